@@ -0,0 +1,115 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+bool arena_init(arena_t *arena, size_t slot_size, bool hugepages) {
+	if (slot_size == 0)
+		return false;
+	*arena = (arena_t){
+			.slot_size = (slot_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1),
+			.hugepages = hugepages,
+	};
+	return true;
+}
+
+// Map `size` bytes (a multiple of ARENA_CHUNK) aligned to ARENA_CHUNK.
+// Explicit huge pages first; failing that, over-map normal pages, trim to
+// alignment and let the kernel back them with transparent huge pages.
+static void *map_chunk(arena_t *arena, size_t size) {
+#ifdef MAP_HUGETLB
+	if (arena->hugepages) {
+		void *huge = mmap(NULL, size, PROT_READ | PROT_WRITE,
+											MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (huge != MAP_FAILED) {
+			arena->huge_chunks++;
+			return huge;
+		}
+	}
+#endif
+	uint8_t *map = mmap(NULL, size + ARENA_CHUNK, PROT_READ | PROT_WRITE,
+											MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	const uintptr_t start = ((uintptr_t)map + ARENA_CHUNK - 1) &
+													~(uintptr_t)(ARENA_CHUNK - 1);
+	uint8_t *aligned = (uint8_t *)start;
+	if (aligned > map)
+		munmap(map, aligned - map);
+	if (map + ARENA_CHUNK > aligned)
+		munmap(aligned + size, map + ARENA_CHUNK - aligned);
+#ifdef MADV_HUGEPAGE
+	if (arena->hugepages)
+		madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+void *arena_alloc_run(arena_t *arena, size_t count) {
+	const size_t bytes = count * arena->slot_size;
+	if (count == 0)
+		return NULL;
+	if ((size_t)(arena->bump_end - arena->bump) < bytes) {
+		// Start a new chunk; what is left of the old one is abandoned
+		const size_t size = (bytes + ARENA_CHUNK - 1) & ~(size_t)(ARENA_CHUNK - 1);
+		void **chunks =
+				realloc(arena->chunks, (arena->chunk_count + 1) * sizeof *chunks);
+		if (!chunks)
+			return NULL;
+		arena->chunks = chunks;
+		size_t *sizes = realloc(arena->chunk_sizes,
+														(arena->chunk_count + 1) * sizeof *sizes);
+		if (!sizes)
+			return NULL;
+		arena->chunk_sizes = sizes;
+		uint8_t *chunk = map_chunk(arena, size);
+		if (!chunk)
+			return NULL;
+		arena->chunks[arena->chunk_count] = chunk;
+		arena->chunk_sizes[arena->chunk_count++] = size;
+		arena->bump = chunk;
+		arena->bump_end = chunk + size;
+	}
+	void *run = arena->bump;
+	arena->bump += bytes;
+	arena->live += count;
+	return run;
+}
+
+void *arena_alloc(arena_t *arena) {
+	void *slot = arena->free_list;
+	if (!slot)
+		return arena_alloc_run(arena, 1);
+	arena->free_list = *(void **)slot;
+	arena->live++;
+	return slot;
+}
+
+void arena_free(arena_t *arena, void *slot) {
+	*(void **)slot = arena->free_list;
+	arena->free_list = slot;
+	arena->live--;
+}
+
+void arena_destroy(arena_t *arena) {
+	for (uint32_t i = 0; i < arena->chunk_count; i++)
+		munmap(arena->chunks[i], arena->chunk_sizes[i]);
+	free(arena->chunks);
+	free(arena->chunk_sizes);
+	*arena = (arena_t){0};
+}
+
+void arena_report(const char *name, const arena_t *arenas, uint32_t count) {
+	size_t live = 0;
+	uint32_t chunks = 0, huge = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		live += arenas[i].live;
+		chunks += arenas[i].chunk_count;
+		huge += arenas[i].huge_chunks;
+	}
+	printf("%s: %zu slots in use, %u chunks, %u of them on explicit huge pages\n",
+				 name, live, chunks, huge);
+}
@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_CHUNK (2u << 20) // Huge page size on x86-64 and arm64
+#define ARENA_ALIGN 64				 // Slots start on a cache line
+
+// Fixed size slot allocator for hosting many machines: machine states,
+// their copied ram pages or snapshot buffers. Slots are carved out of
+// 2 MB aligned chunks, backed by explicit huge pages when any are reserved
+// and by transparent huge pages otherwise, so thousands of machines sit
+// under a handful of TLB entries instead of one per 4 KB page. Freed slots
+// go on a free list for reuse. Not thread safe; use one arena per thread.
+typedef struct {
+	size_t slot_size; // Rounded up to ARENA_ALIGN
+	bool hugepages;		// Ask for huge pages at all
+	void **chunks;
+	size_t *chunk_sizes;
+	uint32_t chunk_count;
+	uint32_t huge_chunks; // Chunks on explicit (MAP_HUGETLB) huge pages
+	uint8_t *bump;				// Unused end of the newest chunk
+	uint8_t *bump_end;
+	void *free_list; // Freed slots, linked through their first word
+	size_t live;		 // Slots handed out
+} arena_t;
+
+bool arena_init(arena_t *arena, size_t slot_size, bool hugepages);
+void *arena_alloc(arena_t *arena);
+// `count` consecutive slots, eg. an array of machines. Each may be freed
+// on its own later.
+void *arena_alloc_run(arena_t *arena, size_t count);
+void arena_free(arena_t *arena, void *slot);
+// Unmap every chunk, including slots still handed out
+void arena_destroy(arena_t *arena);
+// One line on stdout for `count` arenas together, eg. one per worker
+void arena_report(const char *name, const arena_t *arenas, uint32_t count);
+
+#endif
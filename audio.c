@@ -0,0 +1,165 @@
+#include <string.h>
+
+#include "audio.h"
+
+// Dynamic rate control: the frame period is nudged by at most this fraction,
+// small enough that the pitch and game speed change is inaudible
+#define RATE_MAX_ADJUST 0.005
+#define RATE_GAIN 0.01		// Adjustment per 100% latency error
+#define LATENCY_SMOOTH 0.05 // EMA weight of each frame's latency sample
+
+void audio_init(audio_t *audio, uint32_t sample_rate, uint32_t square_wave_freq,
+								int16_t volume, uint32_t latency) {
+	memset(audio, 0, sizeof *audio);
+	audio->sample_rate = sample_rate;
+	audio->volume = volume;
+	audio->half_period = sample_rate / square_wave_freq / 2;
+	if (audio->half_period == 0)
+		audio->half_period = 1;
+
+	audio->frame_samples = sample_rate / 60;
+	audio->frame_frac = sample_rate % 60;
+	audio->latency = latency;
+	// Start ahead of playback so edges are queued before the callback needs them
+	audio->emu_sample = latency;
+	audio->latency_avg = latency;
+	audio->rate_ratio = 1.0;
+}
+
+// Queue a tone edge at `offset` samples into the current emulated frame.
+// Called after every instruction, so it returns early when nothing changed.
+void audio_set_tone(audio_t *audio, uint32_t offset, bool on) {
+	if (on == audio->emu_tone)
+		return;
+
+	const uint32_t head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+	const uint32_t tail = atomic_load_explicit(&audio->tail, memory_order_acquire);
+	if (head - tail == AUDIO_RING_SIZE)
+		return; // Ring full; emu_tone is unchanged so the edge is retried later
+
+	audio->events[head & (AUDIO_RING_SIZE - 1)] = (tone_event_t){
+			.sample = audio->emu_sample + offset,
+			.on = on,
+	};
+	atomic_store_explicit(&audio->head, head + 1, memory_order_release);
+	audio->emu_tone = on;
+}
+
+// Advance the emulated sample clock by one 60hz frame
+void audio_end_frame(audio_t *audio) {
+	audio->emu_sample += audio->frame_samples;
+	audio->frac_acc += audio->frame_frac;
+	if (audio->frac_acc >= 60) {
+		audio->frac_acc -= 60;
+		audio->emu_sample++;
+	}
+
+	// If playback overtook us (pause, stall), jump back ahead of it
+	const uint64_t played =
+			atomic_load_explicit(&audio->played, memory_order_acquire);
+	if (audio->emu_sample < played)
+		audio->emu_sample = played + audio->latency;
+}
+
+// Compare how far the emulated sample clock leads playback against the target
+// latency and return the multiplier for the next frame period. Running ahead
+// (latency too high) lengthens frames, falling behind shortens them.
+double audio_rate_control(audio_t *audio) {
+	if (audio->latency == 0)
+		return 1.0; // Rendered on the emulated clock, nothing to track
+
+	const uint64_t played =
+			atomic_load_explicit(&audio->played, memory_order_acquire);
+	const double latency = (double)audio->emu_sample - (double)played;
+
+	// Playback advances a device buffer at a time, so smooth out the sawtooth
+	audio->latency_avg += LATENCY_SMOOTH * (latency - audio->latency_avg);
+
+	double adjust = RATE_GAIN * (audio->latency_avg - audio->latency) /
+									audio->latency;
+	if (adjust > RATE_MAX_ADJUST)
+		adjust = RATE_MAX_ADJUST;
+	else if (adjust < -RATE_MAX_ADJUST)
+		adjust = -RATE_MAX_ADJUST;
+
+	audio->rate_ratio = 1.0 + adjust;
+	return audio->rate_ratio;
+}
+
+// Fill `count` samples of square wave, silent while the tone is off
+static void render_square(audio_t *audio, int16_t *out, uint32_t count) {
+	if (!audio->tone) {
+		memset(out, 0, count * sizeof *out);
+		return;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		out[i] = ((audio->phase++ / audio->half_period) % 2) ? audio->volume
+																													 : -audio->volume;
+	}
+}
+
+// Render the next `count` samples, applying each queued edge at its exact
+// sample position
+void audio_render(audio_t *audio, int16_t *out, uint32_t count) {
+	const uint32_t head = atomic_load_explicit(&audio->head, memory_order_acquire);
+	uint32_t tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+	const uint64_t end = audio->play_sample + count;
+	uint64_t pos = audio->play_sample;
+
+	while (pos < end) {
+		uint64_t stop = end;
+		if (tail != head) {
+			const tone_event_t *event = &audio->events[tail & (AUDIO_RING_SIZE - 1)];
+			if (event->sample <= pos) {
+				// Edge is due (or late); apply it and look at the next one
+				audio->tone = event->on;
+				tail++;
+				continue;
+			}
+			if (event->sample < end)
+				stop = event->sample;
+		}
+		render_square(audio, out + (pos - audio->play_sample), stop - pos);
+		pos = stop;
+	}
+
+	atomic_store_explicit(&audio->tail, tail, memory_order_release);
+	audio->play_sample = end;
+	atomic_store_explicit(&audio->played, end, memory_order_release);
+}
+
+void audio_callback(void *userdata, uint8_t *stream, int len) {
+	audio_t *audio = (audio_t *)userdata;
+	audio_render(audio, (int16_t *)stream, len / sizeof(int16_t));
+}
+
+void audio_sink_init(audio_sink_t *sink, wav_writer_t *writer) {
+	*sink = (audio_sink_t){
+			.writer = writer,
+			.hash = 0xcbf29ce484222325ULL, // FNV-1a 64 bit offset basis
+	};
+}
+
+// Render everything up to the emulated sample clock. Call after
+// audio_end_frame; with zero latency this is exactly one frame of samples,
+// so output depends only on the ROM and inputs, never on wall time.
+void audio_sink_frame(audio_t *audio, audio_sink_t *sink) {
+	int16_t buffer[1024];
+
+	while (audio->play_sample < audio->emu_sample) {
+		uint64_t n = audio->emu_sample - audio->play_sample;
+		if (n > sizeof buffer / sizeof buffer[0])
+			n = sizeof buffer / sizeof buffer[0];
+		audio_render(audio, buffer, (uint32_t)n);
+
+		for (uint64_t i = 0; i < n; i++) {
+			// Hash as little endian bytes so it matches across hosts
+			const uint16_t sample = (uint16_t)buffer[i];
+			sink->hash = (sink->hash ^ (sample & 0xFF)) * 0x100000001b3ULL;
+			sink->hash = (sink->hash ^ (sample >> 8)) * 0x100000001b3ULL;
+		}
+		if (sink->writer)
+			wav_writer_write(sink->writer, buffer, (uint32_t)n);
+		sink->samples += n;
+	}
+}
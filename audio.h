@@ -0,0 +1,66 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wav_writer.h"
+
+#define AUDIO_RING_SIZE 256 // Tone edges in flight, must be a power of 2
+
+// Tone on/off edge, stamped with the sample it takes effect at
+typedef struct {
+	uint64_t sample; // Position on the emulated sample clock
+	bool on;				 // Tone starts (true) or stops (false)
+} tone_event_t;
+
+// Single producer (emulation thread) / single consumer (audio callback) ring
+// of tone edges. Neither side takes a lock; head is only written by the
+// producer and tail only by the consumer.
+typedef struct {
+	tone_event_t events[AUDIO_RING_SIZE];
+	_Atomic uint32_t head; // Next slot the emulation thread writes
+	_Atomic uint32_t tail; // Next slot the audio callback reads
+
+	// Emulation thread side
+	uint64_t emu_sample;		 // Sample clock at the start of the current frame
+	uint32_t frame_samples;	 // Whole samples per 60hz frame
+	uint32_t frame_frac;		 // Remainder of sample_rate / 60
+	uint32_t frac_acc;			 // Accumulated remainder
+	uint32_t latency;				 // Target lead over playback, in samples
+	bool emu_tone;					 // Last tone state pushed to the ring
+	double latency_avg;			 // Smoothed measured latency in samples
+	double rate_ratio;			 // Current frame period multiplier
+
+	// Audio callback side
+	uint64_t play_sample;		 // Next sample the callback renders
+	_Atomic uint64_t played; // play_sample published for the emulation thread
+	bool tone;							 // Tone state at play_sample
+	uint32_t phase;					 // Running sample index of the square wave
+
+	// Render settings, copied so they outlive the config they came from
+	uint32_t sample_rate;
+	uint32_t half_period; // Samples per half square wave
+	int16_t volume;
+} audio_t;
+
+// Headless audio sink: renders the tone on the emulated clock instead of from
+// a device callback, hashing every sample and optionally streaming to a file
+typedef struct {
+	wav_writer_t *writer; // NULL to only hash
+	uint64_t hash;				// FNV-1a over every rendered sample
+	uint64_t samples;			// Samples rendered so far
+} audio_sink_t;
+
+void audio_init(audio_t *audio, uint32_t sample_rate, uint32_t square_wave_freq,
+								int16_t volume, uint32_t latency);
+void audio_set_tone(audio_t *audio, uint32_t offset, bool on);
+void audio_end_frame(audio_t *audio);
+double audio_rate_control(audio_t *audio);
+void audio_render(audio_t *audio, int16_t *out, uint32_t count);
+void audio_callback(void *userdata, uint8_t *stream, int len);
+void audio_sink_init(audio_sink_t *sink, wav_writer_t *writer);
+void audio_sink_frame(audio_t *audio, audio_sink_t *sink);
+
+#endif
@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "backend.h"
+#include "shm.h"
+#include "wav_writer.h"
+
+static const backend_t *const backends[] = {
+#ifdef HAVE_SDL
+		&backend_sdl,
+#endif
+		&backend_null,
+		&backend_shm,
+		&backend_term,
+};
+
+const backend_t *backend_find(const char *name) {
+	for (size_t i = 0; i < sizeof backends / sizeof backends[0]; i++)
+		if (strcmp(backends[i]->name, name) == 0)
+			return backends[i];
+	return NULL;
+}
+
+// First compiled in backend: the window when built with SDL
+const char *backend_default(void) { return backends[0]->name; }
+
+uint64_t backend_now_ns(void *state) {
+	(void)state;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void backend_sleep_until(void *state, uint64_t deadline_ns) {
+	const uint64_t now = backend_now_ns(state);
+	if (deadline_ns <= now)
+		return;
+	const uint64_t wait = deadline_ns - now;
+	const struct timespec ts = {.tv_sec = wait / 1000000000ULL,
+															.tv_nsec = wait % 1000000000ULL};
+	nanosleep(&ts, NULL);
+}
+
+static void poll_nothing(void *state, chip8_t *chip8) {
+	(void)state;
+	(void)chip8;
+}
+
+// Null backend: runs flat out for max_frames, rendering audio on the
+// emulated clock to an optional file and a hash of every sample
+typedef struct {
+	const char *audio_out;
+	wav_writer_t *writer;
+	audio_sink_t sink;
+} null_state_t;
+
+static void *null_init(const config_t config, audio_t *audio) {
+	null_state_t *null = calloc(1, sizeof *null);
+	if (!null)
+		return NULL;
+	audio_init(audio, config.audio_sample_rate, config.square_wave_freq,
+						 config.volume, 0);
+
+	null->audio_out = config.audio_out;
+	if (config.audio_out) {
+		null->writer = wav_writer_open(config.audio_out, config.audio_sample_rate);
+		if (!null->writer) {
+			fprintf(stderr, "Could not open audio output %s\n", config.audio_out);
+			free(null);
+			return NULL;
+		}
+	}
+	audio_sink_init(&null->sink, null->writer);
+	return null;
+}
+
+static void null_present(void *state, const chip8_t *chip8,
+												 uint32_t dirty_rows) {
+	(void)state;
+	(void)chip8;
+	(void)dirty_rows;
+}
+
+static void null_end_frame(void *state, audio_t *audio) {
+	null_state_t *null = state;
+	audio_sink_frame(audio, &null->sink);
+}
+
+static bool null_cleanup(void *state) {
+	null_state_t *null = state;
+	bool ok = true;
+	if (null->writer && !wav_writer_close(null->writer)) {
+		fprintf(stderr, "Could not write audio output %s\n", null->audio_out);
+		ok = false;
+	}
+	if (ok)
+		printf("audio hash: %016" PRIx64 " (%" PRIu64 " samples)\n",
+					 null->sink.hash, null->sink.samples);
+	free(null);
+	return ok;
+}
+
+const backend_t backend_null = {
+		.name = "null",
+		.realtime = false,
+		.init = null_init,
+		.poll = poll_nothing,
+		.present = null_present,
+		.end_frame = null_end_frame,
+		.now_ns = backend_now_ns,
+		.sleep_until = backend_sleep_until,
+		.cleanup = null_cleanup,
+};
+
+// Shared memory backend: runs in real time with the display, registers and
+// RAM exported for another process to draw. There is no input, so it runs
+// until max_frames or SIGINT/SIGTERM.
+typedef struct {
+	shm_export_t export;
+	audio_sink_t sink;
+} shm_state_t;
+
+static volatile sig_atomic_t shm_stop;
+
+static void shm_on_signal(int sig) {
+	(void)sig;
+	shm_stop = 1;
+}
+
+static void *shm_init(const config_t config, audio_t *audio) {
+	shm_state_t *shm = calloc(1, sizeof *shm);
+	if (!shm)
+		return NULL;
+	if (!shm_export_open(&shm->export, config.shm_name)) {
+		fprintf(stderr, "Could not create shared memory %s\n",
+						config.shm_name ? config.shm_name : "");
+		free(shm);
+		return NULL;
+	}
+	printf("Exporting machine state to shared memory %s\n", shm->export.name);
+
+	audio_init(audio, config.audio_sample_rate, config.square_wave_freq,
+						 config.volume, 0);
+	audio_sink_init(&shm->sink, NULL);
+
+	const struct sigaction action = {.sa_handler = shm_on_signal};
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	return shm;
+}
+
+static void shm_poll(void *state, chip8_t *chip8) {
+	(void)state;
+	if (shm_stop)
+		chip8->state = QUIT;
+}
+
+static void shm_present(void *state, const chip8_t *chip8,
+												uint32_t dirty_rows) {
+	(void)dirty_rows;
+	shm_state_t *shm = state;
+	shm_export_publish(&shm->export, chip8);
+}
+
+// Nothing plays the tone; drain the ring on the emulated clock
+static void shm_end_frame(void *state, audio_t *audio) {
+	shm_state_t *shm = state;
+	audio_sink_frame(audio, &shm->sink);
+}
+
+static bool shm_cleanup(void *state) {
+	shm_state_t *shm = state;
+	shm_export_close(&shm->export);
+	free(shm);
+	return true;
+}
+
+const backend_t backend_shm = {
+		.name = "shm",
+		.realtime = true,
+		.init = shm_init,
+		.poll = shm_poll,
+		.present = shm_present,
+		.end_frame = shm_end_frame,
+		.now_ns = backend_now_ns,
+		.sleep_until = backend_sleep_until,
+		.cleanup = shm_cleanup,
+};
@@ -0,0 +1,57 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "chip8.h"
+
+// Display, input, audio and clock for one way of running the emulator. The
+// main loop only talks to the machine through these, so backends that don't
+// need SDL never link it.
+//
+// Each time round, the main loop calls poll, emulates the frames that are due
+// (calling end_frame once each frame's tone edges are queued in `audio`),
+// then present with the rows drawn since the last present. Realtime
+// backends sleep until the next frame deadline before presenting, unless
+// present itself waits for vsync.
+typedef struct {
+	const char *name;
+	bool realtime; // Paced to 60hz on now_ns/sleep_until, else flat out
+
+	// Returns the backend's state, or NULL on failure. Must audio_init
+	// `audio`, with the device latency if the backend plays it in real time.
+	void *(*init)(const config_t config, audio_t *audio);
+	void (*poll)(void *state, chip8_t *chip8);
+	void (*present)(void *state, const chip8_t *chip8, uint32_t dirty_rows);
+	void (*end_frame)(void *state, audio_t *audio);
+	uint64_t (*now_ns)(void *state);
+	void (*sleep_until)(void *state, uint64_t deadline_ns);
+	bool (*cleanup)(void *state);
+	// Display refresh rate when present blocks on vsync, else 0. May be NULL.
+	uint32_t (*refresh_hz)(void *state);
+	// Present config.instances machines at once, with the rows drawn on each
+	// since the last present. NULL means only the first machine is shown.
+	void (*present_tiles)(void *state, const chip8_t *machines, uint32_t count,
+												const uint32_t *dirty_rows);
+	// Whether presented frames can be seen; while not, the main loop skips
+	// present and applies config.when_hidden. NULL means always.
+	bool (*visible)(void *state);
+} backend_t;
+
+extern const backend_t backend_null; // No window or audio device
+extern const backend_t backend_shm;	 // Machine state in shared memory only
+extern const backend_t backend_term; // Text in the terminal
+#ifdef HAVE_SDL
+extern const backend_t backend_sdl; // Window and audio device
+#endif
+
+const backend_t *backend_find(const char *name);
+const char *backend_default(void);
+
+// Monotonic clock and absolute sleep for backends without their own
+uint64_t backend_now_ns(void *state);
+void backend_sleep_until(void *state, uint64_t deadline_ns);
+
+#endif
@@ -0,0 +1,683 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SDL.h"
+#include "SDL_audio.h"
+#include "SDL_error.h"
+#include "SDL_events.h"
+#include "SDL_keycode.h"
+#include "SDL_log.h"
+#include "SDL_render.h"
+#include "SDL_timer.h"
+#include "SDL_video.h"
+
+#include "backend.h"
+#include "expand.h"
+
+typedef struct {
+	SDL_Window *window;
+	SDL_Renderer *renderer;
+	SDL_AudioSpec want, have;
+	SDL_AudioDeviceID dev;
+	SDL_Texture *texture; // Window sized RGBA8888 copy of the display
+	expand_t expand;
+	phosphor_t *phosphor; // NULL without persistence, else one per tile
+	bool drawn;						// Texture holds a full frame
+	uint32_t width, height; // Texture and window size
+	uint32_t tiles;					// Machines drawn in a grid, 1 for the usual window
+	uint32_t tile_columns;
+	uint32_t *tile_pixels; // CPU copy of the texture when tiled
+	uint32_t refresh_hz;	// Display rate when presenting with vsync, else 0
+	bool visible;					// Not minimised or hidden
+} sdl_t;
+
+#define TILE_GAP 2				// Texels between tiles
+#define PROBE_FRAMES 20 // Uploads and presents timed per render driver
+
+// The probed renderer is cached with one "<host> <video driver> <renderer>"
+// line per machine, so thin clients sharing a home directory each keep
+// their own choice
+static bool renderer_cache_path(char *path, size_t size) {
+	const char *dir = getenv("XDG_CONFIG_HOME");
+	if (dir && *dir)
+		return snprintf(path, size, "%s/chip8-renderer", dir) < (int)size;
+	const char *home = getenv("HOME");
+	if (!home)
+		return false;
+	snprintf(path, size, "%s/.config", home);
+	mkdir(path, 0700); // Usually exists already
+	return snprintf(path, size, "%s/.config/chip8-renderer", home) < (int)size;
+}
+
+static bool load_renderer_choice(const char *key, char *name, size_t size) {
+	char path[512];
+	if (!renderer_cache_path(path, sizeof path))
+		return false;
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return false;
+
+	char line[512];
+	const size_t key_len = strlen(key);
+	bool found = false;
+	while (fgets(line, sizeof line, file)) {
+		if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ') {
+			snprintf(name, size, "%s", &line[key_len + 1]);
+			name[strcspn(name, "\n")] = '\0';
+			found = true;
+		}
+	}
+	fclose(file);
+	return found;
+}
+
+// Rewrite the cache with this machine's line replaced
+static void save_renderer_choice(const char *key, const char *name) {
+	char path[512], tmp_path[520];
+	if (!renderer_cache_path(path, sizeof path))
+		return;
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+	FILE *out = fopen(tmp_path, "w");
+	if (!out)
+		return;
+
+	FILE *in = fopen(path, "r");
+	if (in) {
+		char line[512];
+		const size_t key_len = strlen(key);
+		while (fgets(line, sizeof line, in))
+			if (!(strncmp(line, key, key_len) == 0 && line[key_len] == ' '))
+				fputs(line, out);
+		fclose(in);
+	}
+	fprintf(out, "%s %s\n", key, name);
+	if (fclose(out) == 0)
+		rename(tmp_path, path);
+	else
+		remove(tmp_path);
+}
+
+// Time full frame uploads and presents on every render driver, without
+// vsync, and return the index of the fastest or -1 if none work
+static int probe_renderers(sdl_t *sdl, const config_t config) {
+	const int width = config.window_width * config.scale_factor;
+	const int height = config.window_height * config.scale_factor;
+	const uint64_t perf_freq = SDL_GetPerformanceFrequency();
+	expand_t expand;
+	expand_init(&expand, config.fg_color, config.bg_color, config.scale_factor);
+
+	int best = -1;
+	uint64_t best_time = UINT64_MAX;
+	for (int i = 0; i < SDL_GetNumRenderDrivers(); i++) {
+		SDL_Renderer *renderer = SDL_CreateRenderer(sdl->window, i, 0);
+		if (!renderer)
+			continue;
+		SDL_Texture *texture =
+				SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+													SDL_TEXTUREACCESS_STREAMING, width, height);
+		if (!texture) {
+			SDL_DestroyRenderer(renderer);
+			continue;
+		}
+
+		const uint64_t start = SDL_GetPerformanceCounter();
+		for (uint32_t frame = 0; frame < PROBE_FRAMES; frame++) {
+			uint64_t display[32];
+			for (uint32_t y = 0; y < 32; y++)
+				display[y] = (frame + y) & 1 ? 0xAAAAAAAAAAAAAAAAULL : 0;
+			void *pixels;
+			int pitch;
+			if (SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0) {
+				expand_rows32(&expand, display, NULL, 0, 32, pixels,
+											pitch / sizeof(uint32_t));
+				SDL_UnlockTexture(texture);
+			}
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+			SDL_RenderPresent(renderer);
+		}
+		const uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+
+		SDL_RendererInfo info;
+		SDL_GetRendererInfo(renderer, &info);
+		SDL_Log("Renderer %s: %.2f ms per frame\n", info.name,
+						elapsed * 1000.0 / perf_freq / PROBE_FRAMES);
+		if (elapsed < best_time) {
+			best_time = elapsed;
+			best = i;
+		}
+		SDL_DestroyTexture(texture);
+		SDL_DestroyRenderer(renderer);
+	}
+	return best;
+}
+
+// Render driver index to use: the one named by --renderer, else the cached
+// probe result for this machine, else a fresh probe. -1 lets SDL choose.
+static int choose_renderer(sdl_t *sdl, const config_t config) {
+	const bool probe = config.renderer && strcmp(config.renderer, "probe") == 0;
+	char name[64] = "";
+	if (config.renderer && !probe) {
+		snprintf(name, sizeof name, "%s", config.renderer);
+	} else {
+		char host[256] = "";
+		gethostname(host, sizeof host - 1);
+		const char *video = SDL_GetCurrentVideoDriver();
+		char key[320];
+		snprintf(key, sizeof key, "%s %s", *host ? host : "unknown",
+						 video ? video : "none");
+
+		if (probe || !load_renderer_choice(key, name, sizeof name)) {
+			const int best = probe_renderers(sdl, config);
+			SDL_RendererInfo info;
+			if (best >= 0 && SDL_GetRenderDriverInfo(best, &info) == 0)
+				save_renderer_choice(key, info.name);
+			return best;
+		}
+	}
+
+	for (int i = 0; i < SDL_GetNumRenderDrivers(); i++) {
+		SDL_RendererInfo info;
+		if (SDL_GetRenderDriverInfo(i, &info) == 0 && strcmp(info.name, name) == 0)
+			return i;
+	}
+	SDL_Log("Renderer %s is not available\n", name);
+	return -1;
+}
+
+// Several machines share the window as a grid of tiles, as square as it
+// gets, shrunk so the grid is about the size of the usual window
+static uint32_t layout_tiles(sdl_t *sdl, const config_t config) {
+	sdl->tiles = config.instances > 1 ? config.instances : 1;
+	uint32_t columns = config.tile_columns;
+	if (!columns)
+		columns = (uint32_t)ceil(sqrt(sdl->tiles));
+	if (columns > sdl->tiles)
+		columns = sdl->tiles;
+	const uint32_t rows = (sdl->tiles + columns - 1) / columns;
+	const uint32_t longest = columns > rows ? columns : rows;
+	uint32_t scale = config.scale_factor / longest;
+	if (scale < 1)
+		scale = 1;
+	sdl->tile_columns = columns;
+	sdl->width = columns * config.window_width * scale + (columns - 1) * TILE_GAP;
+	sdl->height = rows * config.window_height * scale + (rows - 1) * TILE_GAP;
+	return scale;
+}
+
+static bool init_sdl(sdl_t *sdl, const config_t config, audio_t *audio) {
+	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0) {
+		SDL_Log("Could not init SDL subsystems! %s\n", SDL_GetError());
+		return false;
+	}
+	const uint32_t scale = layout_tiles(sdl, config);
+	sdl->window = SDL_CreateWindow("CHIP8 Emulator", SDL_WINDOWPOS_CENTERED,
+																 SDL_WINDOWPOS_CENTERED, sdl->width,
+																 sdl->height, 0);
+	if (!sdl->window) {
+		SDL_Log("Could not create window %s\n", SDL_GetError());
+		return false;
+	}
+
+	// Accelerated isn't required: on some machines software is faster
+	Uint32 flags = 0;
+	if (!config.no_vsync)
+		flags |= SDL_RENDERER_PRESENTVSYNC;
+	const int driver = choose_renderer(sdl, config);
+	sdl->renderer = SDL_CreateRenderer(sdl->window, driver, flags);
+	if (!sdl->renderer && driver >= 0)
+		sdl->renderer = SDL_CreateRenderer(sdl->window, -1, flags);
+	if (!sdl->renderer) {
+		SDL_Log("Could not create renderer %s\n", SDL_GetError());
+		return false;
+	}
+
+	// Only present at the display's rate if the driver really waits for
+	// vsync, or the main loop would spin
+	SDL_RendererInfo info;
+	SDL_DisplayMode mode;
+	if (SDL_GetRendererInfo(sdl->renderer, &info) == 0 &&
+			(info.flags & SDL_RENDERER_PRESENTVSYNC)) {
+		sdl->refresh_hz = 60; // Unknown rates are most likely 60hz
+		if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(sdl->window),
+																	&mode) == 0 &&
+				mode.refresh_rate > 0)
+			sdl->refresh_hz = mode.refresh_rate;
+	}
+
+	sdl->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888,
+																	 SDL_TEXTUREACCESS_STREAMING, sdl->width,
+																	 sdl->height);
+	if (!sdl->texture) {
+		SDL_Log("Could not create texture %s\n", SDL_GetError());
+		return false;
+	}
+	if (sdl->tiles > 1) {
+		sdl->tile_pixels =
+				malloc((size_t)sdl->width * sdl->height * sizeof *sdl->tile_pixels);
+		if (!sdl->tile_pixels)
+			return false;
+	}
+	expand_init(&sdl->expand, config.fg_color, config.bg_color, scale);
+	// Below 3 texels a pixel would be all outline
+	sdl->expand.outline = config.pixel_outline && scale >= 3;
+	sdl->expand.scanlines = config.scanlines;
+	if (config.persistence) {
+		sdl->phosphor = malloc(sdl->tiles * sizeof *sdl->phosphor);
+		if (!sdl->phosphor)
+			return false;
+		// Fade per present, so at a higher refresh rate the same per frame
+		// decay is spread over more, smaller steps
+		double keep = config.persistence / 100.0;
+		if (sdl->refresh_hz)
+			keep = pow(keep, 60.0 / sdl->refresh_hz);
+		for (uint32_t i = 0; i < sdl->tiles; i++)
+			phosphor_init(&sdl->phosphor[i], config.fg_color, config.bg_color,
+										(uint32_t)(keep * 256));
+	}
+
+	sdl->visible = !(SDL_GetWindowFlags(sdl->window) &
+									 (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED));
+
+	// Initialize audio config
+	sdl->want = (SDL_AudioSpec){
+			.freq = config.audio_sample_rate,
+			.format = AUDIO_S16LSB, // Signed 16bite little endian
+			.channels = 1,					// Mono .samples =
+			.samples = 512,
+			.callback = audio_callback,
+			.userdata = audio, // Outlives init_sdl, unlike config
+	};
+
+	sdl->dev = SDL_OpenAudioDevice(NULL, 0, &sdl->want, &sdl->have, 0);
+	if (!(sdl->dev > 0)) {
+		SDL_Log("Could not get an audio device %s\n", SDL_GetError());
+		return false;
+	}
+
+	if ((sdl->want.format != sdl->have.format) ||
+			(sdl->want.channels != sdl->have.channels)) {
+		SDL_Log("Could not get desired audio spec \n");
+		return false;
+	}
+
+	// Run ahead of playback by the target latency, but never by less than one
+	// device buffer or edges would land in buffers already handed to the device.
+	// The device is left running; the tone is switched by events in the audio
+	// ring from here on
+	uint32_t latency = sdl->have.freq * config.audio_latency_ms / 1000;
+	if (latency < sdl->have.samples)
+		latency = sdl->have.samples;
+	audio_init(audio, sdl->have.freq, config.square_wave_freq, config.volume,
+						 latency);
+	SDL_PauseAudioDevice(sdl->dev, 0);
+
+	return true;
+}
+
+static void final_cleanup(const sdl_t sdl) {
+	free(sdl.phosphor);
+	free(sdl.tile_pixels);
+	SDL_DestroyTexture(sdl.texture);
+	SDL_DestroyRenderer(sdl.renderer);
+	SDL_DestroyWindow(sdl.window);
+	SDL_CloseAudioDevice(sdl.dev);
+	SDL_Quit(); // shutdown SDL subsystems
+}
+
+// Clear screen / SDL window to background color
+static void clear_screen(const config_t config, const sdl_t sdl) {
+	const uint8_t r = (config.bg_color >> 24) & 0xFF;
+	const uint8_t g = (config.bg_color >> 16) & 0xFF;
+	const uint8_t b = (config.bg_color >> 8) & 0xFF;
+	const uint8_t a = (config.bg_color >> 0) & 0xFF;
+	SDL_SetRenderDrawColor(sdl.renderer, r, g, b, a);
+	SDL_RenderClear(sdl.renderer);
+}
+
+// Update window with any changes. Only the band of rows drawn this frame is
+// expanded into the streaming texture; the GPU scales nothing since the
+// texture is already window sized. With persistence, rows that are still
+// fading are redrawn too.
+static void update_screen(sdl_t *sdl, const chip8_t *chip8,
+													uint32_t dirty_rows) {
+	uint32_t dirty = dirty_rows;
+	if (sdl->phosphor)
+		dirty = phosphor_update(sdl->phosphor, chip8->display);
+	if (!sdl->drawn)
+		dirty = ~0u;
+	if (dirty) {
+		const uint32_t top = __builtin_ctz(dirty);
+		const uint32_t bottom = 31 - __builtin_clz(dirty);
+		const uint32_t scale = sdl->expand.scale;
+		const SDL_Rect band = {.x = 0,
+													 .y = top * scale,
+													 .w = 64 * scale,
+													 .h = (bottom - top + 1) * scale};
+		void *pixels;
+		int pitch;
+		if (SDL_LockTexture(sdl->texture, &band, &pixels, &pitch) == 0) {
+			expand_rows32(&sdl->expand, chip8->display, sdl->phosphor, top,
+										bottom - top + 1, pixels, pitch / sizeof(uint32_t));
+			SDL_UnlockTexture(sdl->texture);
+			sdl->drawn = true;
+		}
+	}
+	SDL_RenderCopy(sdl->renderer, sdl->texture, NULL, NULL);
+	SDL_RenderPresent(sdl->renderer);
+}
+
+// Update a tiled window. Each machine's changed rows are expanded into its
+// tile in a CPU copy of the texture, then the band of lines covering every
+// change is uploaded at once, so the whole grid costs one upload and one
+// present however many machines there are.
+static void update_tiles(sdl_t *sdl, const chip8_t *machines, uint32_t count,
+												 const uint32_t *dirty_rows) {
+	const uint32_t scale = sdl->expand.scale;
+	const uint32_t tile_width = 64 * scale + TILE_GAP;
+	const uint32_t tile_height = 32 * scale + TILE_GAP;
+	const size_t pitch = sdl->width;
+	if (!sdl->drawn) {
+		// Gaps and empty cells halfway between fg and bg
+		const uint32_t gap = ((sdl->expand.fg >> 1) & 0x7F7F7F7F) +
+												 ((sdl->expand.bg >> 1) & 0x7F7F7F7F);
+		for (size_t i = 0; i < pitch * sdl->height; i++)
+			sdl->tile_pixels[i] = gap;
+	}
+
+	uint32_t top = sdl->height, bottom = 0; // Texture lines changed
+	for (uint32_t i = 0; i < count && i < sdl->tiles; i++) {
+		const phosphor_t *phosphor = NULL;
+		uint32_t dirty = dirty_rows[i];
+		if (sdl->phosphor) {
+			phosphor = &sdl->phosphor[i];
+			dirty = phosphor_update(&sdl->phosphor[i], machines[i].display);
+		}
+		if (!sdl->drawn)
+			dirty = ~0u;
+		if (!dirty)
+			continue;
+		const uint32_t first = __builtin_ctz(dirty);
+		const uint32_t rows = 32 - __builtin_clz(dirty) - first;
+		const uint32_t x = i % sdl->tile_columns * tile_width;
+		const uint32_t y = i / sdl->tile_columns * tile_height + first * scale;
+		expand_rows32(&sdl->expand, machines[i].display, phosphor, first, rows,
+									&sdl->tile_pixels[y * pitch + x], pitch);
+		if (y < top)
+			top = y;
+		if (y + rows * scale > bottom)
+			bottom = y + rows * scale;
+	}
+	if (top < bottom) {
+		const SDL_Rect band = {
+				.x = 0, .y = top, .w = sdl->width, .h = bottom - top};
+		if (SDL_UpdateTexture(sdl->texture, &band, &sdl->tile_pixels[top * pitch],
+													pitch * sizeof(uint32_t)) == 0)
+			sdl->drawn = true;
+	}
+	SDL_RenderCopy(sdl->renderer, sdl->texture, NULL, NULL);
+	SDL_RenderPresent(sdl->renderer);
+}
+
+// User input
+// CHIP8 Keypad   QWERTY
+// 123C           1234
+// 456D           qwer
+// 789E           asdf
+// A0BF           zxcv
+static void handle_input(sdl_t *sdl, chip8_t *chip8) {
+	SDL_Event event;
+
+	while (SDL_PollEvent(&event)) {
+		switch (event.type) {
+		case SDL_QUIT:
+			// Exit window; End program
+			chip8->state = QUIT;
+			return;
+		case SDL_WINDOWEVENT:
+			// SDL2 has no occlusion event, so minimised or hidden is as good as it
+			// gets; a covered window keeps drawing
+			switch (event.window.event) {
+			case SDL_WINDOWEVENT_HIDDEN:
+			case SDL_WINDOWEVENT_MINIMIZED:
+				sdl->visible = false;
+				break;
+			case SDL_WINDOWEVENT_SHOWN:
+			case SDL_WINDOWEVENT_RESTORED:
+			case SDL_WINDOWEVENT_MAXIMIZED:
+			case SDL_WINDOWEVENT_EXPOSED:
+				if (!sdl->visible)
+					sdl->drawn = false; // Some drivers drop textures while minimised
+				sdl->visible = true;
+				break;
+			default:
+				break;
+			}
+			break;
+		case SDL_KEYDOWN:
+			switch (event.key.keysym.sym) {
+			case SDLK_ESCAPE:
+				chip8->state = QUIT;
+				return;
+			case SDLK_SPACE:
+				// space bar
+				if (chip8->state == RUNNING) {
+					puts("====== PAUSED ======");
+					chip8->state = PAUSED;
+				} else {
+					puts("====== RESUME ======");
+					chip8->state = RUNNING;
+				}
+				return;
+			case SDLK_1:
+				chip8->keypad[0x1] = true;
+				break;
+			case SDLK_2:
+				chip8->keypad[0x2] = true;
+				break;
+			case SDLK_3:
+				chip8->keypad[0x3] = true;
+				break;
+			case SDLK_4:
+				chip8->keypad[0xC] = true;
+				break;
+
+			case SDLK_q:
+				chip8->keypad[0x4] = true;
+				break;
+			case SDLK_w:
+				chip8->keypad[0x5] = true;
+				break;
+			case SDLK_e:
+				chip8->keypad[0x6] = true;
+				break;
+			case SDLK_r:
+				chip8->keypad[0xD] = true;
+				break;
+
+			case SDLK_a:
+				chip8->keypad[0x7] = true;
+				break;
+			case SDLK_s:
+				chip8->keypad[0x8] = true;
+				break;
+			case SDLK_d:
+				chip8->keypad[0x9] = true;
+				break;
+			case SDLK_f:
+				chip8->keypad[0xE] = true;
+				break;
+
+			case SDLK_z:
+				chip8->keypad[0xA] = true;
+				break;
+			case SDLK_x:
+				chip8->keypad[0x0] = true;
+				break;
+			case SDLK_c:
+				chip8->keypad[0xB] = true;
+				break;
+			case SDLK_v:
+				chip8->keypad[0xF] = true;
+				break;
+			default:
+				break;
+			}
+			break;
+		case SDL_KEYUP:
+			switch (event.key.keysym.sym) {
+
+			case SDLK_1:
+				chip8->keypad[0x1] = false;
+				break;
+			case SDLK_2:
+				chip8->keypad[0x2] = false;
+				break;
+			case SDLK_3:
+				chip8->keypad[0x3] = false;
+				break;
+			case SDLK_4:
+				chip8->keypad[0xC] = false;
+				break;
+
+			case SDLK_q:
+				chip8->keypad[0x4] = false;
+				break;
+			case SDLK_w:
+				chip8->keypad[0x5] = false;
+				break;
+			case SDLK_e:
+				chip8->keypad[0x6] = false;
+				break;
+			case SDLK_r:
+				chip8->keypad[0xD] = false;
+				break;
+
+			case SDLK_a:
+				chip8->keypad[0x7] = false;
+				break;
+			case SDLK_s:
+				chip8->keypad[0x8] = false;
+				break;
+			case SDLK_d:
+				chip8->keypad[0x9] = false;
+				break;
+			case SDLK_f:
+				chip8->keypad[0xE] = false;
+				break;
+
+			case SDLK_z:
+				chip8->keypad[0xA] = false;
+				break;
+			case SDLK_x:
+				chip8->keypad[0x0] = false;
+				break;
+			case SDLK_c:
+				chip8->keypad[0xB] = false;
+				break;
+			case SDLK_v:
+				chip8->keypad[0xF] = false;
+				break;
+			default:
+				break;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+typedef struct {
+	sdl_t sdl;
+	uint64_t perf_freq;
+} sdl_state_t;
+
+static void *sdl_backend_init(const config_t config, audio_t *audio) {
+	sdl_state_t *state = calloc(1, sizeof *state);
+	if (!state)
+		return NULL;
+	if (!init_sdl(&state->sdl, config, audio)) {
+		free(state);
+		return NULL;
+	}
+	state->perf_freq = SDL_GetPerformanceFrequency();
+
+	// Initial screen clear
+	clear_screen(config, state->sdl);
+	return state;
+}
+
+static void sdl_backend_poll(void *state, chip8_t *chip8) {
+	handle_input(&((sdl_state_t *)state)->sdl, chip8);
+}
+
+static void sdl_backend_present(void *state, const chip8_t *chip8,
+																uint32_t dirty_rows) {
+	update_screen(&((sdl_state_t *)state)->sdl, chip8, dirty_rows);
+}
+
+static void sdl_backend_present_tiles(void *state, const chip8_t *machines,
+																			uint32_t count,
+																			const uint32_t *dirty_rows) {
+	sdl_t *sdl = &((sdl_state_t *)state)->sdl;
+	if (sdl->tiles > 1)
+		update_tiles(sdl, machines, count, dirty_rows);
+	else
+		update_screen(sdl, machines, dirty_rows[0]);
+}
+
+// The device callback plays the ring in real time
+static void sdl_backend_end_frame(void *state, audio_t *audio) {
+	(void)state;
+	(void)audio;
+}
+
+static uint64_t sdl_backend_now_ns(void *state) {
+	const sdl_state_t *sdl_state = state;
+	const uint64_t counter = SDL_GetPerformanceCounter();
+	return counter / sdl_state->perf_freq * 1000000000ULL +
+				 counter % sdl_state->perf_freq * 1000000000ULL / sdl_state->perf_freq;
+}
+
+static void sdl_backend_sleep_until(void *state, uint64_t deadline_ns) {
+	const uint64_t now = sdl_backend_now_ns(state);
+	if (now < deadline_ns)
+		SDL_Delay((deadline_ns - now) / 1000000);
+}
+
+static uint32_t sdl_backend_refresh_hz(void *state) {
+	return ((sdl_state_t *)state)->sdl.refresh_hz;
+}
+
+static bool sdl_backend_visible(void *state) {
+	return ((sdl_state_t *)state)->sdl.visible;
+}
+
+static bool sdl_backend_cleanup(void *state) {
+	final_cleanup(((sdl_state_t *)state)->sdl);
+	free(state);
+	return true;
+}
+
+const backend_t backend_sdl = {
+		.name = "sdl",
+		.realtime = true,
+		.init = sdl_backend_init,
+		.poll = sdl_backend_poll,
+		.present = sdl_backend_present,
+		.present_tiles = sdl_backend_present_tiles,
+		.end_frame = sdl_backend_end_frame,
+		.now_ns = sdl_backend_now_ns,
+		.sleep_until = sdl_backend_sleep_until,
+		.cleanup = sdl_backend_cleanup,
+		.refresh_hz = sdl_backend_refresh_hz,
+		.visible = sdl_backend_visible,
+};
@@ -0,0 +1,434 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define DISPLAY_W 64 // CHIP8 display size
+#define DISPLAY_H 32
+
+// BT.601 limited range conversion of an RGBA8888 colour to Y, U, V
+static void rgba_to_yuv(uint32_t color, uint8_t yuv[3]) {
+	const int r = (color >> 24) & 0xFF;
+	const int g = (color >> 16) & 0xFF;
+	const int b = (color >> 8) & 0xFF;
+	yuv[0] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	yuv[1] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+	yuv[2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// Write one plane of a frame, expanded through `expand`, each line
+// repeated scale times. Packed RGB goes through the 32 bit kernel and is
+// narrowed to 3 bytes in place.
+static bool write_plane(capture_t *capture, const uint64_t rows[32],
+												const expand_t *expand, bool rgb) {
+	const uint32_t width = DISPLAY_W * capture->scale;
+	const uint32_t bytes = rgb ? 3 : 1;
+	for (uint32_t y = 0; y < DISPLAY_H; y++) {
+		if (rgb) {
+			uint32_t *wide = (uint32_t *)capture->line;
+			expand_line32(expand, rows[y], wide);
+			for (uint32_t x = 0; x < width; x++) {
+				const uint32_t color = wide[x]; // Read before its bytes are reused
+				capture->line[x * 3] = color >> 24;
+				capture->line[x * 3 + 1] = color >> 16;
+				capture->line[x * 3 + 2] = color >> 8;
+			}
+		} else {
+			expand_line8(expand, rows[y], capture->line);
+		}
+		for (uint32_t s = 0; s < capture->scale; s++)
+			if (fwrite(capture->line, bytes, width, capture->file) != width)
+				return false;
+	}
+	return true;
+}
+
+static void put_le16(FILE *file, uint32_t value) {
+	fputc(value & 0xFF, file);
+	fputc((value >> 8) & 0xFF, file);
+}
+
+// GIF header: logical screen, 2 entry global palette (0 = bg, 1 = fg) and
+// the NETSCAPE2.0 extension so the clip loops
+static void gif_write_header(capture_t *capture) {
+	FILE *file = capture->file;
+	fputs("GIF89a", file);
+	put_le16(file, DISPLAY_W * capture->scale);
+	put_le16(file, DISPLAY_H * capture->scale);
+	fputc(0x80, file); // Global colour table of 2 entries
+	fputc(0, file);		 // Background colour index
+	fputc(0, file);		 // Square pixels
+	const uint32_t palette[2] = {capture->bg_color, capture->fg_color};
+	for (int i = 0; i < 2; i++) {
+		fputc((palette[i] >> 24) & 0xFF, file);
+		fputc((palette[i] >> 16) & 0xFF, file);
+		fputc((palette[i] >> 8) & 0xFF, file);
+	}
+	fputs("\x21\xFF\x0BNETSCAPE2.0\x03\x01", file);
+	put_le16(file, 0); // Loop forever
+	fputc(0, file);
+}
+
+// Image data is LZW codes packed LSB first into sub-blocks of <= 255 bytes
+static void gif_put_byte(capture_t *capture, uint8_t byte) {
+	gif_t *gif = capture->gif;
+	gif->block[++gif->block[0]] = byte;
+	if (gif->block[0] == 255) {
+		fwrite(gif->block, 1, 256, capture->file);
+		gif->block[0] = 0;
+	}
+}
+
+static void gif_put_code(capture_t *capture, uint32_t code, uint32_t size) {
+	gif_t *gif = capture->gif;
+	gif->bits |= code << gif->bit_count;
+	gif->bit_count += size;
+	while (gif->bit_count >= 8) {
+		gif_put_byte(capture, gif->bits & 0xFF);
+		gif->bits >>= 8;
+		gif->bit_count -= 8;
+	}
+}
+
+// LZW compress the given rectangle (in CHIP8 pixels) of `rows`, scaled up.
+// With only 2 colours the minimum code size is 2: codes 0-3 are literals,
+// 4 is clear and 5 is end of information.
+static void gif_write_image(capture_t *capture, const uint64_t rows[32],
+														uint32_t left, uint32_t top, uint32_t width,
+														uint32_t height) {
+	gif_t *gif = capture->gif;
+	FILE *file = capture->file;
+	const uint32_t scale = capture->scale;
+
+	fputc(0x2C, file); // Image descriptor
+	put_le16(file, left * scale);
+	put_le16(file, top * scale);
+	put_le16(file, width * scale);
+	put_le16(file, height * scale);
+	fputc(0, file); // No local palette, not interlaced
+	fputc(2, file); // LZW minimum code size
+
+	memset(gif->child, 0, sizeof gif->child);
+	uint32_t code_size = 3;
+	uint32_t next_code = 6;
+	int32_t key = -1;
+	gif_put_code(capture, 4, code_size);
+
+	const uint8_t *indices = capture->line + left * scale;
+	for (uint32_t py = 0; py < height * scale; py++) {
+		if (py % scale == 0)
+			expand_line8(&capture->expand[0], rows[top + py / scale], capture->line);
+		for (uint32_t px = 0; px < width * scale; px++) {
+			const uint32_t pixel = indices[px];
+			if (key < 0) {
+				key = pixel;
+				continue;
+			}
+			if (gif->child[key][pixel]) {
+				key = gif->child[key][pixel]; // Extend the current string
+				continue;
+			}
+
+			gif_put_code(capture, key, code_size);
+			if (next_code < 4096) {
+				if (next_code == 1u << code_size)
+					code_size++;
+				gif->child[key][pixel] = next_code++;
+			} else {
+				// Dictionary full, start over
+				gif_put_code(capture, 4, code_size);
+				memset(gif->child, 0, sizeof gif->child);
+				code_size = 3;
+				next_code = 6;
+			}
+			key = pixel;
+		}
+	}
+	gif_put_code(capture, key, code_size);
+	gif_put_code(capture, 5, code_size);
+
+	if (gif->bit_count > 0)
+		gif_put_byte(capture, gif->bits & 0xFF);
+	gif->bits = gif->bit_count = 0;
+	if (gif->block[0] > 0)
+		fwrite(gif->block, 1, gif->block[0] + 1, file);
+	gif->block[0] = 0;
+	fputc(0, file); // Block terminator
+}
+
+// Graphic control extension of the image after it: show it for `delay` cs
+static void gif_put_control(FILE *file, uint32_t delay) {
+	fputs("\x21\xF9\x04", file);
+	fputc(0x04, file); // Leave the image in place (disposal 1)
+	put_le16(file, delay);
+	fputc(0, file); // No transparency
+	fputc(0, file);
+}
+
+// Write the held image, cropped to the bounding box of what changed since
+// the last written image. Only rows marked dirty can differ.
+static bool gif_emit(capture_t *capture) {
+	gif_t *gif = capture->gif;
+	uint32_t top = DISPLAY_H, bottom = 0;
+	uint64_t columns = 0;
+
+	if (gif->elapsed_frames == 0) {
+		// First image must cover the whole canvas
+		top = 0;
+		bottom = DISPLAY_H - 1;
+		columns = ~0ULL;
+	} else {
+		for (uint32_t y = 0; y < DISPLAY_H; y++) {
+			if (!((gif->held_dirty >> y) & 1))
+				continue;
+			const uint64_t diff = gif->held[y] ^ gif->shown[y];
+			if (!diff)
+				continue;
+			if (y < top)
+				top = y;
+			bottom = y;
+			columns |= diff;
+		}
+	}
+
+	uint32_t left = 0, width = 1, height = 1;
+	if (columns) {
+		left = __builtin_clzll(columns);
+		width = 64 - __builtin_ctzll(columns) - left;
+		height = bottom - top + 1;
+	} else {
+		top = 0; // Nothing changed; a 1 pixel image just carries the delay
+	}
+
+	// Delay from the running total so rounding never accumulates drift
+	const uint64_t frames = gif->elapsed_frames + gif->held_frames;
+	const uint64_t cs = (frames * 100 + 30) / 60;
+	uint64_t delay = cs - gif->elapsed_cs;
+
+	// Delays are 16 bit; a longer one goes on in 1 pixel images that change
+	// nothing
+	FILE *file = capture->file;
+	gif_put_control(file, delay < 0xFFFF ? delay : 0xFFFF);
+	gif_write_image(capture, gif->held, left, top, width, height);
+	for (delay = delay < 0xFFFF ? 0 : delay - 0xFFFF; delay > 0;) {
+		const uint32_t part = delay < 0xFFFF ? delay : 0xFFFF;
+		gif_put_control(file, part);
+		gif_write_image(capture, gif->held, 0, 0, 1, 1);
+		delay -= part;
+	}
+
+	memcpy(gif->shown, gif->held, sizeof gif->shown);
+	gif->held_dirty = 0;
+	gif->held_frames = 0;
+	gif->elapsed_frames = frames;
+	gif->elapsed_cs = cs;
+	return !ferror(file);
+}
+
+// Most viewers stretch delays under 2cs (>50 fps) to 10cs, so an image
+// that would show for less than that is folded into the next one instead
+static bool gif_frame(capture_t *capture, const capture_frame_t *frame) {
+	gif_t *gif = capture->gif;
+	memcpy(gif->held, frame->rows, sizeof gif->held);
+	gif->held_dirty |= frame->dirty;
+	gif->held_frames += frame->repeat;
+
+	const uint64_t frames = gif->elapsed_frames + gif->held_frames;
+	if ((frames * 100 + 30) / 60 - gif->elapsed_cs < 2)
+		return true;
+	return gif_emit(capture);
+}
+
+static bool write_frame(capture_t *capture, const capture_frame_t *frame) {
+	if (capture->format == CAPTURE_GIF)
+		return gif_frame(capture, frame);
+
+	// Repeats are written out in full; Y4M has no per frame duration
+	for (uint32_t i = 0; i < frame->repeat; i++) {
+		if (capture->format == CAPTURE_RGB) {
+			if (!write_plane(capture, frame->rows, &capture->expand[0], true))
+				return false;
+			continue;
+		}
+
+		if (fputs("FRAME\n", capture->file) == EOF)
+			return false;
+		for (int plane = 0; plane < 3; plane++)
+			if (!write_plane(capture, frame->rows, &capture->expand[plane], false))
+				return false;
+	}
+	return true;
+}
+
+// Encoder thread: expand and write queued frames until closed and drained
+static void *capture_thread(void *arg) {
+	capture_t *capture = arg;
+	for (;;) {
+		const uint32_t tail =
+				atomic_load_explicit(&capture->tail, memory_order_relaxed);
+		const uint32_t head =
+				atomic_load_explicit(&capture->head, memory_order_acquire);
+		if (tail == head) {
+			if (atomic_load(&capture->done))
+				break;
+			// Re-check under the lock so a wakeup can't slip in between
+			pthread_mutex_lock(&capture->lock);
+			while (atomic_load(&capture->head) == tail && !atomic_load(&capture->done))
+				pthread_cond_wait(&capture->cond, &capture->lock);
+			pthread_mutex_unlock(&capture->lock);
+			continue;
+		}
+
+		if (!capture->error &&
+				!write_frame(capture, &capture->queue[tail & (CAPTURE_QUEUE - 1)]))
+			capture->error = true;
+		atomic_store_explicit(&capture->tail, tail + 1, memory_order_release);
+
+		// Wake the emulation thread if it was waiting on a full ring
+		pthread_mutex_lock(&capture->lock);
+		pthread_cond_broadcast(&capture->cond);
+		pthread_mutex_unlock(&capture->lock);
+	}
+	return NULL;
+}
+
+// Start recording to `path`; a .y4m extension selects YUV4MPEG2 and .gif an
+// animated GIF, anything else is written as raw RGB24 at 64*scale x 32*scale
+capture_t *capture_open(const char *path, uint32_t scale, uint32_t fg_color,
+												uint32_t bg_color) {
+	if (scale == 0)
+		return NULL;
+	capture_t *capture = calloc(1, sizeof *capture);
+	if (!capture)
+		return NULL;
+	capture->line = malloc(DISPLAY_W * scale * sizeof(uint32_t));
+	capture->file = fopen(path, "wb");
+	if (!capture->line || !capture->file) {
+		if (capture->file)
+			fclose(capture->file);
+		free(capture->line);
+		free(capture);
+		return NULL;
+	}
+
+	const char *ext = strrchr(path, '.');
+	capture->format = CAPTURE_RGB;
+	if (ext && strcmp(ext, ".y4m") == 0)
+		capture->format = CAPTURE_Y4M;
+	else if (ext && strcmp(ext, ".gif") == 0)
+		capture->format = CAPTURE_GIF;
+	capture->scale = scale;
+	capture->fg_color = fg_color;
+	capture->bg_color = bg_color;
+
+	if (capture->format == CAPTURE_Y4M) {
+		uint8_t fg[3], bg[3];
+		rgba_to_yuv(fg_color, fg);
+		rgba_to_yuv(bg_color, bg);
+		for (int plane = 0; plane < 3; plane++)
+			expand_init(&capture->expand[plane], fg[plane], bg[plane], scale);
+	} else if (capture->format == CAPTURE_GIF) {
+		expand_init(&capture->expand[0], 1, 0, scale); // Palette indices
+	} else {
+		expand_init(&capture->expand[0], fg_color, bg_color, scale);
+	}
+
+	if (capture->format == CAPTURE_GIF) {
+		capture->gif = calloc(1, sizeof *capture->gif);
+		if (!capture->gif || DISPLAY_W * scale > 0xFFFF) {
+			fclose(capture->file);
+			free(capture->gif);
+			free(capture->line);
+			free(capture);
+			return NULL;
+		}
+		gif_write_header(capture);
+	} else if (capture->format == CAPTURE_Y4M) {
+		fprintf(capture->file, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n",
+						DISPLAY_W * scale, DISPLAY_H * scale);
+	}
+
+	pthread_mutex_init(&capture->lock, NULL);
+	pthread_cond_init(&capture->cond, NULL);
+	if (pthread_create(&capture->thread, NULL, capture_thread, capture) != 0) {
+		fclose(capture->file);
+		free(capture->gif);
+		free(capture->line);
+		free(capture);
+		return NULL;
+	}
+	return capture;
+}
+
+// Hand the pending frame to the encoder thread
+static void flush_pending(capture_t *capture) {
+	const uint32_t head =
+			atomic_load_explicit(&capture->head, memory_order_relaxed);
+
+	// Only blocks if the encoder is a full ring of distinct frames behind
+	if (head - atomic_load_explicit(&capture->tail, memory_order_acquire) ==
+			CAPTURE_QUEUE) {
+		pthread_mutex_lock(&capture->lock);
+		while (head - atomic_load(&capture->tail) == CAPTURE_QUEUE)
+			pthread_cond_wait(&capture->cond, &capture->lock);
+		pthread_mutex_unlock(&capture->lock);
+	}
+
+	capture->queue[head & (CAPTURE_QUEUE - 1)] = capture->pending;
+	atomic_store_explicit(&capture->head, head + 1, memory_order_release);
+	capture->distinct++;
+
+	pthread_mutex_lock(&capture->lock);
+	pthread_cond_signal(&capture->cond);
+	pthread_mutex_unlock(&capture->lock);
+}
+
+// Record one emulated frame. Identical consecutive frames only bump a
+// repeat count; a changed frame costs a 256 byte compare and copy.
+// dirty_rows marks the rows drawn to since the previous emulated frame.
+void capture_frame(capture_t *capture, const uint64_t display[32],
+									 uint32_t dirty_rows) {
+	capture->frames++;
+	if (capture->has_pending &&
+			memcmp(capture->pending.rows, display, sizeof capture->pending.rows) ==
+					0) {
+		capture->pending.repeat++;
+		return;
+	}
+
+	if (capture->has_pending)
+		flush_pending(capture);
+	// Rows not drawn to since the previous (pending) image can't differ from it
+	capture->pending.dirty = capture->has_pending ? dirty_rows : ~0u;
+	memcpy(capture->pending.rows, display, sizeof capture->pending.rows);
+	capture->pending.repeat = 1;
+	capture->has_pending = true;
+}
+
+// Flush the last frame, wait for the encoder to finish and free the capture
+bool capture_close(capture_t *capture) {
+	if (capture->has_pending)
+		flush_pending(capture);
+
+	pthread_mutex_lock(&capture->lock);
+	atomic_store(&capture->done, true);
+	pthread_cond_broadcast(&capture->cond);
+	pthread_mutex_unlock(&capture->lock);
+	pthread_join(capture->thread, NULL);
+
+	if (capture->format == CAPTURE_GIF) {
+		// Write out an image still held back for being too short
+		if (capture->gif->held_frames > 0 && !capture->error &&
+				!gif_emit(capture))
+			capture->error = true;
+		fputc(0x3B, capture->file); // Trailer
+	}
+
+	const bool ok = !capture->error && fclose(capture->file) == 0;
+	pthread_mutex_destroy(&capture->lock);
+	pthread_cond_destroy(&capture->cond);
+	free(capture->gif);
+	free(capture->line);
+	free(capture);
+	return ok;
+}
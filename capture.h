@@ -0,0 +1,77 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "expand.h"
+
+#define CAPTURE_QUEUE 256 // Distinct frames in flight, must be a power of 2
+
+typedef enum {
+	CAPTURE_Y4M, // YUV4MPEG2, 4:4:4, 60 fps
+	CAPTURE_RGB, // Headerless packed 24 bit RGB frames
+	CAPTURE_GIF, // Animated GIF of changed rectangles, 2 colour palette
+} capture_format_t;
+
+// One distinct emulated frame, still packed 1 bit per pixel
+typedef struct {
+	uint64_t rows[32];
+	uint32_t repeat; // Consecutive emulated frames this image was shown for
+	uint32_t dirty;	 // Rows drawn since the previous queued frame, bit y = row y
+} capture_frame_t;
+
+// GIF encoder state, owned by the encoder thread
+typedef struct {
+	uint64_t shown[32];			 // Image as of the last frame written
+	uint64_t held[32];			 // Latest image not yet written
+	uint32_t held_dirty;		 // Rows changed since the last frame written
+	uint64_t held_frames;		 // Emulated frames since the last frame written
+	uint64_t elapsed_frames; // Emulated frames covered by frames written
+	uint64_t elapsed_cs;		 // Same in GIF centiseconds
+
+	uint16_t child[4096][2]; // LZW trie, child code per (code, pixel)
+	uint8_t block[256];			 // Data sub-block being filled, [0] is length
+	uint32_t bits;					 // Pending output bits
+	uint32_t bit_count;
+} gif_t;
+
+// Video recorder. The emulation thread only compares and copies the packed
+// display into a lock-free ring; expansion, colour conversion, GIF encoding
+// and file I/O all happen on the encoder thread.
+typedef struct {
+	FILE *file;
+	capture_format_t format;
+	uint32_t scale;
+	uint32_t fg_color, bg_color; // RGBA8888
+	expand_t expand[3];					 // Y, U, V planes; RGBA or GIF indices in [0]
+	uint8_t *line;							 // One expanded output row
+	uint64_t frames;						 // Emulated frames recorded
+	uint64_t distinct;					 // Frames actually queued
+	gif_t *gif;									 // Only for CAPTURE_GIF
+
+	// Emulation thread side
+	capture_frame_t pending; // Latest image, still counting repeats
+	bool has_pending;
+
+	capture_frame_t queue[CAPTURE_QUEUE];
+	_Atomic uint32_t head; // Written by the emulation thread
+	_Atomic uint32_t tail; // Written by the encoder thread
+
+	pthread_t thread;
+	pthread_mutex_t lock; // Only guards sleeping/waking, not the ring
+	pthread_cond_t cond;
+	_Atomic bool done;
+	bool error;
+} capture_t;
+
+capture_t *capture_open(const char *path, uint32_t scale, uint32_t fg_color,
+												uint32_t bg_color);
+void capture_frame(capture_t *capture, const uint64_t display[32],
+									 uint32_t dirty_rows);
+bool capture_close(capture_t *capture);
+
+#endif
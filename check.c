@@ -0,0 +1,238 @@
+// make check: machines run by the scheduler against the same machines run
+// one instruction at a time, frame after frame. Parked machines skip
+// frames and catch up in closed form, stepped ones skip blocked frames on
+// the spot; either way every machine's registers, display and ram must
+// come out exactly as if it had run every frame, on any number of workers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "memo.h"
+#include "scheduler.h"
+
+// Programs that block in each of the ways the scheduler parks for
+static const uint8_t delay_loop_rom[] = {
+		// Draw, then wait 5 frames on the delay timer with FX07; 3X00; 1NNN
+		0x60, 0x05, 0x61, 0x00, 0xF0, 0x15, 0xF2, 0x07, 0x32, 0x00,
+		0x12, 0x06, 0xA2, 0x20, 0xD0, 0x15, 0x70, 0x03, 0x71, 0x01,
+		0xF0, 0x18, 0x12, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0xF0, 0x90, 0x90, 0x90, 0xF0,
+};
+static const uint8_t key_wait_rom[] = {
+		// FX0A, draw the key's digit, then a delay loop
+		0x63, 0x00, 0xF3, 0x0A, 0xF3, 0x29, 0xD4, 0x55, 0x74, 0x05, 0x66,
+		0x20, 0xF6, 0x15, 0xF7, 0x07, 0x37, 0x00, 0x12, 0x0E, 0x12, 0x02,
+};
+static const uint8_t halt_rom[] = {
+		// Draw a line, then BNNN to itself
+		0x6A, 0x00, 0xA2, 0x30, 0xDA, 0xA1, 0x7A, 0x01, 0x3A, 0x40, 0x12,
+		0x02, 0x60, 0x00, 0xB2, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x80,
+};
+static const uint8_t busy_rom[] = {
+		// Draws forever, never blocks
+		0xA2, 0x10, 0xD0, 0x15, 0x70, 0x01, 0x71, 0x01, 0x12, 0x02, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF0, 0x90, 0x90, 0x90,
+		0xF0,
+};
+static const uint8_t random_rom[] = {
+		// CXNN, draw the digit, then a delay loop
+		0xC0, 0xFF, 0xF0, 0x29, 0xD1, 0x25, 0x71, 0x05, 0x63, 0x03, 0xF3,
+		0x15, 0xF4, 0x07, 0x34, 0x00, 0x12, 0x0C, 0x12, 0x00,
+};
+static const char *rom_files[] = {"test_opcode.ch8", "BC_test.ch8",
+																	"IBM Logo.ch8"};
+
+#define ROMS 8
+#define MACHINES (ROMS * 40)
+
+static boot_image_t images[ROMS];
+
+static bool load_images(void) {
+	const struct {
+		const uint8_t *rom;
+		size_t size;
+		const char *name;
+	} built_in[] = {
+			{delay_loop_rom, sizeof delay_loop_rom, "delay loop"},
+			{key_wait_rom, sizeof key_wait_rom, "key wait"},
+			{halt_rom, sizeof halt_rom, "halt"},
+			{busy_rom, sizeof busy_rom, "busy"},
+			{random_rom, sizeof random_rom, "random"},
+	};
+	for (uint32_t i = 0; i < 5; i++)
+		boot_image_from_rom(&images[i], built_in[i].name, built_in[i].rom,
+												built_in[i].size);
+	for (uint32_t i = 0; i < 3; i++)
+		if (!boot_image_load(&images[5 + i], rom_files[i]))
+			return false;
+	return true;
+}
+
+static uint64_t state_hash(const chip8_t *chip8) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	const uint8_t *regs = (const uint8_t *)&chip8->regs;
+	for (size_t i = 0; i < sizeof chip8->regs; i++)
+		hash = (hash ^ regs[i]) * 0x100000001B3ULL;
+	hash = (hash ^ chip8->rng) * 0x100000001B3ULL;
+	for (uint32_t y = 0; y < 32; y++)
+		hash = (hash ^ chip8->display[y]) * 0x100000001B3ULL;
+	for (uint32_t addr = 0; addr < RAM_SIZE; addr++)
+		hash = (hash ^ read_ram(chip8, addr)) * 0x100000001B3ULL;
+	return hash;
+}
+
+// One frame of the plain sequential machine
+static void reference_frame(chip8_t *chip8, const config_t config) {
+	for (uint32_t i = 0; i < config.insts_per_second / 60; i++)
+		emulate_instruction(chip8, config);
+	if (chip8->regs.delay_timer > 0)
+		chip8->regs.delay_timer--;
+	if (chip8->regs.sound_timer > 0)
+		chip8->regs.sound_timer--;
+}
+
+// Keys held on a frame: bursts of one key, with long stretches of none so
+// key waits park
+static void keys_at(uint32_t frame, bool keys[16]) {
+	memset(keys, 0, 16);
+	if (frame % 13 < 4 && (frame / 50) % 3 != 1)
+		keys[(frame / 7) % 16] = true;
+}
+
+static uint32_t compare(sched_t *sched, const chip8_t *reference,
+												uint32_t frame) {
+	uint32_t bad = 0;
+	for (uint32_t i = 0; i < MACHINES; i++) {
+		sched_task_t *task = &sched->tasks[i];
+		sched_sync(sched, task);
+		if (state_hash(task->chip8) != state_hash(&reference[i]) && bad++ < 3)
+			fprintf(stderr, "  frame %u: machine %u (%s) differs, wait %d\n", frame,
+							i, reference[i].rom_name, task->wait);
+	}
+	return bad;
+}
+
+// Every machine runs every frame, parked ones caught up when woken
+static uint32_t check_free(config_t config, uint32_t workers, bool memo_on,
+													 uint32_t frames, chip8_t *scheduled,
+													 chip8_t *reference, arena_t *pages) {
+	memo_t *memo = memo_on ? memo_create(4 << 20) : NULL;
+	sched_t *sched =
+			sched_create(scheduled, MACHINES, config, memo, pages, workers, false);
+	if (!sched)
+		return 1;
+	uint32_t bad = 0;
+	bool keys[16], last[16] = {0};
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		keys_at(frame, keys);
+		for (uint32_t i = 0; i < MACHINES; i++) {
+			memcpy(reference[i].keypad, keys, sizeof keys);
+			reference_frame(&reference[i], config);
+			if (memcmp(keys, last, sizeof keys) != 0)
+				sched_set_keys(sched, &sched->tasks[i], keys);
+		}
+		memcpy(last, keys, sizeof keys);
+		sched_frame(sched);
+		if (frame % 37 == 0 || frame == frames - 1)
+			bad += compare(sched, reference, frame);
+	}
+	sched_destroy(sched);
+	if (memo)
+		memo_destroy(memo);
+	return bad;
+}
+
+// Machines are given runs of frames of differing lengths, and skip
+// blocked frames as they go
+static uint32_t check_stepped(config_t config, uint32_t workers,
+															uint32_t frames, chip8_t *scheduled,
+															chip8_t *reference, arena_t *pages) {
+	sched_t *sched =
+			sched_create(scheduled, MACHINES, config, NULL, pages, workers, true);
+	if (!sched)
+		return 1;
+	uint32_t bad = 0, frame = 0;
+	uint64_t random = 0x9E3779B97F4A7C15ULL;
+	bool keys[16];
+	while (frame < frames) {
+		keys_at(frame, keys);
+		const uint32_t longest = 1 + frame % 90;
+		for (uint32_t i = 0; i < MACHINES; i++) {
+			random ^= random << 13; // xorshift64
+			random ^= random >> 7;
+			random ^= random << 17;
+			const uint32_t run = random % longest + 1;
+			memcpy(reference[i].keypad, keys, sizeof keys);
+			for (uint32_t f = 0; f < run; f++)
+				reference_frame(&reference[i], config);
+			sched_set_keys(sched, &sched->tasks[i], keys);
+			sched_step(sched, &sched->tasks[i], run);
+		}
+		while (sched_frame(sched) > 0)
+			;
+		bad += compare(sched, reference, frame);
+		frame += longest;
+	}
+	sched_destroy(sched);
+	return bad;
+}
+
+int main(void) {
+	config_t config;
+	char *args[] = {"chip8-check", "check", "--frames", "1"};
+	if (!set_config_from_args(&config, 4, args) || !load_images())
+		return EXIT_FAILURE;
+	free(config.roms);
+
+	static const struct {
+		uint32_t insts_per_second, workers;
+		bool memo, stepped;
+	} runs[] = {
+			{700, 1, false, false}, {700, 3, false, false}, {600, 2, false, false},
+			{1000, 2, true, false}, {120, 2, false, false}, {700, 1, false, true},
+			{700, 3, false, true},	{1000, 2, false, true}, {120, 2, false, true},
+	};
+	chip8_t *scheduled = calloc(MACHINES, sizeof *scheduled);
+	chip8_t *reference = calloc(MACHINES, sizeof *reference);
+	arena_t pages[4];
+	if (!scheduled || !reference)
+		return EXIT_FAILURE;
+	for (uint32_t w = 0; w < 4; w++)
+		arena_init(&pages[w], RAM_PAGE_SIZE, false);
+
+	uint32_t failed = 0;
+	for (size_t r = 0; r < sizeof runs / sizeof *runs; r++) {
+		config.insts_per_second = runs[r].insts_per_second;
+		for (uint32_t i = 0; i < MACHINES; i++) {
+			boot_image_spawn(&images[i % ROMS], &scheduled[i], chip8_seed(1, i));
+			boot_image_spawn(&images[i % ROMS], &reference[i], chip8_seed(1, i));
+			reference[i].page_arena = &pages[3];
+		}
+		const uint32_t bad =
+				runs[r].stepped
+						? check_stepped(config, runs[r].workers, 2000, scheduled,
+														reference, pages)
+						: check_free(config, runs[r].workers, runs[r].memo, 2000,
+												 scheduled, reference, pages);
+		printf("%s %4u ips, %u workers%s: %s\n",
+					 runs[r].stepped ? "stepped" : "free   ", runs[r].insts_per_second,
+					 runs[r].workers, runs[r].memo ? ", memo" : "",
+					 bad ? "MISMATCH" : "ok");
+		failed += bad > 0;
+		for (uint32_t i = 0; i < MACHINES; i++) {
+			release_chip8(&scheduled[i]);
+			release_chip8(&reference[i]);
+		}
+	}
+
+	for (uint32_t w = 0; w < 4; w++)
+		arena_destroy(&pages[w]);
+	free(scheduled);
+	free(reference);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
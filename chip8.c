@@ -1,132 +1,53 @@
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-
-#include "SDL.h"
-#include "SDL_audio.h"
-#include "SDL_error.h"
-#include "SDL_events.h"
-#include "SDL_keycode.h"
-#include "SDL_log.h"
-#include "SDL_render.h"
-#include "SDL_timer.h"
-#include "SDL_video.h"
-
-typedef struct {
-	SDL_Window *window;
-	SDL_Renderer *renderer;
-	SDL_AudioSpec want, have;
-	SDL_AudioDeviceID dev;
-} sdl_t;
-
-typedef struct {
-	uint32_t window_height;		 // SDL Window height
-	uint32_t window_width;		 // SDL Window width
-	uint32_t fg_color;				 // Foreground color RGBA8888
-	uint32_t bg_color;				 // background color RGBA8888
-	uint32_t scale_factor;		 // Amount to scale a CHIP8 pixels
-	bool pixel_outline;				 // Outinline effect for pixels
-	uint32_t insts_per_second; // CHIP8 CPU "clock rate" or hz
-	uint32_t square_wave_freq; //  Frequency of square wave sound eg. 440hz for
-														 //  middle A
-	uint32_t audio_sample_rate;
-	int16_t volume; // How loud the sound
-} config_t;
-
-typedef enum {
-	QUIT,
-	RUNNING,
-	PAUSED,
-} emulator_state_t;
-
-typedef struct {
-	uint16_t opcode;
-	uint16_t NNN; // 12 bit address/constand
-	uint8_t NN;		// 8 bit constant
-	uint8_t N;		// 4 bit constant
-	uint8_t X;		// 4 bit register identifier
-	uint8_t Y;		// 4 bit register identifier
-} instruction_t;
-
-typedef struct {
-	emulator_state_t state;
-	uint8_t ram[4096];
-	bool display[64 * 32]; // CHIP8 original resolution
-	uint16_t stack[16];		 // Subroutine stack
-	uint16_t *stack_ptr;
-	uint8_t V[16];				// V0-VF Data registers
-	uint16_t I;						// Index register
-	uint16_t PC;					// Program Counter
-	uint8_t delay_timer;	// Decrease at 60hz per second when > 0
-	uint8_t sound_timer;	// Decrease at 60hz per second and play tone when > 0
-	bool keypad[16];			// Hexadecimal keypad
-	const char *rom_name; // Currently running ROM
-	instruction_t inst;		// Currently executing inst
-} chip8_t;
-
-void audio_callback(void *userdata, uint8_t *stream, int len) {
-	config_t *config = (config_t *)userdata;
-
-	// Fill data with some squre wave
-	int16_t *audio_data = (int16_t *)stream;
-	static uint32_t running_sample_index = 0;
-
-	const int32_t square_wave_period =
-			config->audio_sample_rate / config->square_wave_freq;
-	const int32_t half_square_wave_period = square_wave_period / 2;
-
-	for (int i = 0; i < len / 2; i++) {
-		audio_data[i] = ((running_sample_index++ / half_square_wave_period) % 2)
-												? config->volume
-												: -config->volume;
-	}
+#include <unistd.h>
+
+#include "audio.h"
+#include "backend.h"
+#include "capture.h"
+#include "chip8.h"
+#include "daemon.h"
+#include "displog.h"
+#include "env.h"
+#include "memo.h"
+#include "png.h"
+#include "scheduler.h"
+#include "shm.h"
+#include "thumbs.h"
+#include "vnc.h"
+
+static int compare_frames(const void *a, const void *b) {
+	const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
 }
 
-bool init_sdl(sdl_t *sdl, config_t config) {
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0) {
-		SDL_Log("Could not init SDL subsystems! %s\n", SDL_GetError());
-		return false;
-	}
-	sdl->window = SDL_CreateWindow("CHIP8 Emulator", SDL_WINDOWPOS_CENTERED,
-																 SDL_WINDOWPOS_CENTERED,
-																 config.window_width * config.scale_factor,
-																 config.window_height * config.scale_factor, 0);
-	if (!sdl->window) {
-		SDL_Log("Could not create window %s\n", SDL_GetError());
-		return false;
-	}
-
-	sdl->renderer = SDL_CreateRenderer(sdl->window, -1, SDL_RENDERER_ACCELERATED);
-	if (!sdl->renderer) {
-		SDL_Log("Could not create renderer %s\n", SDL_GetError());
-		return false;
-	}
-
-	// Initialize audio config
-	sdl->want = (SDL_AudioSpec){
-			.freq = 44100,					// 44100hz "CD" Quality
-			.format = AUDIO_S16LSB, // Signed 16bite little endian
-			.channels = 1,					// Mono .samples =
-			.samples = 512,
-			.callback = audio_callback,
-			.userdata = &config, // Userdata passed to the audio callback
-	};
-
-	sdl->dev = SDL_OpenAudioDevice(NULL, 0, &sdl->want, &sdl->have, 0);
-	if (!(sdl->dev > 0)) {
-		SDL_Log("Could not get an audio device %s\n", SDL_GetError());
-		return false;
-	}
-
-	if ((sdl->want.format != sdl->have.format) ||
-			(sdl->want.channels != sdl->have.channels)) {
-		SDL_Log("Could not get desired audio spec \n");
+// Comma separated thumbnail frames, eg. "60,300", stored ascending
+bool parse_frame_list(config_t *config, const char *list) {
+	uint32_t count = 1;
+	for (const char *c = list; *c; c++)
+		count += *c == ',';
+	uint32_t *frames = malloc(count * sizeof *frames);
+	if (!frames)
 		return false;
+	for (uint32_t i = 0; i < count; i++) {
+		char *end;
+		frames[i] = strtoul(list, &end, 10);
+		if (frames[i] == 0 || (*end != ',' && *end != '\0')) {
+			fprintf(stderr, "Bad --thumb-frames %s\n", list);
+			free(frames);
+			return false;
+		}
+		list = end + 1;
 	}
-
+	qsort(frames, count, sizeof *frames, compare_frames);
+	free(config->thumb_frames);
+	config->thumb_frames = frames;
+	config->thumb_frame_count = count;
 	return true;
 }
 
@@ -144,294 +65,350 @@ bool set_config_from_args(config_t *config, const int argc, char **argv) {
 			.square_wave_freq = 440,		// 440hz for middle A
 			.audio_sample_rate = 44100, // CD Quality
 			.volume = 3000,							// INT16_MAX would be max volume
+			.audio_latency_ms = 20,			// Held by dynamic rate control
+			.capture_scale = 4,
+			.vnc_bind = "127.0.0.1", // No VNC authentication, so loopback only
+			.vnc_scale = 8,
+			.keyframe_interval = 600, // 10 seconds
+			.sessions = 1024,
+			.env_steps = 1000,
+			.hugepages = true,
+			.backend = backend_default(),
+			.roms = malloc(argc * sizeof *config->roms),
+			.rom_count = 1,
 	};
+	if (!config->roms)
+		return false;
+	config->roms[0] = argv[1];
+
+	// Override defaults form passed in arguments, argv[1] is the ROM
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--latency-ms") == 0 && i + 1 < argc) {
+			config->audio_latency_ms = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+			config->backend = argv[++i];
+		} else if (strcmp(argv[i], "--scanlines") == 0) {
+			config->scanlines = true;
+		} else if (strcmp(argv[i], "--when-hidden") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "run") == 0) {
+				config->when_hidden = HIDDEN_RUN;
+			} else if (strcmp(argv[i], "throttle") == 0) {
+				config->when_hidden = HIDDEN_THROTTLE;
+			} else if (strcmp(argv[i], "pause") == 0) {
+				config->when_hidden = HIDDEN_PAUSE;
+			} else {
+				fprintf(stderr, "Unknown --when-hidden policy %s\n", argv[i]);
+				return false;
+			}
+		} else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+			config->roms[config->rom_count++] = argv[++i];
+		} else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			config->instances = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--tile-columns") == 0 && i + 1 < argc) {
+			config->tile_columns = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) {
+			config->renderer = argv[++i];
+		} else if (strcmp(argv[i], "--no-vsync") == 0) {
+			config->no_vsync = true;
+		} else if (strcmp(argv[i], "--persistence") == 0 && i + 1 < argc) {
+			config->persistence = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			config->backend = "null";
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			config->max_frames = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--audio-out") == 0 && i + 1 < argc) {
+			config->audio_out = argv[++i];
+		} else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			config->capture_out = argv[++i];
+		} else if (strcmp(argv[i], "--capture-scale") == 0 && i + 1 < argc) {
+			config->capture_scale = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--shm") == 0) {
+			config->shm_export = true;
+		} else if (strcmp(argv[i], "--shm-name") == 0 && i + 1 < argc) {
+			config->shm_export = true;
+			config->shm_name = argv[++i];
+		} else if (strcmp(argv[i], "--vnc") == 0 && i + 1 < argc) {
+			const unsigned long port = strtoul(argv[++i], NULL, 10);
+			if (port == 0 || port > 65535) {
+				fprintf(stderr, "--vnc port must be 1 to 65535\n");
+				return false;
+			}
+			config->vnc_port = port;
+		} else if (strcmp(argv[i], "--vnc-bind") == 0 && i + 1 < argc) {
+			config->vnc_bind = argv[++i];
+		} else if (strcmp(argv[i], "--vnc-scale") == 0 && i + 1 < argc) {
+			config->vnc_scale = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--term") == 0 && i + 1 < argc) {
+			config->backend = "term";
+			i++;
+			if (strcmp(argv[i], "braille") == 0) {
+				config->term_braille = true;
+			} else if (strcmp(argv[i], "half") != 0 &&
+								 strcmp(argv[i], "halfblock") != 0) {
+				fprintf(stderr, "Unknown --term mode %s\n", argv[i]);
+				return false;
+			}
+		} else if (strcmp(argv[i], "--thumbnails") == 0 && i + 1 < argc) {
+			config->thumbs_out = argv[++i];
+		} else if (strcmp(argv[i], "--thumb-frames") == 0 && i + 1 < argc) {
+			if (!parse_frame_list(config, argv[++i]))
+				return false;
+		} else if (strcmp(argv[i], "--atlas") == 0) {
+			config->thumb_atlas = true;
+		} else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+			config->thumb_input = argv[++i];
+		} else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+			config->jobs = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--display-log") == 0 && i + 1 < argc) {
+			config->display_log = argv[++i];
+		} else if (strcmp(argv[i], "--keyframe-interval") == 0 && i + 1 < argc) {
+			config->keyframe_interval = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--replay-frame") == 0 && i + 1 < argc) {
+			config->replay_frame = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--png") == 0 && i + 1 < argc) {
+			config->replay_png = argv[++i];
+		} else if (strcmp(argv[i], "--memo") == 0 && i + 1 < argc) {
+			config->memo_mb = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--no-hugepages") == 0) {
+			config->hugepages = false;
+		} else if (strcmp(argv[i], "--serve") == 0) {
+			config->serve = true;
+		} else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+			config->sessions = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--envs") == 0 && i + 1 < argc) {
+			config->envs = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--env-steps") == 0 && i + 1 < argc) {
+			config->env_steps = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc) {
+			config->frameskip = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--obs") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "pixels") == 0) {
+				config->env_pixels = true;
+			} else if (strcmp(argv[i], "packed") != 0) {
+				fprintf(stderr, "Unknown --obs format %s\n", argv[i]);
+				return false;
+			}
+		} else if (strcmp(argv[i], "--downsample") == 0 && i + 1 < argc) {
+			config->downsample = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--frame-stack") == 0 && i + 1 < argc) {
+			config->frame_stack = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--reward") == 0 && i + 1 < argc) {
+			config->reward = argv[++i];
+		} else if (strcmp(argv[i], "--terminal") == 0 && i + 1 < argc) {
+			config->terminal = argv[++i];
+		} else if (strcmp(argv[i], "--episode-frames") == 0 && i + 1 < argc) {
+			config->episode_frames = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			config->seed_set = true;
+			config->seed = strtoul(argv[++i], NULL, 10);
+		} else {
+			fprintf(stderr, "Unknown argument %s\n", argv[i]);
+			return false;
+		}
+	}
+
+	if (config->replay_png)
+		return true; // argv[1] is a display log
+	if (config->thumbs_out) {
+		if (!config->thumb_frames && !parse_frame_list(config, "120"))
+			return false;
+		if (config->capture_scale == 0) {
+			fprintf(stderr, "--capture-scale must be at least 1\n");
+			return false;
+		}
+		return true; // argv[1] is a directory, nothing else applies
+	}
+	if (config->serve) {
+		if (config->sessions == 0) {
+			fprintf(stderr, "--sessions must be at least 1\n");
+			return false;
+		}
+		return true; // argv[1] is the socket
+	}
+	if (config->envs)
+		return true; // Environments have their own defaults
+	if (config->thumb_frames || config->thumb_atlas || config->thumb_input) {
+		fprintf(stderr, "--thumb-frames, --atlas and --input need --thumbnails\n");
+		return false;
+	}
 
-	// Override defaults form passed in arguments
-	for (int i = 1; i < argc; i++) {
-		(void)argv[i];
+	if (config->instances == 0)
+		config->instances = config->rom_count;
+	if (config->instances < config->rom_count) {
+		fprintf(stderr, "--instances is less than the number of ROMs\n");
+		return false;
+	}
+	if (config->persistence >= 100) {
+		fprintf(stderr, "--persistence must be below 100\n");
+		return false;
+	}
+	if (!backend_find(config->backend)) {
+		fprintf(stderr, "Unknown or not compiled in backend %s\n", config->backend);
+		return false;
+	}
+	const bool null = strcmp(config->backend, "null") == 0;
+	if (null && config->max_frames == 0) {
+		fprintf(stderr, "--headless needs --frames\n");
+		return false;
+	}
+	if (config->audio_out && !null) {
+		fprintf(stderr, "--audio-out is only available with --headless\n");
+		return false;
 	}
-	// ...
+	// The shm backend is the export itself
+	if (strcmp(config->backend, "shm") == 0)
+		config->shm_export = false;
 	return true;
 }
 
-bool init_chip8(chip8_t *chip8, const char rom_name[]) {
-	const uint32_t entry_point = 0x200; // CHIP8 Roms will be loaded to 0x200
-	const uint8_t font[] = {
-			0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-			0x20, 0x60, 0x20, 0x20, 0x70, // 1
-			0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-			0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-			0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-			0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-			0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-			0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-			0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-			0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-			0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-			0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-			0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-			0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-			0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-			0xF0, 0x80, 0xF0, 0x80, 0x80, // F
-	};
+static const uint8_t font[] = {
+		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+		0x20, 0x60, 0x20, 0x20, 0x70, // 1
+		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+		0xF0, 0x80, 0xF0, 0x80, 0x80, // F
+};
+
+// Set up the machine around a ram image that already holds the ROM
+static void boot_image_finish(boot_image_t *image, const char rom_name[]) {
+	chip8_t *chip8 = &image->machine;
+	memcpy(&image->ram[0], font, sizeof(font));
+	for (uint32_t page = 0; page < RAM_PAGES; page++)
+		chip8->ram[page] = &image->ram[page * RAM_PAGE_SIZE];
+	for (uint32_t addr = 0; addr < sizeof image->ram; addr++)
+		chip8->ram_hash += ram_mix(addr, image->ram[addr]);
+	//  Set chip8 machine
+	chip8->state = RUNNING;	 // Default machine state to RUNNING
+	chip8->regs.PC = ROM_ENTRY; // Start program counter at ROM entry point
+	chip8->rom_name = rom_name;
+}
+
+bool boot_image_load(boot_image_t *image, const char rom_name[]) {
+	memset(image, 0, sizeof *image);
 
-	// Load font
-	memcpy(&chip8->ram[0], font, sizeof(font));
 	//  Load ROM
 	// Open ROM file
 	FILE *rom = fopen(rom_name, "rb");
 	if (!rom) {
-		SDL_Log("Rom file %s is invalid or does not exist \n", rom_name);
+		fprintf(stderr, "Rom file %s is invalid or does not exist \n", rom_name);
 		return false;
 	}
 	// Get/Check rom size
 	fseek(rom, 0, SEEK_END);
 	const long rom_size = ftell(rom);
-	const long max_size = sizeof chip8->ram - entry_point;
+	const long max_size = ROM_MAX_SIZE;
 	rewind(rom);
 
 	if (rom_size > max_size) {
-		SDL_Log("Rom file %s is too big! Rom size: %zu, Max size allowed: %zu\n",
+		fprintf(stderr, "Rom file %s is too big! Rom size: %zu, Max size allowed: %zu\n",
 						rom_name, rom_size, max_size);
+		fclose(rom);
 		return false;
 	}
 
-	if (fread(&chip8->ram[entry_point], rom_size, 1, rom) != 1) {
-		SDL_Log("Could not read from Rom file %s in to CHIP8 memory \n", rom_name);
+	if (fread(&image->ram[ROM_ENTRY], rom_size, 1, rom) != 1) {
+		fprintf(stderr, "Could not read from Rom file %s in to CHIP8 memory \n", rom_name);
+		fclose(rom);
 		return false;
 	}
 
 	fclose(rom);
-	//  Set chip8 machine
-	chip8->state = RUNNING;	 // Default machine state to RUNNING
-	chip8->PC = entry_point; // Start program counter at ROM entry point
-	chip8->rom_name = rom_name;
-	chip8->stack_ptr = &chip8->stack[0];
+	boot_image_finish(image, rom_name);
+	return true;
+}
+
+bool boot_image_from_rom(boot_image_t *image, const char rom_name[],
+												 const uint8_t *rom, size_t rom_size) {
+	if (rom_size > ROM_MAX_SIZE)
+		return false;
+	memset(image, 0, sizeof *image);
+	memcpy(&image->ram[ROM_ENTRY], rom, rom_size);
+	boot_image_finish(image, rom_name);
 	return true;
 }
 
-void final_cleanup(const sdl_t sdl) {
-	SDL_DestroyRenderer(sdl.renderer);
-	SDL_DestroyWindow(sdl.window);
-	SDL_CloseAudioDevice(sdl.dev);
-	SDL_Quit(); // shutdown SDL subsystems
+void boot_image_spawn(const boot_image_t *image, chip8_t *chip8,
+											uint64_t seed) {
+	memcpy(chip8, &image->machine, sizeof *chip8);
+	// Neighbouring seeds give unrelated streams
+	chip8->rng = ram_mix(0, 0) ^ (seed * 0x9E3779B97F4A7C15ULL);
+	if (chip8->rng == 0)
+		chip8->rng = 1;
 }
 
-// Clear screen / SDL window to background color
-void clear_screen(const config_t config, const sdl_t sdl) {
-	const uint8_t r = (config.bg_color >> 24) & 0xFF;
-	const uint8_t g = (config.bg_color >> 16) & 0xFF;
-	const uint8_t b = (config.bg_color >> 8) & 0xFF;
-	const uint8_t a = (config.bg_color >> 0) & 0xFF;
-	SDL_SetRenderDrawColor(sdl.renderer, r, g, b, a);
-	SDL_RenderClear(sdl.renderer);
+void boot_image_reset(const boot_image_t *image, chip8_t *chip8,
+											uint64_t seed) {
+	release_chip8(chip8);
+	boot_image_spawn(image, chip8, seed);
 }
 
-// Update window with any changes
-void update_screen(const sdl_t sdl, const config_t config,
-									 const chip8_t chip8) {
-	SDL_Rect rect = {
-			.x = 0, .y = 0, .w = config.scale_factor, .h = config.scale_factor};
-	// Grab color values to draw
-	const uint8_t bg_r = (config.bg_color >> 24) & 0xFF;
-	const uint8_t bg_g = (config.bg_color >> 16) & 0xFF;
-	const uint8_t bg_b = (config.bg_color >> 8) & 0xFF;
-	const uint8_t bg_a = (config.bg_color >> 0) & 0xFF;
-
-	const uint8_t fg_r = (config.fg_color >> 24) & 0xFF;
-	const uint8_t fg_g = (config.fg_color >> 16) & 0xFF;
-	const uint8_t fg_b = (config.fg_color >> 8) & 0xFF;
-	const uint8_t fg_a = (config.fg_color >> 0) & 0xFF;
-	// Loop through display pixels, draw a rectangle per pixel to the SDL window
-	for (uint32_t i = 0; i < sizeof chip8.display; i++) {
-		// 1D i value to 2D X/Y coordinates
-		// X = i % window width
-		// Y = i / window width
-		rect.x = (i % config.window_width) * config.scale_factor;
-		rect.y = (i / config.window_width) * config.scale_factor;
-
-		if (chip8.display[i]) {
-			// if pixel is on, draw foreground color
-			SDL_SetRenderDrawColor(sdl.renderer, fg_r, fg_g, fg_b, fg_a);
-			SDL_RenderFillRect(sdl.renderer, &rect);
-
-			if (config.pixel_outline) {
-				SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-				SDL_RenderDrawRect(sdl.renderer, &rect);
-			}
-		} else {
-			// if pixel is off, draw background color
-			SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-			SDL_RenderFillRect(sdl.renderer, &rect);
-		}
+void release_chip8(chip8_t *chip8) {
+	for (uint32_t page = 0; page < RAM_PAGES; page++) {
+		if (!((chip8->own_pages >> page) & 1))
+			continue;
+		if (chip8->page_arena)
+			arena_free(chip8->page_arena, chip8->ram[page]);
+		else
+			free(chip8->ram[page]);
 	}
-	SDL_RenderPresent(sdl.renderer);
+	chip8->own_pages = 0;
 }
 
-// User input
-// CHIP8 Keypad   QWERTY
-// 123C           1234
-// 456D           qwer
-// 789E           asdf
-// A0BF           zxcv
-void handle_input(chip8_t *chip8) {
-	SDL_Event event;
-
-	while (SDL_PollEvent(&event)) {
-		switch (event.type) {
-		case SDL_QUIT:
-			// Exit window; End program
+// Write a byte of ram, keeping ram_hash in step. The first write to a
+// shared page gives the machine its own copy.
+void store_ram(chip8_t *chip8, uint16_t addr, uint8_t value) {
+	addr &= RAM_SIZE - 1;
+	const uint16_t page = addr / RAM_PAGE_SIZE;
+	if (!((chip8->own_pages >> page) & 1)) {
+		uint8_t *copy = chip8->page_arena ? arena_alloc(chip8->page_arena)
+																			: malloc(RAM_PAGE_SIZE);
+		if (!copy) {
+			fprintf(stderr, "Out of memory copying a ram page\n");
 			chip8->state = QUIT;
 			return;
-		case SDL_KEYDOWN:
-			switch (event.key.keysym.sym) {
-			case SDLK_ESCAPE:
-				chip8->state = QUIT;
-				return;
-			case SDLK_SPACE:
-				// space bar
-				if (chip8->state == RUNNING) {
-					puts("====== PAUSED ======");
-					chip8->state = PAUSED;
-				} else {
-					puts("====== RESUME ======");
-					chip8->state = RUNNING;
-				}
-				return;
-			case SDLK_1:
-				chip8->keypad[0x1] = true;
-				break;
-			case SDLK_2:
-				chip8->keypad[0x2] = true;
-				break;
-			case SDLK_3:
-				chip8->keypad[0x3] = true;
-				break;
-			case SDLK_4:
-				chip8->keypad[0xC] = true;
-				break;
-
-			case SDLK_q:
-				chip8->keypad[0x4] = true;
-				break;
-			case SDLK_w:
-				chip8->keypad[0x5] = true;
-				break;
-			case SDLK_e:
-				chip8->keypad[0x6] = true;
-				break;
-			case SDLK_r:
-				chip8->keypad[0xD] = true;
-				break;
-
-			case SDLK_a:
-				chip8->keypad[0x7] = true;
-				break;
-			case SDLK_s:
-				chip8->keypad[0x8] = true;
-				break;
-			case SDLK_d:
-				chip8->keypad[0x9] = true;
-				break;
-			case SDLK_f:
-				chip8->keypad[0xE] = true;
-				break;
-
-			case SDLK_z:
-				chip8->keypad[0xA] = true;
-				break;
-			case SDLK_x:
-				chip8->keypad[0x0] = true;
-				break;
-			case SDLK_c:
-				chip8->keypad[0xB] = true;
-				break;
-			case SDLK_v:
-				chip8->keypad[0xF] = true;
-				break;
-			default:
-				break;
-			}
-			break;
-		case SDL_KEYUP:
-			switch (event.key.keysym.sym) {
-
-			case SDLK_1:
-				chip8->keypad[0x1] = false;
-				break;
-			case SDLK_2:
-				chip8->keypad[0x2] = false;
-				break;
-			case SDLK_3:
-				chip8->keypad[0x3] = false;
-				break;
-			case SDLK_4:
-				chip8->keypad[0xC] = false;
-				break;
-
-			case SDLK_q:
-				chip8->keypad[0x4] = false;
-				break;
-			case SDLK_w:
-				chip8->keypad[0x5] = false;
-				break;
-			case SDLK_e:
-				chip8->keypad[0x6] = false;
-				break;
-			case SDLK_r:
-				chip8->keypad[0xD] = false;
-				break;
-
-			case SDLK_a:
-				chip8->keypad[0x7] = false;
-				break;
-			case SDLK_s:
-				chip8->keypad[0x8] = false;
-				break;
-			case SDLK_d:
-				chip8->keypad[0x9] = false;
-				break;
-			case SDLK_f:
-				chip8->keypad[0xE] = false;
-				break;
-
-			case SDLK_z:
-				chip8->keypad[0xA] = false;
-				break;
-			case SDLK_x:
-				chip8->keypad[0x0] = false;
-				break;
-			case SDLK_c:
-				chip8->keypad[0xB] = false;
-				break;
-			case SDLK_v:
-				chip8->keypad[0xF] = false;
-				break;
-			default:
-				break;
-			}
-			break;
-		default:
-			break;
 		}
+		memcpy(copy, chip8->ram[page], RAM_PAGE_SIZE);
+		chip8->ram[page] = copy;
+		chip8->own_pages |= 1u << page;
 	}
+	uint8_t *byte = &chip8->ram[page][addr % RAM_PAGE_SIZE];
+	chip8->ram_hash += ram_mix(addr, value) - ram_mix(addr, *byte);
+	*byte = value;
+}
+
+void copy_ram(const chip8_t *chip8, uint8_t out[RAM_SIZE]) {
+	for (uint32_t page = 0; page < RAM_PAGES; page++)
+		memcpy(&out[page * RAM_PAGE_SIZE], chip8->ram[page], RAM_PAGE_SIZE);
 }
 
 #ifdef DEBUG
-void print_debug_info(chip8_t *chip8) {
-	printf("Address: 0x%04X, Opcode: 0x%04X Desc: ", chip8->PC - 2,
-				 chip8->inst.opcode);
-	switch ((chip8->inst.opcode >> 12) & 0x0F) {
+void print_debug_info(const chip8_t *chip8, const instruction_t inst) {
+	printf("Address: 0x%04X, Opcode: 0x%04X Desc: ", chip8->regs.PC - 2,
+				 inst.opcode);
+	switch ((inst.opcode >> 12) & 0x0F) {
 	case 0x00:
-		if (chip8->inst.NN == 0xE0) {
+		if (inst.NN == 0xE0) {
 			// 0x00E0: clear screen
 			printf("Clear screen\n");
-		} else if (chip8->inst.NN == 0xEE) {
+		} else if (inst.NN == 0xEE) {
 			// 0x00EE: return from subroutine
 			// Grab last address from sub routine stack (pop from stack)
 			// set program counter to last address on stack
 			printf("Return from subroutine to address 0x%04X\n",
-						 *(chip8->stack_ptr - 1));
+						 chip8->regs.stack[(chip8->regs.sp - 1) & 15]);
 		} else {
 			printf("Unimplemented Opcode.\n");
 		}
@@ -440,97 +417,98 @@ void print_debug_info(chip8_t *chip8) {
 		// 0x1NNN: Jump to address NNN
 		printf(
 				"Jump to address NNN (0x%04X)\n",
-				chip8->inst.NNN); // Set program counter so that next opcode is from NNN
+				inst.NNN); // Set program counter so that next opcode is from NNN
+		break;
 	case 0x02:
 		// 0x2NNN: Call Subroutine at NNN
-		printf("Call subroutine at NNN (0x%04X) \n", chip8->inst.NNN);
+		printf("Call subroutine at NNN (0x%04X) \n", inst.NNN);
 		break;
 	case 0x03:
 		// 0x3XNN: Skip to next instruction if Vx == KK
-		printf("Increment PC by two if V%X(0x%02X) == NN(0x%02X)\n", chip8->inst.X,
-					 chip8->V[chip8->inst.X], chip8->inst.NN);
+		printf("Increment PC by two if V%X(0x%02X) == NN(0x%02X)\n", inst.X,
+					 chip8->regs.V[inst.X], inst.NN);
 		break;
 	case 0x04:
 		// 0x4XNN: Skip to next instruction if Vx != KK
-		printf("Increment PC by two if V%X(0x%02X) != NN(0x%02X)\n", chip8->inst.X,
-					 chip8->V[chip8->inst.X], chip8->inst.NN);
+		printf("Increment PC by two if V%X(0x%02X) != NN(0x%02X)\n", inst.X,
+					 chip8->regs.V[inst.X], inst.NN);
 		break;
 	case 0x05:
 		// 0x5XY0: Skip to next instruction if Vx == Vy
-		printf("Increment PC by two if V%X(0x%02X) == V%X(0x%02X)\n", chip8->inst.X,
-					 chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
+		printf("Increment PC by two if V%X(0x%02X) == V%X(0x%02X)\n", inst.X,
+					 chip8->regs.V[inst.X], inst.Y, chip8->regs.V[inst.Y]);
 		break;
 	case 0x06:
 		// 0x6XNN: Set register VX to NN
-		printf("Set register V%X = NN(%02X)\n", chip8->inst.X, chip8->inst.NN);
+		printf("Set register V%X = NN(%02X)\n", inst.X, inst.NN);
 		break;
 	case 0x07:
 		// 0x7XNN: Set register VX += NN
 		printf("Set register V%X (0x%02X) += NN(%02X), Result 0x%02X\n",
-					 chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN,
-					 chip8->V[chip8->inst.X] + chip8->inst.NN);
+					 inst.X, chip8->regs.V[inst.X], inst.NN,
+					 chip8->regs.V[inst.X] + inst.NN);
 		break;
 	case 0x08:
-		switch (chip8->inst.N) {
+		switch (inst.N) {
 		case 0x0:
 			// 0x8XY0: Set Vx = Vy
-			printf("Set register V%X (0x%02X) = V%X (0x%02X)\n", chip8->inst.X,
-						 chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
+			printf("Set register V%X (0x%02X) = V%X (0x%02X)\n", inst.X,
+						 chip8->regs.V[inst.X], inst.Y, chip8->regs.V[inst.Y]);
 			break;
 		case 0x1:
 			// 0x8XY1: Set Vx = Vx OR Vy
-			printf("Set register V%X (0x%02X) |= V%X (0x%02X)\n", chip8->inst.X,
-						 chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
+			printf("Set register V%X (0x%02X) |= V%X (0x%02X)\n", inst.X,
+						 chip8->regs.V[inst.X], inst.Y, chip8->regs.V[inst.Y]);
 			break;
 		case 0x2:
 			// 0x8XY2: Set Vx = Vx AND Vy
-			printf("Set register V%X (0x%02X) &= V%X (0x%02X)\n", chip8->inst.X,
-						 chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
+			printf("Set register V%X (0x%02X) &= V%X (0x%02X)\n", inst.X,
+						 chip8->regs.V[inst.X], inst.Y, chip8->regs.V[inst.Y]);
 			break;
 		case 0x3:
 			// 0x8XY3: Set Vx = Vx XOR Vy
-			printf("Set register V%X (0x%02X) ^= V%X (0x%02X)\n", chip8->inst.X,
-						 chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
+			printf("Set register V%X (0x%02X) ^= V%X (0x%02X)\n", inst.X,
+						 chip8->regs.V[inst.X], inst.Y, chip8->regs.V[inst.Y]);
 			break;
 		case 0x4:
 			// 0x8XY4: Add VX + VY, set VF = carry
 			printf("Set V%X (0x%02X) += V%X (0x%02X), ie 0x%X VF is set if there is "
 						 "overflow  \n",
-						 chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y,
-						 chip8->V[chip8->inst.Y],
-						 (uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]));
+						 inst.X, chip8->regs.V[inst.X], inst.Y,
+						 chip8->regs.V[inst.Y],
+						 (uint16_t)(chip8->regs.V[inst.X] + chip8->regs.V[inst.Y]));
 			break;
 		case 0x5:
 			// 0x8XY5: Set VX = VX - VY, Set VF = NOT borrow
 			printf(
 					"Set V%X (0x%02X) -= V%X (0x%02X), ie 0x%X VF is set if VX > VY  \n",
-					chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y,
-					chip8->V[chip8->inst.Y],
-					chip8->V[chip8->inst.X] - chip8->V[chip8->inst.Y]);
+					inst.X, chip8->regs.V[inst.X], inst.Y,
+					chip8->regs.V[inst.Y],
+					chip8->regs.V[inst.X] - chip8->regs.V[inst.Y]);
 			break;
 		case 0x6:
 			// 0x8XY6: Set VX = VX SHR 1
 			// If the least significant bit of Vx is 1, then VF is set 1, otherwise 0,
 			// Vx is divided 2
 			printf("if lsb of V%X (0x%X) == 1, VF is set 1, V%X /= 2\n",
-						 chip8->inst.X, chip8->V[chip8->inst.X] & 0x1,
-						 chip8->V[chip8->inst.X]);
+						 inst.X, chip8->regs.V[inst.X] & 0x1,
+						 chip8->regs.V[inst.X]);
 			break;
 		case 0x7:
 			// 0x8XY7: Set VX = VY - VX, Set VF = NOT borrow
 			printf(
 					"Set V%X (0x%02X) -= V%X (0x%02X), ie 0x%X VF is set if VX < VY  \n",
-					chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y,
-					chip8->V[chip8->inst.Y],
-					chip8->V[chip8->inst.X] - chip8->V[chip8->inst.Y]);
+					inst.X, chip8->regs.V[inst.X], inst.Y,
+					chip8->regs.V[inst.Y],
+					chip8->regs.V[inst.X] - chip8->regs.V[inst.Y]);
 			break;
 		case 0xe:
 			// 0x8XY6: Set VX = VX SHL 1
 			// If the most significant bit of Vx is 1, then VF is set to 1, otherwise
 			// 0. Then Vx is multiplied by 2
 			printf("if lsb of V%X (0x%X) == 1, VF is set 1, V%X /= 2\n",
-						 chip8->inst.X, chip8->V[chip8->inst.X] >> 7 & 0x1,
-						 chip8->V[chip8->inst.X]);
+						 inst.X, chip8->regs.V[inst.X] >> 7 & 0x1,
+						 chip8->regs.V[inst.X]);
 			break;
 		default:
 			printf("Unimplemented Opcode\n");
@@ -539,83 +517,83 @@ void print_debug_info(chip8_t *chip8) {
 		break;
 	case 0x09:
 		// 0x9XY0: Skip to next instruction if Vx != Vy
-		printf("Increment PC by two if V%X(0x%02X) != V%X(0x%02X)\n", chip8->inst.X,
-					 chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y]);
+		printf("Increment PC by two if V%X(0x%02X) != V%X(0x%02X)\n", inst.X,
+					 chip8->regs.V[inst.X], inst.Y, chip8->regs.V[inst.Y]);
 		break;
 	case 0x0A:
 		// 0xANNN: Set index register I to NNN
-		printf("Set I to NNN (0x%04X)\n", chip8->inst.NNN);
+		printf("Set I to NNN (0x%04X)\n", inst.NNN);
 		break;
 	case 0x0B:
 		// 0xBNNN: Jump to location nnn + V0 (PC = V0 + NNN)
-		printf("Set PC to V0 (0x%02X) + NNN (0x%04X) = 0x%04X\n", chip8->V[0],
-					 chip8->inst.NNN, chip8->V[0] + chip8->inst.NNN);
+		printf("Set PC to V0 (0x%02X) + NNN (0x%04X) = 0x%04X\n", chip8->regs.V[0],
+					 inst.NNN, chip8->regs.V[0] + inst.NNN);
 		break;
 	case 0x0C:
-		// 0xCXNN: Sets register VX = rand() % 256 & NN (bitwise AND)
-		printf("Set V%X = rand() %% 256 & NN (0x%02X)\n", chip8->inst.X,
-					 chip8->inst.NN);
+		// 0xCXNN: Sets register VX = random byte & NN (bitwise AND)
+		printf("Set V%X = random byte & NN (0x%02X)\n", inst.X,
+					 inst.NN);
 		break;
 	case 0x0D:
 		// 0xDXYN: Draw N-height sprite at coords X,Y; Read from location I;
 		printf("Draw N (%u) height sprite at coords V%X (0x%02X), V%X (0x%02X) "
 					 "from memory location I (0x%04X). Set VF = 1 if any pixels are "
 					 "turned off.\n",
-					 chip8->inst.N, chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y,
-					 chip8->V[chip8->inst.Y], chip8->I);
+					 inst.N, inst.X, chip8->regs.V[inst.X], inst.Y,
+					 chip8->regs.V[inst.Y], chip8->regs.I);
 		break;
 	case 0x0E:
-		if (chip8->inst.NN == 0x9E) {
+		if (inst.NN == 0x9E) {
 			// 0xEX9E: Skip next instruction if the key with the value of VX is
 			// pressed
 			printf("Skip next instruction if the key in V%X (0x%02X) is pressed; ",
-						 chip8->inst.X, chip8->V[chip8->inst.X]);
-		} else if (chip8->inst.NN == 0xA1) {
+						 inst.X, chip8->regs.V[inst.X]);
+		} else if (inst.NN == 0xA1) {
 			// 0xEXA1: Skip next instruction if the key with the value of VX is not
 			// pressed
 			printf(
 					"Skip next instruction if the key in V%X (0x%02X) is not pressed; ",
-					chip8->inst.X, chip8->V[chip8->inst.X]);
+					inst.X, chip8->regs.V[inst.X]);
 		}
 		break;
 	case 0x0F:
-		switch (chip8->inst.NN) {
+		switch (inst.NN) {
 		case 0x0A:
 			// 0xFX0A: Wait for a key press and store the value of the key in Vx.
 			// All execution stops until a key is pressed, then the value of the key
 			// is stored in Vx.
-			printf("Waiting for key press; Store key in V%X\n", chip8->inst.X);
+			printf("Waiting for key press; Store key in V%X\n", inst.X);
 			break;
 		case 0x1E:
 			// 0xFX1Ea: Set I = I + Vx;
-			printf("I(0x%04X) +=V%X (0x%02X)\n", chip8->I, chip8->inst.X,
-						 chip8->V[chip8->inst.X]);
+			printf("I(0x%04X) +=V%X (0x%02X)\n", chip8->regs.I, inst.X,
+						 chip8->regs.V[inst.X]);
 			break;
 		case 0x15:
 			// 0xFX15: Set delay time = Vx
-			printf("delay_timer(0x%02X) = V%X(0x%02X)\n", chip8->delay_timer,
-						 chip8->inst.X, chip8->V[chip8->inst.X]);
+			printf("delay_timer(0x%02X) = V%X(0x%02X)\n", chip8->regs.delay_timer,
+						 inst.X, chip8->regs.V[inst.X]);
 			break;
 		case 0x07:
 			// 0xFX07: Set Vx = delay timer value.
-			printf("V%X (0x%02X)= 0x%02X\n", chip8->inst.X, chip8->V[chip8->inst.X],
-						 chip8->delay_timer);
+			printf("V%X (0x%02X)= 0x%02X\n", inst.X, chip8->regs.V[inst.X],
+						 chip8->regs.delay_timer);
 			break;
 		case 0x18:
 			// 0xFX18: Set sound timer = Vx
-			printf("sound_timer(0x%02X) = V%X(0x%02X)\n", chip8->sound_timer,
-						 chip8->inst.X, chip8->V[chip8->inst.X]);
+			printf("sound_timer(0x%02X) = V%X(0x%02X)\n", chip8->regs.sound_timer,
+						 inst.X, chip8->regs.V[inst.X]);
 			break;
 		case 0x29:
 			// 0xFX29: Set I = location of sprite for digit Vx
 			printf("Set I to location of sprite for digit V%X(%02X), ie %02X \n",
-						 chip8->inst.X, chip8->V[chip8->inst.X],
-						 chip8->V[chip8->inst.X] * 5);
+						 inst.X, chip8->regs.V[inst.X],
+						 chip8->regs.V[inst.X] * 5);
 			break;
 		case 0x33:
 			printf("Store BCD representation of V%X (0x%02X) at memory from I "
 						 "(0x%04X)\n",
-						 chip8->inst.X, chip8->V[chip8->inst.X], chip8->I);
+						 inst.X, chip8->regs.V[inst.X], chip8->regs.I);
 			break;
 		case 0x55:
 			// 0xFX55: Store registers V0 through VX in memory starting at location I
@@ -623,7 +601,7 @@ void print_debug_info(chip8_t *chip8) {
 			// memory, starting at the address I
 			printf("Store registers V0 through V%X in memory starting at location "
 						 "0x%04X",
-						 chip8->inst.X, chip8->I);
+						 inst.X, chip8->regs.I);
 			break;
 		case 0x65:
 			// 0xFX65: Read registers V0 through VX from memory starting at locaation
@@ -631,7 +609,7 @@ void print_debug_info(chip8_t *chip8) {
 			// registers V0 through VX
 			printf("Read registers V0 through V%X from memory starting at location "
 						 "0x%04X",
-						 chip8->inst.X, chip8->I);
+						 inst.X, chip8->regs.I);
 			break;
 		default:
 			printf("Unimplemented Opcode\n");
@@ -648,123 +626,128 @@ void print_debug_info(chip8_t *chip8) {
 // Emulate 1 CHIP8 instruction
 void emulate_instruction(chip8_t *chip8, const config_t config) {
 	// Get next opcode from ram
-	chip8->inst.opcode = chip8->ram[chip8->PC] << 8 | chip8->ram[chip8->PC + 1];
-	chip8->PC += 2; // Pre increment pc for next opcode
+	instruction_t inst;
+	inst.opcode =
+			read_ram(chip8, chip8->regs.PC) << 8 | read_ram(chip8, chip8->regs.PC + 1);
+	chip8->regs.PC += 2; // Pre increment pc for next opcode
 
-	// Fill out current instruction format
+	// Fill out current instruction format, kept in registers rather than
+	// the machine state
 	// DXYN
-	chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
-	chip8->inst.NN = chip8->inst.opcode & 0x0FF;
-	chip8->inst.N = chip8->inst.opcode & 0x0F;
-	chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
-	chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
+	inst.NNN = inst.opcode & 0x0FFF;
+	inst.NN = inst.opcode & 0x0FF;
+	inst.N = inst.opcode & 0x0F;
+	inst.X = (inst.opcode >> 8) & 0x0F;
+	inst.Y = (inst.opcode >> 4) & 0x0F;
 
 #ifdef DEBUG
-	print_debug_info(chip8);
+	print_debug_info(chip8, inst);
 #endif
 
 	uint8_t X_coord;
 	uint8_t Y_coord;
 	// Emulate opcode
-	switch ((chip8->inst.opcode >> 12) & 0x0F) {
+	switch ((inst.opcode >> 12) & 0x0F) {
 	case 0x00:
-		if (chip8->inst.NN == 0xE0) {
+		if (inst.NN == 0xE0) {
 			// 0x00E0: clear screen
-			memset(&chip8->display[0], false, sizeof chip8->display);
-		} else if (chip8->inst.NN == 0xEE) {
+			memset(&chip8->display[0], 0, sizeof chip8->display);
+			chip8->dirty_rows = ~0u;
+		} else if (inst.NN == 0xEE) {
 			// 0x00EE: return from subroutine
 			// Grab last address from sub routine stack (pop from stack)
 			// set program counter to last address on stack
-			chip8->PC = *--chip8->stack_ptr;
+			chip8->regs.PC = chip8->regs.stack[--chip8->regs.sp & 15];
 		} else {
 			// Unimplemented/invalid opcode, may be 0xNNN for calling machine code
 		}
 		break;
 	case 0x01:
 		// 0x1NNN: Jump to address NNN
-		chip8->PC =
-				chip8->inst.NNN; // Set program counter so that next opcode is from NNN
+		chip8->regs.PC =
+				inst.NNN; // Set program counter so that next opcode is from NNN
 		break;
 	case 0x02:
 		// 0x2NNN: Call Subroutine at NNN
 		// subroutine stack (push to the stack)
-		*chip8->stack_ptr++ = chip8->PC; // Store current address to return to the
-		chip8->PC = chip8->inst.NNN; // Store the subroutine address to the PC so it
-																 // will get executed next
+		// Store current address to return to, then the subroutine address to
+		// the PC so it will get executed next
+		chip8->regs.stack[chip8->regs.sp++ & 15] = chip8->regs.PC;
+		chip8->regs.PC = inst.NNN;
 		break;
 	case 0x03:
 		// 0x3XNN: Skip to next instruction if Vx == NN
-		if (chip8->V[chip8->inst.X] == chip8->inst.NN)
-			chip8->PC += 2;
+		if (chip8->regs.V[inst.X] == inst.NN)
+			chip8->regs.PC += 2;
 		break;
 	case 0x04:
 		// 0x4XNN: Skip to next instruction if Vx != KK
-		if (chip8->V[chip8->inst.X] != chip8->inst.NN)
-			chip8->PC += 2;
+		if (chip8->regs.V[inst.X] != inst.NN)
+			chip8->regs.PC += 2;
 		break;
 	case 0x05:
 		// 0x5XY0: Skip to next instruction if Vx == Vy
-		if (chip8->inst.N != 0)
+		if (inst.N != 0)
 			break; // Wrong Opcode
-		if (chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y])
-			chip8->PC += 2;
+		if (chip8->regs.V[inst.X] == chip8->regs.V[inst.Y])
+			chip8->regs.PC += 2;
 		break;
 	case 0x06:
 		// 0x6XNN: Set register VX to NN
-		chip8->V[chip8->inst.X] = chip8->inst.NN;
+		chip8->regs.V[inst.X] = inst.NN;
 		break;
 	case 0x07:
 		// 0x7XNN: Set register VX += NN
-		chip8->V[chip8->inst.X] += chip8->inst.NN;
+		chip8->regs.V[inst.X] += inst.NN;
 		break;
 	case 0x08:
-		switch (chip8->inst.N) {
+		switch (inst.N) {
 		case 0x0:
 			// 0x8XY0: Set Vx = Vy
-			chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
+			chip8->regs.V[inst.X] = chip8->regs.V[inst.Y];
 			break;
 		case 0x1:
 			// 0x8XY1: Set Vx = Vx OR Vy
-			chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
+			chip8->regs.V[inst.X] |= chip8->regs.V[inst.Y];
 			break;
 		case 0x2:
 			// 0x8XY2: Set Vx = Vx AND Vy
-			chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
+			chip8->regs.V[inst.X] &= chip8->regs.V[inst.Y];
 			break;
 		case 0x3:
 			// 0x8XY3: Set Vx = Vx XOR Vy
-			chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
+			chip8->regs.V[inst.X] ^= chip8->regs.V[inst.Y];
 			break;
 		case 0x4:
 			// 0x8XY4: Add VX + VY, set VF = carry
-			if ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255)
-				chip8->V[0xF] = 1;
-			chip8->V[chip8->inst.X] += chip8->V[chip8->inst.Y];
+			if ((uint16_t)(chip8->regs.V[inst.X] + chip8->regs.V[inst.Y]) > 255)
+				chip8->regs.V[0xF] = 1;
+			chip8->regs.V[inst.X] += chip8->regs.V[inst.Y];
 			break;
 		case 0x5:
 			// 0x8XY5: Set VX = VX - VY, Set VF = NOT borrow
-			chip8->V[0xF] = chip8->V[chip8->inst.X] >= chip8->V[chip8->inst.Y];
-			chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
+			chip8->regs.V[0xF] = chip8->regs.V[inst.X] >= chip8->regs.V[inst.Y];
+			chip8->regs.V[inst.X] -= chip8->regs.V[inst.Y];
 			break;
 		case 0x6:
 			// 0x8XY6: Set VX = VX SHR 1
 			// If the least significant bit of Vx is 1, then VF is set 1, otherwise 0,
 			// Vx is divided 2
-			chip8->V[0xF] = chip8->V[chip8->inst.X] & 1;
-			chip8->V[chip8->inst.X] >>= 1;
+			chip8->regs.V[0xF] = chip8->regs.V[inst.X] & 1;
+			chip8->regs.V[inst.X] >>= 1;
 			break;
 		case 0x7:
 			// 0x8XY7: Set VX = VY - VX, Set VF = NOT borrow
-			chip8->V[0xF] = chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y];
-			chip8->V[chip8->inst.X] =
-					chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
+			chip8->regs.V[0xF] = chip8->regs.V[inst.X] <= chip8->regs.V[inst.Y];
+			chip8->regs.V[inst.X] =
+					chip8->regs.V[inst.Y] - chip8->regs.V[inst.X];
 			break;
 		case 0xe:
 			// 0x8XY6: Set VX = VX SHL 1
 			// If the most significant bit of Vx is 1, then VF is set to 1, otherwise
 			// 0. Then Vx is multiplied by 2
-			chip8->V[0xF] = chip8->V[chip8->inst.X] >> 7 & 1;
-			chip8->V[chip8->inst.X] <<= 1;
+			chip8->regs.V[0xF] = chip8->regs.V[inst.X] >> 7 & 1;
+			chip8->regs.V[inst.X] <<= 1;
 			break;
 		default:
 			// Wrong opcode
@@ -773,74 +756,70 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
 		break;
 	case 0x09:
 		// 0x9XY0: Skip to next instruction if Vx != Vy
-		if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y])
-			chip8->PC += 2;
+		if (chip8->regs.V[inst.X] != chip8->regs.V[inst.Y])
+			chip8->regs.PC += 2;
 		break;
 	case 0x0A:
 		// 0xANNN: Set index register I to NNN
-		chip8->I = chip8->inst.NNN;
+		chip8->regs.I = inst.NNN;
 		break;
 	case 0x0B:
 		// 0xBNNN: Jump to location nnn + V0 (PC = V0 + NNN)
-		chip8->PC = chip8->V[0] + chip8->inst.NNN;
+		chip8->regs.PC = chip8->regs.V[0] + inst.NNN;
 		break;
 	case 0x0C:
-		// 0xCXNN: Sets register VX = rand() % 256 & NN (bitwise AND)
-		chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
+		// 0xCXNN: Sets register VX = random byte & NN (bitwise AND)
+		chip8->rng ^= chip8->rng << 13; // xorshift64
+		chip8->rng ^= chip8->rng >> 7;
+		chip8->rng ^= chip8->rng << 17;
+		chip8->regs.V[inst.X] = (chip8->rng >> 56) & inst.NN;
 		break;
 	case 0x0D:
 		// 0xDXYN: Draw N-height sprite at coords X,Y; Read from location I;
 		// Screen pixels are XOR'd with sprite bits,
 		// VF (Carry flag) is set if any screen pixels are set off; This is useful
 		// for collision detection or other reasons.
-		X_coord = chip8->V[chip8->inst.X] % config.window_width;
-		Y_coord = chip8->V[chip8->inst.Y] % config.window_height;
+		X_coord = chip8->regs.V[inst.X] % config.window_width;
+		Y_coord = chip8->regs.V[inst.Y] % config.window_height;
 
-		const uint8_t og_X = X_coord;
+		chip8->regs.V[0xF] = 0; // Init carry flag to 0
 
-		chip8->V[0xF] = 0; // Init carry flag to 0
+		for (uint8_t i = 0; i < inst.N; i++) {
+			// Get next byte/row of sprite data, lined up with X_coord in the display
+			// row. Bits shifted past the right edge of the screen are dropped.
+			const uint64_t sprite_row =
+					(uint64_t)read_ram(chip8, chip8->regs.I + i) << 56 >> X_coord;
+			uint64_t *row = &chip8->display[Y_coord];
 
-		for (uint8_t i = 0; i < chip8->inst.N; i++) {
-			// Get next byte/row of sprite data
-			const uint8_t sprite_data = chip8->ram[chip8->I + i];
-			X_coord = og_X; // Reset X for next row to draw
-
-			for (int8_t j = 7; j >= 0; j--) {
-				// If sprite pixel/bit is on and display pixel is on, set carry flag
-				bool *pixel = &chip8->display[Y_coord * config.window_width + X_coord];
-				const bool sprite_bit = (sprite_data & (1 << j));
-
-				if (sprite_bit && *pixel) {
-					chip8->V[0xF] = 1;
-				}
+			// If any sprite pixel/bit is on where a display pixel is on, set carry
+			if (*row & sprite_row)
+				chip8->regs.V[0xF] = 1;
 
-				// XOR display pixel with sprite pixel/bit
-				*pixel ^= sprite_bit;
+			// XOR display pixels with sprite pixels/bits
+			*row ^= sprite_row;
+			if (sprite_row)
+				chip8->dirty_rows |= 1u << Y_coord;
 
-				// Stop drawing if hit right edge of screen
-				if (++X_coord >= config.window_width)
-					break;
-			}
 			// Stop drawing entire sprite if hit bottom edge of screen
 			if (++Y_coord >= config.window_height)
 				break;
 		}
 		break;
 	case 0x0E:
-		if (chip8->inst.NN == 0x9E) {
+		if (inst.NN == 0x9E) {
 			// 0xEX9E: Skip next instruction if the key with the value of VX is
 			// pressed
-			if (chip8->keypad[chip8->V[chip8->inst.X]])
-				chip8->PC += 2;
-		} else if (chip8->inst.NN == 0xA1) {
+			if (chip8->keypad[chip8->regs.V[inst.X]])
+				chip8->regs.PC += 2;
+		} else if (inst.NN == 0xA1) {
 			// 0xEXA1: Skip next instruction if the key with the value of VX is not
 			// pressed
-			if (!chip8->keypad[chip8->V[chip8->inst.X]])
-				chip8->PC += 2;
+			if (!chip8->keypad[chip8->regs.V[inst.X]])
+				chip8->regs.PC += 2;
 		}
 		break;
 	case 0x0F:
-		switch (chip8->inst.NN) {
+		switch (inst.NN) {
 		case 0x0A: {
 			// 0xFX0A: Wait for a key press and store the value of the key in Vx.
 			// All execution stops until a key is pressed, then the value of the key
@@ -848,59 +827,60 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
 			bool key_pressed = false;
 			for (uint8_t i = 0; i < sizeof chip8->keypad; i++)
 				if (chip8->keypad[i]) {
-					chip8->V[chip8->inst.X] = i;
+					chip8->regs.V[inst.X] = i;
 					key_pressed = true;
 					break;
 				}
 			// If no key has been pressed yet, keep getting the current opcode &
 			// running this instruction
 			if (!key_pressed)
-				chip8->PC -= 2;
+				chip8->regs.PC -= 2;
+			break;
 		}
 		case 0x1E:
 			// 0xFX1E: Set I = I + Vx;
-			chip8->I += chip8->V[chip8->inst.X];
+			chip8->regs.I += chip8->regs.V[inst.X];
 			break;
 		case 0x15:
 			// 0xFX15: Set delay time = Vx
-			chip8->delay_timer = chip8->V[chip8->inst.X];
+			chip8->regs.delay_timer = chip8->regs.V[inst.X];
 			break;
 		case 0x07:
 			// 0xFX07: Set Vx = delay timer value.
-			chip8->V[chip8->inst.X] = chip8->delay_timer;
+			chip8->regs.V[inst.X] = chip8->regs.delay_timer;
 			break;
 		case 0x18:
 			// 0xFX18: Set sound timer = Vx
-			chip8->sound_timer = chip8->V[chip8->inst.X];
+			chip8->regs.sound_timer = chip8->regs.V[inst.X];
 			break;
 		case 0x29:
 			// 0xFX29: Set I = location of sprite for digit Vx
-			chip8->I = chip8->V[chip8->inst.X] * 5;
+			chip8->regs.I = chip8->regs.V[inst.X] * 5;
 			break;
 		case 0x33: {
 			// 0xFX33: Store BCD representation of VX in memory location I, I+1, I+2
 			// I = hundred's place, I+1 = tent's palce, I+2 = one's place
-			uint8_t bcd = chip8->V[chip8->inst.X]; // 123
-			chip8->ram[chip8->I + 2] = bcd % 10;
+			uint8_t bcd = chip8->regs.V[inst.X]; // 123
+			store_ram(chip8, chip8->regs.I + 2, bcd % 10);
 			bcd /= 10;
-			chip8->ram[chip8->I + 1] = bcd % 10;
+			store_ram(chip8, chip8->regs.I + 1, bcd % 10);
 			bcd /= 10;
-			chip8->ram[chip8->I] = bcd;
+			store_ram(chip8, chip8->regs.I, bcd);
 			break;
 		}
 		case 0x55:
 			// 0xFX55: Store registers V0 through VX in memory starting at location I
 			// The interpreter copies the values of registers V0 through VX into
 			// memory, starting at the address I
-			for (uint8_t i = 0; i <= chip8->inst.X; i++)
-				chip8->ram[chip8->I + i] = chip8->V[i];
+			for (uint8_t i = 0; i <= inst.X; i++)
+				store_ram(chip8, chip8->regs.I + i, chip8->regs.V[i]);
 			break;
 		case 0x65:
 			// 0xFX65: Read registers V0 through VX from memory starting at locaation
 			// I The interpreter reads values from memory starting at location I into
 			// registers V0 through VX
-			for (uint8_t i = 0; i <= chip8->inst.X; i++)
-				chip8->V[i] = chip8->ram[chip8->I + i];
+			for (uint8_t i = 0; i <= inst.X; i++)
+				chip8->regs.V[i] = read_ram(chip8, chip8->regs.I + i);
 			break;
 		}
 		break;
@@ -909,23 +889,307 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
 	}
 }
 
-void update_timers(const sdl_t sdl, chip8_t *chip8) {
-	if (chip8->delay_timer > 0)
-		chip8->delay_timer--;
-	if (chip8->sound_timer > 0) {
-		chip8->sound_timer--;
-		// Play sound
-		SDL_PauseAudioDevice(sdl.dev, 0);
-	} else {
-		// Stop playing sound
-		SDL_PauseAudioDevice(sdl.dev, 1);
+// Only one machine is heard; the others pass NULL audio
+void update_timers(audio_t *audio, chip8_t *chip8) {
+	if (chip8->regs.delay_timer > 0)
+		chip8->regs.delay_timer--;
+	if (chip8->regs.sound_timer > 0)
+		chip8->regs.sound_timer--;
+	if (!audio)
+		return;
+	// Tone stops at the end of this frame if the timer just ran out
+	audio_set_tone(audio, audio->frame_samples, chip8->regs.sound_timer > 0);
+	audio_end_frame(audio);
+}
+
+// Emulate one 60hz frame worth of CHIP8 instructions
+void emulate_frame(chip8_t *chip8, const config_t config, audio_t *audio,
+									 displog_t *displog) {
+	const uint32_t insts_per_frame = config.insts_per_second / 60;
+	for (uint32_t i = 0; i < insts_per_frame; i++) {
+		if (displog)
+			displog_instruction(displog, chip8, i);
+		emulate_instruction(chip8, config);
+		// Stamp sound timer edges (FX18) with the instruction's sample position
+		if (audio)
+			audio_set_tone(audio, i * audio->frame_samples / insts_per_frame,
+										 chip8->regs.sound_timer > 0);
+	}
+}
+
+// Per frame outputs besides the window: recording, display command log,
+// shared memory export and the VNC server
+typedef struct {
+	capture_t *capture;
+	displog_t *displog;
+	shm_export_t shm;
+	bool shm_open;
+	vnc_t *vnc;
+} outputs_t;
+
+bool open_outputs(outputs_t *outputs, const config_t config) {
+	*outputs = (outputs_t){0};
+	if (config.capture_out) {
+		outputs->capture = capture_open(config.capture_out, config.capture_scale,
+																		config.fg_color, config.bg_color);
+		if (!outputs->capture) {
+			fprintf(stderr, "Could not start capture to %s\n", config.capture_out);
+			return false;
+		}
+	}
+	if (config.display_log) {
+		outputs->displog = displog_open(config.display_log,
+																		config.insts_per_second / 60,
+																		config.keyframe_interval);
+		if (!outputs->displog) {
+			fprintf(stderr, "Could not start display log %s\n", config.display_log);
+			return false;
+		}
+	}
+	if (config.shm_export) {
+		if (!shm_export_open(&outputs->shm, config.shm_name)) {
+			fprintf(stderr, "Could not create shared memory %s\n",
+							config.shm_name ? config.shm_name : "");
+			return false;
+		}
+		printf("Exporting machine state to shared memory %s\n",
+					 outputs->shm.name);
+		outputs->shm_open = true;
+	}
+	if (config.vnc_port) {
+		outputs->vnc = vnc_open(config.vnc_bind, config.vnc_port,
+														config.vnc_scale, config.fg_color, config.bg_color);
+		if (!outputs->vnc) {
+			fprintf(stderr, "Could not start VNC server on %s:%u\n", config.vnc_bind,
+							config.vnc_port);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Hand a completed frame to every output, then start a new dirty frame.
+// Keys pressed by VNC clients take effect from the next frame.
+void publish_frame(outputs_t *outputs, chip8_t *chip8) {
+	if (outputs->capture)
+		capture_frame(outputs->capture, chip8->display, chip8->dirty_rows);
+	if (outputs->displog)
+		displog_end_frame(outputs->displog, chip8->display);
+	if (outputs->shm_open)
+		shm_export_publish(&outputs->shm, chip8);
+	if (outputs->vnc) {
+		vnc_publish(outputs->vnc, chip8->display, chip8->dirty_rows);
+		vnc_apply_keys(outputs->vnc, chip8->keypad);
+	}
+	chip8->dirty_rows = 0;
+}
+
+bool close_outputs(outputs_t *outputs, const config_t config) {
+	bool ok = true;
+	if (outputs->capture && !capture_close(outputs->capture)) {
+		fprintf(stderr, "Could not finish capture to %s\n", config.capture_out);
+		ok = false;
+	}
+	if (outputs->displog && !displog_close(outputs->displog)) {
+		fprintf(stderr, "Could not finish display log %s\n", config.display_log);
+		ok = false;
+	}
+	if (outputs->shm_open)
+		shm_export_close(&outputs->shm);
+	if (outputs->vnc)
+		vnc_close(outputs->vnc);
+	return ok;
+}
+
+// Main emulator loop on any backend. Realtime backends are paced against
+// absolute deadlines so the sub-millisecond rate adjustments aren't lost to
+// coarse sleeps; the others run flat out. When the backend presents with
+// vsync, the display paces the loop instead and emulation catches up with
+// the emulated clock each refresh, so a 120/144hz monitor shows the 60hz
+// frames without a second timer beating against it.
+//
+// With several instances, input goes to the first machine and is copied to
+// the rest, and only the first is heard and handed to the other outputs.
+// The rest are tasks on a pool of config.jobs workers, one page arena
+// each, and go through the frame cache if there is one.
+bool run(chip8_t *machines, const config_t config, outputs_t *outputs,
+				 const backend_t *backend, arena_t *page_arenas) {
+	chip8_t *chip8 = &machines[0];
+	uint32_t *dirty_rows = calloc(config.instances, sizeof *dirty_rows);
+	if (!dirty_rows)
+		return false;
+	memo_t *memo = NULL;
+	if (config.memo_mb && config.instances > 1) {
+		memo = memo_create((size_t)config.memo_mb << 20);
+		if (!memo) {
+			free(dirty_rows);
+			return false;
+		}
+	}
+	sched_t *sched = NULL;
+	if (config.instances > 1) {
+		sched = sched_create(&machines[1], config.instances - 1, config, memo,
+												 page_arenas, config.jobs, false);
+		if (!sched) {
+			if (memo)
+				memo_destroy(memo);
+			free(dirty_rows);
+			return false;
+		}
+	}
+	audio_t audio;
+	void *state = backend->init(config, &audio);
+	if (!state) {
+		if (sched)
+			sched_destroy(sched);
+		if (memo)
+			memo_destroy(memo);
+		free(dirty_rows);
+		return false;
+	}
+
+	const bool vsync = backend->refresh_hz && backend->refresh_hz(state) > 0;
+	const uint64_t frame_ns = 1000000000ULL / 60;
+	uint64_t frame_deadline = backend->now_ns(state);
+	uint32_t frames = 0;
+	bool keys[16] = {0};
+	while (chip8->state != QUIT) {
+		// Handle user input. The other machines only hear of key changes,
+		// which wake those waiting for a key.
+		backend->poll(state, chip8);
+		if (sched && memcmp(keys, chip8->keypad, sizeof keys) != 0) {
+			memcpy(keys, chip8->keypad, sizeof keys);
+			for (uint32_t i = 0; i < sched->task_count; i++)
+				sched_set_keys(sched, &sched->tasks[i], keys);
+		}
+		const bool visible = !backend->visible || backend->visible(state);
+		if (chip8->state == PAUSED ||
+				(!visible && config.when_hidden == HIDDEN_PAUSE)) {
+			backend->sleep_until(state, backend->now_ns(state) + frame_ns);
+			frame_deadline = backend->now_ns(state);
+			continue;
+		}
+
+		const uint64_t now = backend->now_ns(state);
+		if (backend->realtime && now > frame_deadline + frame_ns * 6)
+			frame_deadline = now; // Fell far behind (stall); don't try to catch up
+
+		// Emulate every frame due by now when something else sets the pace:
+		// vsync, or a hidden window woken only every few frames. Otherwise
+		// exactly one frame.
+		const bool throttled = !visible && config.when_hidden == HIDDEN_THROTTLE;
+		const bool catch_up = (vsync && visible) || throttled;
+		while (!catch_up || now >= frame_deadline) {
+			// emulate CHIP8 Instructions for this emulator frame (60hz)
+			emulate_frame(chip8, config, &audio, outputs->displog);
+			// Hand the frame to the other outputs, which clears dirty rows
+			dirty_rows[0] |= chip8->dirty_rows;
+			publish_frame(outputs, chip8);
+			// update delay and sound timers (60hz)
+			update_timers(&audio, chip8);
+			if (sched)
+				sched_frame(sched);
+			backend->end_frame(state, &audio);
+			frames++;
+
+			// Next deadline is ~16.67ms (60hz) out, stretched or shrunk by a
+			// fraction of a percent to hold audio latency at its target
+			frame_deadline += (uint64_t)(frame_ns * audio_rate_control(&audio));
+			if (!catch_up || (config.max_frames && frames >= config.max_frames))
+				break;
+		}
+		if (throttled)
+			backend->sleep_until(state, frame_deadline + frame_ns * 4);
+		else if (backend->realtime && !(vsync && visible))
+			backend->sleep_until(state, frame_deadline);
+
+		// Show the latest completed frame, if anyone can see it
+		if (visible) {
+			if (config.instances > 1 && backend->present_tiles) {
+				// The other machines keep their drawn rows until shown
+				for (uint32_t i = 1; i < config.instances; i++) {
+					dirty_rows[i] = machines[i].dirty_rows;
+					machines[i].dirty_rows = 0;
+				}
+				backend->present_tiles(state, machines, config.instances, dirty_rows);
+			} else
+				backend->present(state, chip8, dirty_rows[0]);
+			memset(dirty_rows, 0, config.instances * sizeof *dirty_rows);
+		}
+
+		if (config.max_frames && frames >= config.max_frames)
+			break;
+	}
+
+	if (sched) {
+		sched_report(sched);
+		sched_destroy(sched);
+	}
+	if (memo) {
+		memo_report(memo);
+		memo_destroy(memo);
+	}
+	free(dirty_rows);
+	return backend->cleanup(state);
+}
+
+// Rebuild one frame of a display log and write it out as a PNG
+bool replay_display_log(const config_t config) {
+	displog_reader_t *reader = displog_reader_open(config.roms[0]);
+	if (!reader) {
+		fprintf(stderr, "%s is not a display log\n", config.roms[0]);
+		return false;
+	}
+	uint64_t display[32];
+	if (!displog_read_frame(reader, config.replay_frame, display)) {
+		fprintf(stderr, "Frame %u is past the end of the log (%" PRIu64 " frames)\n",
+						config.replay_frame, reader->frames);
+		displog_reader_close(reader);
+		return false;
 	}
+	displog_reader_close(reader);
+
+	// PNG lines are MSB first, like the display rows
+	uint8_t bits[32][8];
+	for (uint32_t y = 0; y < 32; y++)
+		for (uint32_t b = 0; b < 8; b++)
+			bits[y][b] = display[y] >> (56 - 8 * b);
+	if (!png_write(config.replay_png, &bits[0][0], 64, 32, sizeof bits[0],
+								 config.fg_color, config.bg_color)) {
+		fprintf(stderr, "Could not write %s\n", config.replay_png);
+		return false;
+	}
+	return true;
 }
 
+// make check links the emulator with its own main
+#ifndef CHIP8_NO_MAIN
 int main(int argc, char **argv) {
 	// Default usage message for args
 	if (argc < 2) {
-		fprintf(stderr, "Usage: %s <rom_name>\n", argv[0]);
+		fprintf(stderr, "Usage: %s <rom_name> [--latency-ms <ms>] [--seed <n>]\n"
+										"       [--backend <sdl|null|shm|term>] [--frames <n>]\n"
+										"       [--scanlines] [--persistence <percent>] [--no-vsync]\n"
+										"       [--when-hidden <run|throttle|pause>]\n"
+										"       [--renderer <name|probe>]\n"
+										"       [--tile <rom>]... [--instances <n>] [--tile-columns <n>]\n"
+										"       [--capture <file> [--capture-scale <n>]]\n"
+										"       [--display-log <file> [--keyframe-interval <frames>]]\n"
+										"       [--memo <MiB>] [--no-hugepages] [--jobs <n>]\n"
+										"       [--shm | --shm-name <name>]\n"
+										"       [--vnc <port> [--vnc-bind <ipv4>] [--vnc-scale <n>]]\n"
+										"       [--headless --frames <n> [--audio-out <file>]]\n"
+										"       [--term <half|braille>]\n"
+										"   or: %s <rom_dir> --thumbnails <out_dir> [--thumb-frames <n,...>]\n"
+										"       [--atlas] [--input <script>] [--jobs <n>] [--capture-scale <n>]\n"
+										"       [--memo <MiB>]\n"
+										"   or: %s <display_log> --replay-frame <n> --png <file>\n"
+										"   or: %s <socket> --serve [--sessions <n>] [--jobs <n>] [--memo <MiB>]\n"
+										"   or: %s <rom_name> --envs <n> [--env-steps <n>] [--frameskip <n>]\n"
+										"       [--obs <packed|pixels>] [--downsample <n>] [--frame-stack <n>]\n"
+										"       [--reward <expr>] [--terminal <expr>] [--episode-frames <n>]\n"
+										"       [--jobs <n>] [--memo <MiB>]\n",
+						argv[0], argv[0], argv[0], argv[0], argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
@@ -934,53 +1198,98 @@ int main(int argc, char **argv) {
 	if (!set_config_from_args(&config, argc, argv))
 		exit(EXIT_FAILURE);
 
-	// Initialize SDL
-	sdl_t sdl = {0};
-	if (!init_sdl(&sdl, config))
-		exit(EXIT_FAILURE);
-
-	// Init chip8 machine
-	chip8_t chip8 = {0};
-	const char *rom_name = argv[1];
-	if (!init_chip8(&chip8, rom_name))
-		exit(EXIT_FAILURE);
+	// Seed the machines' random number generators
+	if (!config.seed_set)
+		config.seed = time(NULL);
 
-	// Initial screen clear
-	clear_screen(config, sdl);
+	// Rebuild a frame of a display log instead of running a ROM
+	if (config.replay_png) {
+		const bool ok = replay_display_log(config);
+		free(config.thumb_frames);
+		free(config.roms);
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 
-	// Seed the random number generator
-	srand(time(NULL));
+	// Batch thumbnails of a ROM directory instead of running a ROM
+	if (config.thumbs_out) {
+		const bool ok = thumbs_run(config);
+		free(config.thumb_frames);
+		free(config.roms);
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 
-	// main emulator loop
-	while (chip8.state != QUIT) {
-		// Handle user input
-		handle_input(&chip8);
-		if (chip8.state == PAUSED)
-			continue;
+	// Host sessions for clients on a socket instead of running a ROM
+	if (config.serve) {
+		const bool ok = daemon_run(config);
+		free(config.roms);
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 
-		// Get_time(); before running instruction
-		const uint64_t start_frame_time = SDL_GetPerformanceCounter();
+	// Benchmark batched RL environments on the ROM
+	if (config.envs) {
+		const bool ok = env_bench(config);
+		free(config.roms);
+		exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 
-		// emulate CHIP8 Instructions for this emulator frame (60hz)
-		for (uint32_t i = 0; i < config.insts_per_second / 60; i++)
-			emulate_instruction(&chip8, config);
+	// Machines after the first run on one worker per core, unless told
+	// otherwise, and never more workers than machines
+	if (config.jobs == 0) {
+		const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		config.jobs = cores > 0 ? (uint32_t)cores : 1;
+	}
+	if (config.jobs >= config.instances)
+		config.jobs = config.instances > 1 ? config.instances - 1 : 1;
+
+	// Init chip8 machines, one per ROM unless more instances are asked for.
+	// Each ROM is read once; its instances are copies of the boot image,
+	// laid out one after another in huge page backed memory, as are the
+	// ram pages they copy on write, from an arena per worker.
+	arena_t machine_arena;
+	arena_t *page_arenas = calloc(config.jobs, sizeof *page_arenas);
+	if (!page_arenas ||
+			!arena_init(&machine_arena, sizeof(chip8_t), config.hugepages))
+		exit(EXIT_FAILURE);
+	for (uint32_t i = 0; i < config.jobs; i++)
+		if (!arena_init(&page_arenas[i], RAM_PAGE_SIZE, config.hugepages))
+			exit(EXIT_FAILURE);
+	chip8_t *machines = arena_alloc_run(&machine_arena, config.instances);
+	boot_image_t *images = calloc(config.rom_count, sizeof *images);
+	if (!machines || !images)
+		exit(EXIT_FAILURE);
+	for (uint32_t i = 0; i < config.rom_count; i++)
+		if (!boot_image_load(&images[i], config.roms[i]))
+			exit(EXIT_FAILURE);
+	for (uint32_t i = 0; i < config.instances; i++) {
+		boot_image_spawn(&images[i % config.rom_count], &machines[i],
+										chip8_seed(config.seed, i));
+		machines[i].page_arena = &page_arenas[0];
+	}
 
-		// Get_time() elapsed since last get_time(); elapsed time after instruction
-		const uint64_t end_frame_time = SDL_GetPerformanceCounter();
+	// Start video capture and state export, if any
+	outputs_t outputs;
+	if (!open_outputs(&outputs, config))
+		exit(EXIT_FAILURE);
 
-		const double time_elapsed =
-				(double)((end_frame_time - start_frame_time) * 1000) /
-				SDL_GetPerformanceFrequency();
-		// delay for approximately 60hz/60fps (16.67ms)
-		SDL_Delay(16.67f > time_elapsed ? 16.67f - time_elapsed : 0);
-		// update window with changes
-		update_screen(sdl, config, chip8);
-		// update delay and sound timers (60hz)
-		update_timers(sdl, &chip8);
+	bool ok = run(machines, config, &outputs, backend_find(config.backend),
+								page_arenas);
+	if (config.instances > 1) {
+		arena_report("machines", &machine_arena, 1);
+		arena_report("pages", page_arenas, config.jobs);
 	}
 
 	// Final cleanup
-	final_cleanup(sdl);
-
-	exit(EXIT_SUCCESS);
+	if (!close_outputs(&outputs, config))
+		ok = false;
+
+	for (uint32_t i = 0; i < config.instances; i++)
+		release_chip8(&machines[i]);
+	arena_destroy(&machine_arena);
+	for (uint32_t i = 0; i < config.jobs; i++)
+		arena_destroy(&page_arenas[i]);
+	free(page_arenas);
+	free(images);
+	free(config.roms);
+	exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
 }
+#endif
@@ -0,0 +1,180 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// What emulation does while the window can't be seen. Drawing always stops.
+typedef enum {
+	HIDDEN_RUN,			 // Keep emulating in real time
+	HIDDEN_THROTTLE, // Same emulated speed, but woken in batches of frames
+	HIDDEN_PAUSE,		 // Stop until the window is visible again
+} hidden_policy_t;
+
+typedef struct {
+	uint32_t window_height;		 // SDL Window height
+	uint32_t window_width;		 // SDL Window width
+	uint32_t fg_color;				 // Foreground color RGBA8888
+	uint32_t bg_color;				 // background color RGBA8888
+	uint32_t scale_factor;		 // Amount to scale a CHIP8 pixels
+	bool pixel_outline;				 // Outinline effect for pixels
+	bool scanlines;						 // Dim every other line of the window
+	uint32_t persistence;			 // % of brightness a pixel keeps per frame
+	bool no_vsync;						 // Present once per emulated frame instead
+	hidden_policy_t when_hidden;
+	const char *renderer;			 // SDL render driver, "probe" or NULL for cached
+	const char **roms;				 // ROM from argv[1], then any --tile ROMs
+	uint32_t rom_count;
+	uint32_t instances;				 // Machines to run, cycling through the ROMs
+	uint32_t tile_columns;		 // Grid width when tiled, 0 for about square
+	uint32_t insts_per_second; // CHIP8 CPU "clock rate" or hz
+	uint32_t square_wave_freq; //  Frequency of square wave sound eg. 440hz for
+														 //  middle A
+	uint32_t audio_sample_rate;
+	int16_t volume;						 // How loud the sound
+	uint32_t audio_latency_ms; // Target lead of emulation over audio playback
+	const char *backend;			 // Name of the display/input/audio backend
+	uint32_t max_frames;			 // Quit after this many frames, 0 to run forever
+	const char *audio_out;		 // .wav or raw PCM capture of headless audio
+	bool seed_set;						 // Use a fixed seed so runs are reproducible
+	uint32_t seed;
+	const char *capture_out;	 // .y4m, .gif or raw RGB24 recording of display
+	uint32_t capture_scale;		 // Integer upscale of recorded frames
+	bool shm_export;					 // Publish machine state to shared memory
+	const char *shm_name;			 // Shared memory object, NULL for /chip8-<pid>
+	uint16_t vnc_port;				 // Serve the display over VNC, 0 for off
+	const char *vnc_bind;			 // Address the VNC server listens on
+	uint32_t vnc_scale;				 // Integer upscale of the VNC framebuffer
+	bool term_braille;				 // Braille cells instead of half blocks
+	const char *thumbs_out;		 // Thumbnails of every ROM in the argv[1] dir
+	uint32_t *thumb_frames;		 // Frames to capture, ascending
+	uint32_t thumb_frame_count;
+	bool thumb_atlas;					 // One sprite sheet and index, not a PNG each
+	const char *thumb_input;	 // Scripted keypad input for the thumbnail runs
+	uint32_t jobs;						 // Worker threads, 0 for one per core
+	const char *display_log;	 // Record display commands, not frames
+	uint32_t keyframe_interval; // Frames between display log keyframes
+	const char *replay_png;		 // Rebuild a frame of the argv[1] log to a PNG
+	uint32_t replay_frame;
+	uint32_t memo_mb;					 // Frame memoisation cache size, 0 for off
+	bool hugepages;						 // Host machines in huge page backed arenas
+	bool serve;								 // Run as a daemon on the socket in roms[0]
+	uint32_t sessions;				 // Machines the daemon hosts
+	uint32_t envs;						 // Benchmark this many RL environments
+	uint32_t env_steps;
+	uint32_t frameskip;				 // Frames per environment step
+	bool env_pixels;					 // Pixel observations, not packed rows
+	uint32_t downsample;
+	uint32_t frame_stack;
+	const char *reward;				 // Watch expressions, see watch.h
+	const char *terminal;
+	uint32_t episode_frames;	 // Truncate episodes, 0 for no limit
+} config_t;
+
+typedef enum {
+	QUIT,
+	RUNNING,
+	PAUSED,
+} emulator_state_t;
+
+typedef struct {
+	uint16_t opcode;
+	uint16_t NNN; // 12 bit address/constand
+	uint8_t NN;		// 8 bit constant
+	uint8_t N;		// 4 bit constant
+	uint8_t X;		// 4 bit register identifier
+	uint8_t Y;		// 4 bit register identifier
+} instruction_t;
+
+// Ram is mapped in pages so machines spawned from one boot image share the
+// font and ROM. A page is copied the first time FX33 or FX55 writes to it,
+// so a machine typically owns none or one of them.
+#define RAM_SIZE 4096
+#define RAM_PAGE_SIZE 256
+#define RAM_PAGES (RAM_SIZE / RAM_PAGE_SIZE)
+#define ROM_ENTRY 0x200 // CHIP8 Roms will be loaded to 0x200
+#define ROM_MAX_SIZE (RAM_SIZE - ROM_ENTRY)
+
+// Everything a typical instruction reads or writes, in one cache line. It
+// holds no pointers, so saving or restoring registers is a plain copy.
+typedef struct {
+	uint8_t V[16];			 // V0-VF Data registers
+	uint16_t I;					 // Index register
+	uint16_t PC;				 // Program Counter
+	uint8_t delay_timer; // Decrease at 60hz per second when > 0
+	uint8_t sound_timer; // Decrease at 60hz per second and play tone when > 0
+	uint8_t sp;					 // Subroutine stack depth, the next free slot
+	uint16_t stack[16];	 // Subroutine stack
+} chip8_regs_t;
+
+_Static_assert(sizeof(chip8_regs_t) <= 64, "registers fit in a cache line");
+
+typedef struct {
+	chip8_regs_t regs;
+
+	// Read by fetches and draws
+	uint8_t *ram[RAM_PAGES]; // By page; the boot image's until first written
+	uint64_t display[32];		 // CHIP8 64x32 pixels, a row per word, bit 63 is x=0
+	uint32_t dirty_rows;		 // Rows drawn to this frame, bit y = row y
+	bool keypad[16];				 // Hexadecimal keypad
+
+	// Cold: touched on ram writes or a few times a frame at most
+	uint16_t own_pages;		 // Pages copied on write, bit p = ram[p]
+	uint64_t ram_hash;		 // Sum of ram_mix() over all of ram, kept up by writes
+	arena_t *page_arena;	 // Where copied pages come from, NULL for malloc
+	emulator_state_t state;
+	const char *rom_name; // Currently running ROM
+	uint64_t rng;					// CXNN's xorshift64 state, never 0
+} chip8_t;
+
+// Hash of one ram byte at its address. Summed over ram, so a write only
+// has to swap the old byte's term for the new one's.
+static inline uint64_t ram_mix(uint16_t addr, uint8_t value) {
+	uint64_t z = ((uint64_t)addr << 8 | value) + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// Addresses wrap at the end of ram
+static inline uint8_t read_ram(const chip8_t *chip8, uint16_t addr) {
+	addr &= RAM_SIZE - 1;
+	return chip8->ram[addr / RAM_PAGE_SIZE][addr % RAM_PAGE_SIZE];
+}
+
+void store_ram(chip8_t *chip8, uint16_t addr, uint8_t value);
+void copy_ram(const chip8_t *chip8, uint8_t out[RAM_SIZE]);
+
+// A machine as it is at power on: font and ROM in ram, PC at the entry
+// point. Built once per ROM, so starting or resetting a machine is a copy
+// with no file I/O. Its ram backs every spawned machine's unwritten pages,
+// so the image must outlive them and stay where it is.
+typedef struct {
+	chip8_t machine;
+	uint8_t ram[RAM_SIZE];
+} boot_image_t;
+
+bool boot_image_load(boot_image_t *image, const char rom_name[]);
+// Same from a ROM already in memory. `rom_name` is kept, not copied.
+bool boot_image_from_rom(boot_image_t *image, const char rom_name[],
+												 const uint8_t *rom, size_t rom_size);
+// Start a new machine, or one that has been released. Machines spawned
+// with the same seed draw the same CXNN numbers, whichever worker runs them.
+void boot_image_spawn(const boot_image_t *image, chip8_t *chip8,
+											uint64_t seed);
+// Release and spawn again
+void boot_image_reset(const boot_image_t *image, chip8_t *chip8,
+											uint64_t seed);
+// Seed of machine `index` of a run seeded with `seed`
+static inline uint64_t chip8_seed(uint32_t seed, uint32_t index) {
+	return (uint64_t)seed << 32 | index;
+}
+// Free the pages the machine copied on write
+void release_chip8(chip8_t *chip8);
+void emulate_instruction(chip8_t *chip8, const config_t config);
+// Defaults overridden by the command line. Reports what is wrong on stderr.
+bool set_config_from_args(config_t *config, const int argc, char **argv);
+
+#endif
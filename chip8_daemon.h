@@ -0,0 +1,108 @@
+#ifndef CHIP8_DAEMON_H
+#define CHIP8_DAEMON_H
+
+// Control protocol of the emulator daemon (chip8 <socket> --serve).
+//
+// Messages for clients; include this header on its own, it has no
+// dependency on the emulator. The daemon hosts a fixed number of sessions,
+// each a machine, and listens on a Unix domain stream socket. As the
+// socket never leaves the host, everything is in host byte order.
+//
+// On connecting, a client reads a chip8_daemon_hello_t. From then on each
+// round trip is a batch: the client sends a chip8_daemon_batch_t and
+// `count` commands, each a chip8_daemon_cmd_t followed by `length` payload
+// bytes, and reads back a chip8_daemon_batch_t and one chip8_daemon_reply_t
+// per command, in order.
+//
+// Framebuffers and machine state never go through the socket. The daemon
+// publishes them into the session's slot of the shared memory object named
+// in the hello, an array of chip8_shm_t (see chip8_shm.h), and the client
+// reads them from there once the reply is in:
+//
+//   const chip8_shm_t *slots =
+//       mmap(NULL, hello.sessions * sizeof *slots, PROT_READ, MAP_SHARED,
+//            shm_open(hello.shm_name, O_RDONLY, 0), 0);
+//   chip8_shm_t snapshot;
+//   chip8_shm_read(&slots[session], &snapshot);
+//
+// chip8_daemon.py is a client for Python.
+
+#include <stdint.h>
+
+#define CHIP8_DAEMON_MAGIC 0x44385043u // "CP8D" little endian
+#define CHIP8_DAEMON_VERSION 1
+#define CHIP8_DAEMON_NEW UINT32_MAX		 // LOAD into any free session
+#define CHIP8_DAEMON_MAX_BATCH 65536	 // Commands in one batch
+#define CHIP8_DAEMON_MAX_PAYLOAD 3584	 // A ROM filling ram from 0x200
+#define CHIP8_DAEMON_MAX_STEP 3600		 // Frames in one step, a minute
+// Frames all the steps in one batch may add up to, so that no client
+// holds up the others for long
+#define CHIP8_DAEMON_MAX_BATCH_FRAMES (1u << 20)
+
+typedef enum {
+	// Payload: ROM bytes. Loads into `session`, replacing whatever ran
+	// there, or into a free session with CHIP8_DAEMON_NEW. Value: the
+	// session.
+	CHIP8_OP_LOAD = 1,
+	CHIP8_OP_RESET = 2, // Restart the session's ROM
+	CHIP8_OP_CLOSE = 3, // Free the session
+	// Run `arg` frames, at most CHIP8_DAEMON_MAX_STEP. Steps are carried
+	// out together, on every worker, when the batch reaches a command other
+	// than a step or its end. Value: frames the session will have run.
+	CHIP8_OP_STEP = 4,
+	CHIP8_OP_KEYS = 5, // `arg`: keys down, bit k = key k
+	// Publish the frame count and display into the session's slot. Value:
+	// the frame count.
+	CHIP8_OP_DISPLAY = 6,
+	// Publish everything into the session's slot: display, registers,
+	// timers, keypad and ram. Value: the frame count.
+	CHIP8_OP_SNAPSHOT = 7,
+	CHIP8_OP_SHUTDOWN = 8, // Stop the daemon after this batch
+} chip8_daemon_op_t;
+
+typedef enum {
+	CHIP8_STATUS_OK = 0,
+	CHIP8_STATUS_BAD_OP = 1,
+	CHIP8_STATUS_BAD_SESSION = 2, // Out of range, or not loaded
+	CHIP8_STATUS_BAD_ROM = 3,			// Empty, or over CHIP8_DAEMON_MAX_PAYLOAD
+	CHIP8_STATUS_FULL = 4,				// No free session for CHIP8_DAEMON_NEW
+	// Over CHIP8_DAEMON_MAX_STEP, or the batch's steps over
+	// CHIP8_DAEMON_MAX_BATCH_FRAMES; nothing is run
+	CHIP8_STATUS_TOO_LONG = 5,
+} chip8_daemon_status_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sessions; // Sessions, and slots in the shared memory object
+	uint32_t reserved;
+	char shm_name[64]; // NUL terminated
+} chip8_daemon_hello_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t count; // Commands or replies that follow
+} chip8_daemon_batch_t;
+
+typedef struct {
+	uint8_t op; // chip8_daemon_op_t
+	uint8_t reserved[3];
+	uint32_t session;
+	uint32_t arg;
+	uint32_t length; // Payload bytes that follow
+} chip8_daemon_cmd_t;
+
+typedef struct {
+	uint8_t op;
+	uint8_t status; // chip8_daemon_status_t
+	uint16_t reserved;
+	uint32_t session;
+	uint64_t value;
+} chip8_daemon_reply_t;
+
+_Static_assert(sizeof(chip8_daemon_hello_t) == 80, "daemon layout");
+_Static_assert(sizeof(chip8_daemon_batch_t) == 8, "daemon layout");
+_Static_assert(sizeof(chip8_daemon_cmd_t) == 16, "daemon layout");
+_Static_assert(sizeof(chip8_daemon_reply_t) == 16, "daemon layout");
+
+#endif
@@ -0,0 +1,186 @@
+"""Client for the CHIP8 emulator daemon.
+
+Start the daemon with `chip8 /tmp/chip8.sock --serve [--sessions <n>]`, then:
+
+    from chip8_daemon import Chip8Daemon
+    with Chip8Daemon("/tmp/chip8.sock") as daemon:
+        session = daemon.batch().load(open("pong.ch8", "rb").read()).run()[0].value
+        daemon.batch().keys(session, 1 << 5).step(session, 60).display(session).run()
+        print(daemon.read(session).rows())
+
+Each batch is one round trip however many commands it holds; steps in a
+batch run together on all the daemon's workers. Displays and snapshots come
+back through shared memory, read with Chip8Shm. Protocol and layouts match
+chip8_daemon.h.
+"""
+
+import socket
+import struct
+import sys
+from collections import namedtuple
+
+from chip8_shm import Chip8Shm
+
+MAGIC = 0x44385043
+VERSION = 1
+NEW = 0xFFFFFFFF
+
+OP_LOAD = 1
+OP_RESET = 2
+OP_CLOSE = 3
+OP_STEP = 4
+OP_KEYS = 5
+OP_DISPLAY = 6
+OP_SNAPSHOT = 7
+OP_SHUTDOWN = 8
+
+STATUS_OK = 0
+STATUS_BAD_OP = 1
+STATUS_BAD_SESSION = 2
+STATUS_BAD_ROM = 3
+STATUS_FULL = 4
+STATUS_TOO_LONG = 5
+
+MAX_STEP = 3600
+MAX_BATCH_FRAMES = 1 << 20
+
+_ENDIAN = "<" if sys.byteorder == "little" else ">"
+_HELLO = struct.Struct(_ENDIAN + "IIII 64s")
+_BATCH = struct.Struct(_ENDIAN + "II")
+_CMD = struct.Struct(_ENDIAN + "B3x III")
+_REPLY = struct.Struct(_ENDIAN + "BB2x I Q")
+
+Reply = namedtuple("Reply", "op status session value")
+
+
+class DaemonError(Exception):
+    pass
+
+
+class Batch:
+    """Commands sent together by run(), which returns one Reply each."""
+
+    def __init__(self, daemon):
+        self._daemon = daemon
+        self._parts = []
+        self._count = 0
+
+    def _add(self, op, session=0, arg=0, payload=b""):
+        self._parts.append(_CMD.pack(op, session, arg, len(payload)))
+        self._parts.append(payload)
+        self._count += 1
+        return self
+
+    def load(self, rom, session=NEW):
+        return self._add(OP_LOAD, session, payload=bytes(rom))
+
+    def reset(self, session):
+        return self._add(OP_RESET, session)
+
+    def close(self, session):
+        return self._add(OP_CLOSE, session)
+
+    def step(self, session, frames=1):
+        return self._add(OP_STEP, session, frames)
+
+    def keys(self, session, mask):
+        return self._add(OP_KEYS, session, mask)
+
+    def display(self, session):
+        return self._add(OP_DISPLAY, session)
+
+    def snapshot(self, session):
+        return self._add(OP_SNAPSHOT, session)
+
+    def shutdown(self):
+        return self._add(OP_SHUTDOWN)
+
+    def run(self, check=True):
+        replies = self._daemon._round_trip(self._count, b"".join(self._parts))
+        if check:
+            for reply in replies:
+                if reply.status != STATUS_OK:
+                    raise DaemonError("op %d on session %d failed with status %d"
+                                      % (reply.op, reply.session, reply.status))
+        return replies
+
+
+class Chip8Daemon:
+    def __init__(self, path):
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._sock.connect(path)
+        magic, version, self.sessions, _, name = _HELLO.unpack(
+            self._recv(_HELLO.size))
+        if magic != MAGIC or version != VERSION:
+            self._sock.close()
+            raise DaemonError("not a CHIP8 daemon: %s" % path)
+        self.shm_name = name.split(b"\0", 1)[0].decode()
+        self._slots = {}
+
+    def _recv(self, size):
+        data = bytearray()
+        while len(data) < size:
+            chunk = self._sock.recv(size - len(data))
+            if not chunk:
+                raise DaemonError("daemon hung up")
+            data += chunk
+        return bytes(data)
+
+    def _round_trip(self, count, commands):
+        self._sock.sendall(_BATCH.pack(MAGIC, count) + commands)
+        magic, got = _BATCH.unpack(self._recv(_BATCH.size))
+        if magic != MAGIC:
+            raise DaemonError("bad reply")
+        data = self._recv(got * _REPLY.size)
+        replies = [Reply(*r) for r in _REPLY.iter_unpack(data)]
+        if got != count:
+            raise DaemonError("daemon dropped the batch after %d commands" % got)
+        return replies
+
+    def batch(self):
+        return Batch(self)
+
+    def read(self, session):
+        """Last display or snapshot published for the session."""
+        if session not in self._slots:
+            self._slots[session] = Chip8Shm(self.shm_name, session)
+        return self._slots[session].read()
+
+    def close(self):
+        for slot in self._slots.values():
+            slot.close()
+        self._slots = {}
+        self._sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        sys.exit("usage: %s <socket> <rom> [sessions] [frames]" % sys.argv[0])
+    count = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+    frames = int(sys.argv[4]) if len(sys.argv) > 4 else 60
+    with open(sys.argv[2], "rb") as f:
+        rom = f.read()
+    with Chip8Daemon(sys.argv[1]) as daemon:
+        batch = daemon.batch()
+        for _ in range(count):
+            batch.load(rom)
+        sessions = [reply.value for reply in batch.run()]
+        batch = daemon.batch()
+        for session in sessions:
+            batch.step(session, frames)
+        batch.snapshot(sessions[0]).run()
+        snap = daemon.read(sessions[0])
+        print("%d sessions, frame %d PC 0x%04X I 0x%04X"
+              % (len(sessions), snap.frame, snap.PC, snap.I))
+        for row in snap.rows():
+            print("".join("#" if p else "." for p in row))
+        batch = daemon.batch()
+        for session in sessions:
+            batch.close(session)
+        batch.run()
@@ -0,0 +1,71 @@
+#ifndef CHIP8_SHM_H
+#define CHIP8_SHM_H
+
+// Shared memory export of a running emulator's machine state.
+//
+// Layout and reader for external tools; include this header on its own, it
+// has no dependency on the emulator. The emulator creates a POSIX shared
+// memory object (default name "/chip8-<pid>") holding one chip8_shm_t and
+// republishes it every frame. Readers map it read-only and take consistent
+// snapshots without syscalls or locks using the seqlock in `seq`:
+//
+//   int fd = shm_open("/chip8-1234", O_RDONLY, 0);
+//   const chip8_shm_t *shm =
+//       mmap(NULL, sizeof *shm, PROT_READ, MAP_SHARED, fd, 0);
+//   chip8_shm_t snapshot;
+//   chip8_shm_read(shm, &snapshot);
+//
+// chip8_shm.py is the equivalent reader for Python.
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CHIP8_SHM_MAGIC 0x38504843u // "CHP8" little endian
+#define CHIP8_SHM_VERSION 1
+
+// Every field is naturally aligned so there is no padding; offsets are part
+// of the format (see chip8_shm.py)
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	_Atomic uint32_t seq; // Odd while the emulator is writing
+	uint32_t reserved;
+	uint64_t frame;				// Emulated frames since start
+	uint64_t display[32]; // Host endian rows, bit 63 is x=0
+	uint16_t I;
+	uint16_t PC;
+	uint16_t stack[16];
+	uint8_t stack_index; // Entries in use on the stack
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint8_t state; // 0 quit, 1 running, 2 paused
+	uint8_t V[16];
+	uint8_t keypad[16]; // 1 if held
+	uint8_t ram[4096];
+} chip8_shm_t;
+
+_Static_assert(offsetof(chip8_shm_t, display) == 24, "shm layout");
+_Static_assert(offsetof(chip8_shm_t, V) == 320, "shm layout");
+_Static_assert(offsetof(chip8_shm_t, ram) == 352, "shm layout");
+_Static_assert(sizeof(chip8_shm_t) == 4448, "shm layout");
+
+// Copy a consistent snapshot of `shm` into `out`. Retries while the
+// emulator is mid-publish, which only happens for the ~100ns of a copy.
+static inline void chip8_shm_read(const chip8_shm_t *shm, chip8_shm_t *out) {
+	for (;;) {
+		const uint32_t seq1 = atomic_load_explicit(
+				(_Atomic uint32_t *)&shm->seq, memory_order_acquire);
+		if (seq1 & 1)
+			continue;
+		memcpy(out, (const void *)shm, sizeof *out);
+		atomic_thread_fence(memory_order_acquire);
+		const uint32_t seq2 = atomic_load_explicit(
+				(_Atomic uint32_t *)&shm->seq, memory_order_relaxed);
+		if (seq1 == seq2)
+			return;
+	}
+}
+
+#endif
@@ -0,0 +1,119 @@
+"""Reader for the CHIP8 emulator's shared memory state export.
+
+Start the emulator with --shm (or --shm-name <name>), then:
+
+    from chip8_shm import Chip8Shm
+    with Chip8Shm("/chip8-1234") as shm:
+        snap = shm.read()
+        print(snap.frame, snap.PC, snap.pixel(0, 0))
+
+An export with a slot per machine (the daemon's, see chip8_daemon.py) is
+read one slot at a time: Chip8Shm(name, slot=3).
+
+Layout matches chip8_shm_t in chip8_shm.h. Snapshots are consistent: the
+reader retries while the emulator is mid-publish (seqlock), and never
+blocks it.
+"""
+
+import struct
+import sys
+from collections import namedtuple
+from multiprocessing import shared_memory
+
+MAGIC = 0x38504843
+VERSION = 1
+SIZE = 4448
+
+_ENDIAN = "<" if sys.byteorder == "little" else ">"
+_HEADER = struct.Struct(_ENDIAN + "IIII Q")
+_DISPLAY = struct.Struct(_ENDIAN + "32Q")
+_REGS = struct.Struct(_ENDIAN + "HH16H BBBB")
+_SEQ_OFFSET = 8
+_DISPLAY_OFFSET = 24
+_REGS_OFFSET = 280
+_V_OFFSET = 320
+_KEYPAD_OFFSET = 336
+_RAM_OFFSET = 352
+
+
+class Snapshot(namedtuple("Snapshot", "frame display I PC stack stack_index "
+                                      "delay_timer sound_timer state V keypad ram")):
+    """One consistent copy of the machine state."""
+
+    def pixel(self, x, y):
+        return (self.display[y] >> (63 - x)) & 1
+
+    def rows(self):
+        """Display as 32 lists of 64 ints (0 or 1)."""
+        return [[(row >> (63 - x)) & 1 for x in range(64)] for row in self.display]
+
+
+class Chip8Shm:
+    def __init__(self, name, slot=0):
+        # SharedMemory wants the name without the leading slash
+        self._shm = shared_memory.SharedMemory(name=name.lstrip("/"))
+        try:
+            # Don't let Python's resource tracker unlink the emulator's segment
+            from multiprocessing import resource_tracker
+            resource_tracker.unregister(self._shm._name, "shared_memory")
+        except Exception:
+            pass
+        self._buf = None
+        offset = slot * SIZE
+        if slot < 0 or offset + SIZE > self._shm.size:
+            self.close()
+            raise ValueError("no slot %d in %s" % (slot, name))
+        self._buf = self._shm.buf[offset:offset + SIZE]
+        magic, version, _, _, _ = _HEADER.unpack_from(self._buf, 0)
+        if magic != MAGIC or version != VERSION:
+            self.close()
+            raise ValueError("not a CHIP8 shared memory export: %s" % name)
+
+    def _seq(self):
+        return struct.unpack_from(_ENDIAN + "I", self._buf, _SEQ_OFFSET)[0]
+
+    def read(self):
+        while True:
+            seq1 = self._seq()
+            if seq1 & 1:
+                continue
+            data = bytes(self._buf[:SIZE])
+            if self._seq() == seq1:
+                break
+        frame = _HEADER.unpack_from(data, 0)[4]
+        display = _DISPLAY.unpack_from(data, _DISPLAY_OFFSET)
+        regs = _REGS.unpack_from(data, _REGS_OFFSET)
+        return Snapshot(
+            frame=frame,
+            display=display,
+            I=regs[0],
+            PC=regs[1],
+            stack=regs[2:18],
+            stack_index=regs[18],
+            delay_timer=regs[19],
+            sound_timer=regs[20],
+            state=regs[21],
+            V=data[_V_OFFSET:_V_OFFSET + 16],
+            keypad=data[_KEYPAD_OFFSET:_KEYPAD_OFFSET + 16],
+            ram=data[_RAM_OFFSET:_RAM_OFFSET + 4096],
+        )
+
+    def close(self):
+        if self._buf is not None:
+            self._buf.release()
+        self._buf = None
+        self._shm.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+if __name__ == "__main__":
+    with Chip8Shm(sys.argv[1]) as shm:
+        snap = shm.read()
+        print("frame %d PC 0x%04X I 0x%04X" % (snap.frame, snap.PC, snap.I))
+        for row in snap.rows():
+            print("".join("#" if p else "." for p in row))
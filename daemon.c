@@ -0,0 +1,457 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: SO_NOSIGPIPE is set per socket instead
+#endif
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int signal) {
+	(void)signal;
+	stop = 1;
+}
+
+static bool send_all(int fd, const void *data, size_t len) {
+	const uint8_t *bytes = data;
+	while (len > 0) {
+		const ssize_t n = send(fd, bytes, len, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		bytes += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool recv_all(int fd, void *data, size_t len) {
+	uint8_t *bytes = data;
+	while (len > 0) {
+		const ssize_t n = recv(fd, bytes, len, 0);
+		if (n <= 0)
+			return false;
+		bytes += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Read a command's payload, throwing away one too big to be a ROM
+static bool recv_payload(int fd, uint8_t payload[CHIP8_DAEMON_MAX_PAYLOAD],
+												 uint32_t len) {
+	if (len <= CHIP8_DAEMON_MAX_PAYLOAD)
+		return recv_all(fd, payload, len);
+	while (len > 0) {
+		const uint32_t n =
+				len < CHIP8_DAEMON_MAX_PAYLOAD ? len : CHIP8_DAEMON_MAX_PAYLOAD;
+		if (!recv_all(fd, payload, n))
+			return false;
+		len -= n;
+	}
+	return true;
+}
+
+// FNV-1a
+static uint64_t rom_hash(const uint8_t *rom, uint32_t size) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (uint32_t i = 0; i < size; i++)
+		hash = (hash ^ rom[i]) * 0x100000001B3ULL;
+	return hash;
+}
+
+// Boot image for the ROM, the one already loaded if any session runs the
+// same bytes
+static daemon_rom_t *use_rom(daemon_t *daemon, const uint8_t *rom,
+														 uint32_t size) {
+	const uint64_t hash = rom_hash(rom, size);
+	uint32_t free_slot = daemon->rom_count;
+	for (uint32_t i = 0; i < daemon->rom_count; i++) {
+		daemon_rom_t *loaded = daemon->roms[i];
+		if (!loaded) {
+			free_slot = i;
+			continue;
+		}
+		if (loaded->hash == hash && loaded->size == size &&
+				memcmp(&loaded->image.ram[ROM_ENTRY], rom, size) == 0) {
+			loaded->users++;
+			return loaded;
+		}
+	}
+
+	if (free_slot == daemon->rom_count) {
+		daemon_rom_t **roms =
+				realloc(daemon->roms, (daemon->rom_count + 1) * sizeof *roms);
+		if (!roms)
+			return NULL;
+		daemon->roms = roms;
+		daemon->roms[daemon->rom_count++] = NULL;
+	}
+	daemon_rom_t *loaded = malloc(sizeof *loaded);
+	if (!loaded)
+		return NULL;
+	loaded->hash = hash;
+	loaded->size = size;
+	loaded->users = 1;
+	snprintf(loaded->name, sizeof loaded->name, "rom-%016" PRIx64, hash);
+	boot_image_from_rom(&loaded->image, loaded->name, rom, size);
+	daemon->roms[free_slot] = loaded;
+	return loaded;
+}
+
+// Once no session runs it, nothing points into its image any more
+static void drop_rom(daemon_t *daemon, daemon_rom_t *rom) {
+	if (--rom->users > 0)
+		return;
+	for (uint32_t i = 0; i < daemon->rom_count; i++)
+		if (daemon->roms[i] == rom)
+			daemon->roms[i] = NULL;
+	free(rom);
+}
+
+// Run the steps given out so far, every session at once
+static void run_steps(daemon_t *daemon) {
+	if (!daemon->stepping)
+		return;
+	while (sched_frame(daemon->sched) > 0)
+		;
+	daemon->stepping = false;
+}
+
+static chip8_daemon_status_t load(daemon_t *daemon, uint32_t *session,
+																	const uint8_t *rom, uint32_t size) {
+	if (size == 0 || size > ROM_MAX_SIZE)
+		return CHIP8_STATUS_BAD_ROM;
+	if (*session == CHIP8_DAEMON_NEW) {
+		for (*session = 0; *session < daemon->config.sessions; (*session)++)
+			if (!daemon->sessions[*session].rom)
+				break;
+		if (*session == daemon->config.sessions)
+			return CHIP8_STATUS_FULL;
+	} else if (*session >= daemon->config.sessions) {
+		return CHIP8_STATUS_BAD_SESSION;
+	}
+	daemon_session_t *running = &daemon->sessions[*session];
+	daemon_rom_t *loaded = use_rom(daemon, rom, size);
+	if (!loaded)
+		return CHIP8_STATUS_FULL;
+	sched_spawn(daemon->sched, &daemon->sched->tasks[*session], &loaded->image,
+							chip8_seed(daemon->config.seed, *session));
+	if (running->rom)
+		drop_rom(daemon, running->rom);
+	*running = (daemon_session_t){.rom = loaded};
+	return CHIP8_STATUS_OK;
+}
+
+// Carry out one command. Anything but a step first runs the steps before
+// it, so it sees their results.
+static void handle(daemon_t *daemon, const chip8_daemon_cmd_t *cmd,
+									 const uint8_t *payload, chip8_daemon_reply_t *reply) {
+	*reply = (chip8_daemon_reply_t){.op = cmd->op, .session = cmd->session};
+	if (cmd->op != CHIP8_OP_STEP)
+		run_steps(daemon);
+	if (cmd->op == CHIP8_OP_LOAD) {
+		uint32_t session = cmd->session;
+		reply->status = load(daemon, &session, payload, cmd->length);
+		if (reply->status == CHIP8_STATUS_OK)
+			reply->session = reply->value = session;
+		return;
+	}
+	if (cmd->op == CHIP8_OP_SHUTDOWN) {
+		daemon->quit = true;
+		return;
+	}
+	if (cmd->session >= daemon->config.sessions ||
+			!daemon->sessions[cmd->session].rom) {
+		reply->status = CHIP8_STATUS_BAD_SESSION;
+		return;
+	}
+
+	daemon_session_t *session = &daemon->sessions[cmd->session];
+	sched_task_t *task = &daemon->sched->tasks[cmd->session];
+	chip8_shm_t *slot = &daemon->shm.shm[cmd->session];
+	switch (cmd->op) {
+	case CHIP8_OP_RESET:
+		sched_spawn(daemon->sched, task, &session->rom->image,
+								chip8_seed(daemon->config.seed, cmd->session));
+		session->frames = 0;
+		break;
+	case CHIP8_OP_CLOSE:
+		release_chip8(task->chip8);
+		drop_rom(daemon, session->rom);
+		*session = (daemon_session_t){0};
+		break;
+	case CHIP8_OP_STEP:
+		if (cmd->arg > CHIP8_DAEMON_MAX_STEP ||
+				cmd->arg > CHIP8_DAEMON_MAX_BATCH_FRAMES - daemon->batch_frames) {
+			reply->status = CHIP8_STATUS_TOO_LONG;
+			break;
+		}
+		daemon->batch_frames += cmd->arg;
+		session->frames += sched_step(daemon->sched, task, cmd->arg);
+		reply->value = session->frames;
+		daemon->stepping = true;
+		break;
+	case CHIP8_OP_KEYS: {
+		bool keys[16];
+		for (int i = 0; i < 16; i++)
+			keys[i] = (cmd->arg >> i) & 1;
+		sched_set_keys(daemon->sched, task, keys);
+		break;
+	}
+	case CHIP8_OP_DISPLAY:
+	case CHIP8_OP_SNAPSHOT:
+		shm_publish(slot, task->chip8, session->frames,
+								cmd->op == CHIP8_OP_SNAPSHOT);
+		reply->value = session->frames;
+		break;
+	default:
+		reply->status = CHIP8_STATUS_BAD_OP;
+	}
+}
+
+// Read one batch from the client, carry it out and send the replies.
+// False drops the client: it hung up or broke the protocol.
+static bool serve_batch(daemon_t *daemon, int fd) {
+	chip8_daemon_batch_t batch;
+	if (!recv_all(fd, &batch, sizeof batch) ||
+			batch.magic != CHIP8_DAEMON_MAGIC ||
+			batch.count > CHIP8_DAEMON_MAX_BATCH)
+		return false;
+	if (batch.count > daemon->reply_capacity) {
+		chip8_daemon_reply_t *replies =
+				realloc(daemon->replies, batch.count * sizeof *replies);
+		if (!replies)
+			return false;
+		daemon->replies = replies;
+		daemon->reply_capacity = batch.count;
+	}
+
+	uint8_t payload[CHIP8_DAEMON_MAX_PAYLOAD];
+	bool ok = true;
+	daemon->batch_frames = 0;
+	for (uint32_t i = 0; i < batch.count; i++) {
+		chip8_daemon_cmd_t cmd;
+		if (!recv_all(fd, &cmd, sizeof cmd) ||
+				!recv_payload(fd, payload, cmd.length)) {
+			ok = false; // Still carry out what came in
+			batch.count = i;
+			break;
+		}
+		if (cmd.length > CHIP8_DAEMON_MAX_PAYLOAD) {
+			daemon->replies[i] = (chip8_daemon_reply_t){
+					.op = cmd.op,
+					.status = CHIP8_STATUS_BAD_ROM,
+					.session = cmd.session,
+			};
+			continue;
+		}
+		handle(daemon, &cmd, payload, &daemon->replies[i]);
+	}
+	run_steps(daemon);
+	return ok && send_all(fd, &batch, sizeof batch) &&
+				 send_all(fd, daemon->replies, batch.count * sizeof *daemon->replies);
+}
+
+static void accept_client(daemon_t *daemon) {
+	const int fd = accept(daemon->listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+	int *client = NULL;
+	for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+		if (daemon->clients[i] < 0)
+			client = &daemon->clients[i];
+	if (!client) {
+		close(fd);
+		return;
+	}
+
+	// A stalled client can only hold up the others this long
+	const struct timeval timeout = {.tv_sec = 2};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+#ifdef SO_NOSIGPIPE
+	const int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+
+	chip8_daemon_hello_t hello = {
+			.magic = CHIP8_DAEMON_MAGIC,
+			.version = CHIP8_DAEMON_VERSION,
+			.sessions = daemon->config.sessions,
+	};
+	snprintf(hello.shm_name, sizeof hello.shm_name, "%s", daemon->shm.name);
+	if (!send_all(fd, &hello, sizeof hello)) {
+		close(fd);
+		return;
+	}
+	*client = fd;
+}
+
+static int listen_on(const char *path) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof addr.sun_path)
+		return -1;
+	strcpy(addr.sun_path, path);
+	// A daemon that died leaves its socket behind; anything else is kept
+	struct stat st;
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+			listen(fd, DAEMON_MAX_CLIENTS) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Sessions, their shared memory slots and the workers that step them
+static bool daemon_open(daemon_t *daemon, const config_t config) {
+	*daemon = (daemon_t){.config = config, .path = config.roms[0]};
+	for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+		daemon->clients[i] = -1;
+	daemon->listen_fd = -1;
+
+	daemon->jobs = config.jobs;
+	if (daemon->jobs == 0) {
+		const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		daemon->jobs = cores > 0 ? (uint32_t)cores : 1;
+	}
+	if (daemon->jobs > config.sessions)
+		daemon->jobs = config.sessions;
+	daemon->page_arenas = calloc(daemon->jobs, sizeof *daemon->page_arenas);
+	daemon->sessions = calloc(config.sessions, sizeof *daemon->sessions);
+	if (!daemon->page_arenas || !daemon->sessions ||
+			!arena_init(&daemon->machine_arena, sizeof(chip8_t), config.hugepages))
+		return false;
+	for (uint32_t i = 0; i < daemon->jobs; i++)
+		if (!arena_init(&daemon->page_arenas[i], RAM_PAGE_SIZE, config.hugepages))
+			return false;
+	daemon->machines = arena_alloc_run(&daemon->machine_arena, config.sessions);
+	if (!daemon->machines)
+		return false;
+	if (config.memo_mb) {
+		daemon->memo = memo_create((size_t)config.memo_mb << 20);
+		if (!daemon->memo)
+			return false;
+	}
+	daemon->sched = sched_create(daemon->machines, config.sessions, config,
+															 daemon->memo, daemon->page_arenas,
+															 daemon->jobs, true);
+	if (!daemon->sched)
+		return false;
+
+	if (!shm_export_open_slots(&daemon->shm, config.shm_name,
+														 config.sessions)) {
+		fprintf(stderr, "Could not create shared memory %s\n",
+						config.shm_name ? config.shm_name : "");
+		return false;
+	}
+	daemon->listen_fd = listen_on(daemon->path);
+	if (daemon->listen_fd < 0) {
+		fprintf(stderr, "Could not listen on %s\n", daemon->path);
+		return false;
+	}
+	return true;
+}
+
+static void daemon_close(daemon_t *daemon) {
+	const bool served = daemon->listen_fd >= 0;
+	for (int i = 0; i < DAEMON_MAX_CLIENTS; i++)
+		if (daemon->clients[i] >= 0)
+			close(daemon->clients[i]);
+	if (daemon->listen_fd >= 0) {
+		close(daemon->listen_fd);
+		unlink(daemon->path);
+	}
+	if (daemon->shm.shm)
+		shm_export_close(&daemon->shm);
+	if (daemon->sched) {
+		if (served)
+			sched_report(daemon->sched);
+		sched_destroy(daemon->sched);
+	}
+	if (daemon->memo) {
+		if (served)
+			memo_report(daemon->memo);
+		memo_destroy(daemon->memo);
+	}
+	if (served && daemon->machines) {
+		arena_report("machines", &daemon->machine_arena, 1);
+		arena_report("pages", daemon->page_arenas, daemon->jobs);
+	}
+	for (uint32_t i = 0; daemon->machines && i < daemon->config.sessions; i++)
+		if (daemon->sessions[i].rom)
+			release_chip8(&daemon->machines[i]);
+	for (uint32_t i = 0; i < daemon->rom_count; i++)
+		free(daemon->roms[i]);
+	free(daemon->roms);
+	arena_destroy(&daemon->machine_arena);
+	for (uint32_t i = 0; daemon->page_arenas && i < daemon->jobs; i++)
+		arena_destroy(&daemon->page_arenas[i]);
+	free(daemon->page_arenas);
+	free(daemon->sessions);
+	free(daemon->replies);
+}
+
+bool daemon_run(const config_t config) {
+	daemon_t daemon;
+	if (!daemon_open(&daemon, config)) {
+		daemon_close(&daemon);
+		return false;
+	}
+	printf("Serving %u sessions on %s, displays in shared memory %s\n",
+				 config.sessions, daemon.path, daemon.shm.name);
+	fflush(stdout);
+
+	struct sigaction action = {.sa_handler = on_signal};
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	while (!stop && !daemon.quit) {
+		struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+		int *owners[DAEMON_MAX_CLIENTS + 1];
+		nfds_t nfds = 0;
+		fds[nfds] = (struct pollfd){.fd = daemon.listen_fd, .events = POLLIN};
+		owners[nfds++] = NULL;
+		for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+			if (daemon.clients[i] < 0)
+				continue;
+			fds[nfds] = (struct pollfd){.fd = daemon.clients[i], .events = POLLIN};
+			owners[nfds++] = &daemon.clients[i];
+		}
+		// Wake up now and then to notice signals taken by a worker thread
+		if (poll(fds, nfds, 100) <= 0)
+			continue;
+		for (nfds_t i = 0; i < nfds && !daemon.quit; i++) {
+			if (!fds[i].revents)
+				continue;
+			if (!owners[i]) {
+				accept_client(&daemon);
+			} else if (!serve_batch(&daemon, *owners[i])) {
+				close(*owners[i]);
+				*owners[i] = -1;
+			}
+		}
+	}
+
+	daemon_close(&daemon);
+	return true;
+}
@@ -0,0 +1,63 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "chip8.h"
+#include "chip8_daemon.h"
+#include "memo.h"
+#include "scheduler.h"
+#include "shm.h"
+
+#define DAEMON_MAX_CLIENTS 16
+
+// A loaded ROM's boot image, shared by every session running the same bytes
+typedef struct {
+	boot_image_t image;
+	uint64_t hash; // Of the ROM bytes
+	uint32_t size;
+	uint32_t users; // Sessions running it
+	char name[24];	// rom-<hash>, the machines' rom_name
+} daemon_rom_t;
+
+typedef struct {
+	daemon_rom_t *rom; // NULL while the session is free
+	uint64_t frames;	 // Run since loaded or reset
+} daemon_session_t;
+
+// Long-lived host for many sessions, controlled over a Unix domain socket
+// with the protocol in chip8_daemon.h. Sessions are stepped tasks on the
+// scheduler, so a batch of steps runs on every worker at once and
+// sessions blocked on a key or a timer cost nothing for those frames.
+// Clients are served one batch at a time from a single thread.
+typedef struct {
+	config_t config;
+	const char *path; // Socket
+	int listen_fd;
+	int clients[DAEMON_MAX_CLIENTS]; // -1 when the slot is free
+	shm_export_t shm;								 // One slot per session
+
+	arena_t machine_arena;
+	arena_t *page_arenas; // One per worker
+	uint32_t jobs;
+	chip8_t *machines;
+	daemon_session_t *sessions;
+	memo_t *memo; // Frame cache shared by the workers, NULL without --memo
+	sched_t *sched;
+	daemon_rom_t **roms; // Loaded, NULL entries are free
+	uint32_t rom_count;
+
+	chip8_daemon_reply_t *replies; // For the batch being served
+	uint32_t reply_capacity;
+	uint32_t batch_frames; // Steps given out in the batch, summed
+	bool stepping;				 // Steps given out and not run yet
+	bool quit;
+} daemon_t;
+
+// Serve on the socket at config.roms[0] until SIGINT, SIGTERM or a
+// SHUTDOWN command
+bool daemon_run(const config_t config);
+
+#endif
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "displog.h"
+
+#define DISPLAY_W 64 // CHIP8 display size
+#define DISPLAY_H 32
+#define HEADER_SIZE 13
+
+static void put_le(uint8_t *out, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint64_t get_le(const uint8_t *in, int bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (uint64_t)in[i] << (8 * i);
+	return value;
+}
+
+// Tag and LEB128 stamp delta of a record at `cycle`
+static void put_record(displog_t *log, displog_tag_t tag, uint64_t cycle) {
+	uint8_t head[11];
+	uint32_t len = 0;
+	head[len++] = tag;
+	uint64_t delta = cycle - log->last_cycle;
+	do {
+		head[len++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+		delta >>= 7;
+	} while (delta);
+	fwrite(head, 1, len, log->file);
+	log->last_cycle = cycle;
+}
+
+displog_t *displog_open(const char *path, uint32_t insts_per_frame,
+												uint32_t keyframe_interval) {
+	if (insts_per_frame == 0 || keyframe_interval == 0)
+		return NULL;
+	displog_t *log = calloc(1, sizeof *log);
+	if (!log)
+		return NULL;
+	log->file = fopen(path, "wb");
+	if (!log->file) {
+		free(log);
+		return NULL;
+	}
+	log->insts_per_frame = insts_per_frame;
+	log->keyframe_interval = keyframe_interval;
+
+	uint8_t header[HEADER_SIZE];
+	memcpy(header, "C8DL", 4);
+	header[4] = DISPLOG_VERSION;
+	put_le(&header[5], insts_per_frame, 4);
+	put_le(&header[9], keyframe_interval, 4);
+	fwrite(header, sizeof header, 1, log->file);
+	return log;
+}
+
+void displog_instruction(displog_t *log, const chip8_t *chip8, uint32_t inst) {
+	const uint16_t opcode =
+			read_ram(chip8, chip8->regs.PC) << 8 | read_ram(chip8, chip8->regs.PC + 1);
+	const uint64_t cycle = log->frame * log->insts_per_frame + inst;
+	if (opcode == 0x00E0) {
+		put_record(log, DISPLOG_CLEAR, cycle);
+	} else if ((opcode >> 12) == 0xD) {
+		// Coordinates are logged before the draw, which may overwrite VF
+		uint8_t draw[3 + 15];
+		const uint8_t n = opcode & 0x0F;
+		draw[0] = chip8->regs.V[(opcode >> 8) & 0x0F];
+		draw[1] = chip8->regs.V[(opcode >> 4) & 0x0F];
+		draw[2] = n;
+		for (uint8_t i = 0; i < n; i++)
+			draw[3 + i] = read_ram(chip8, chip8->regs.I + i);
+		put_record(log, DISPLOG_DRAW, cycle);
+		fwrite(draw, 1, 3 + n, log->file);
+	}
+}
+
+void displog_end_frame(displog_t *log, const uint64_t display[32]) {
+	log->frame++;
+	if (log->frame % log->keyframe_interval != 0)
+		return;
+	uint8_t rows[DISPLAY_H * 8];
+	for (uint32_t y = 0; y < DISPLAY_H; y++)
+		put_le(&rows[y * 8], display[y], 8);
+	put_record(log, DISPLOG_KEYFRAME, log->frame * log->insts_per_frame);
+	fwrite(rows, sizeof rows, 1, log->file);
+}
+
+bool displog_close(displog_t *log) {
+	put_record(log, DISPLOG_END, log->frame * log->insts_per_frame);
+	const bool ok = !ferror(log->file) && fclose(log->file) == 0;
+	free(log);
+	return ok;
+}
+
+// Read the next record's tag, stamp delta and payload. Returns false at
+// the end of the file or on a truncated record.
+static bool read_record(FILE *file, displog_tag_t *tag, uint64_t *delta,
+												uint8_t payload[DISPLAY_H * 8]) {
+	const int t = fgetc(file);
+	if (t == EOF)
+		return false;
+	*tag = t;
+	*delta = 0;
+	for (int shift = 0;; shift += 7) {
+		const int byte = fgetc(file);
+		if (byte == EOF || shift > 63)
+			return false;
+		*delta |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			break;
+	}
+	switch (*tag) {
+	case DISPLOG_DRAW:
+		if (fread(payload, 3, 1, file) != 1 || payload[2] > 15)
+			return false;
+		return payload[2] == 0 || fread(&payload[3], payload[2], 1, file) == 1;
+	case DISPLOG_KEYFRAME:
+		return fread(payload, DISPLAY_H * 8, 1, file) == 1;
+	case DISPLOG_CLEAR:
+	case DISPLOG_END:
+		return true;
+	}
+	return false; // Unknown tag
+}
+
+// Same wrapping and clipping as DXYN in emulate_instruction
+static void replay_draw(uint64_t display[32], const uint8_t *draw) {
+	uint8_t y = draw[1] % DISPLAY_H;
+	const uint8_t x = draw[0] % DISPLAY_W;
+	for (uint8_t i = 0; i < draw[2]; i++) {
+		display[y] ^= (uint64_t)draw[3 + i] << 56 >> x;
+		if (++y >= DISPLAY_H)
+			break;
+	}
+}
+
+// Open a log and index its keyframes, with the blank display at the start
+// as the first
+displog_reader_t *displog_reader_open(const char *path) {
+	displog_reader_t *reader = calloc(1, sizeof *reader);
+	if (!reader)
+		return NULL;
+	reader->file = fopen(path, "rb");
+	uint8_t header[HEADER_SIZE];
+	if (!reader->file || fread(header, sizeof header, 1, reader->file) != 1 ||
+			memcmp(header, "C8DL", 4) != 0 || header[4] != DISPLOG_VERSION ||
+			get_le(&header[5], 4) == 0) {
+		if (reader->file)
+			fclose(reader->file);
+		free(reader);
+		return NULL;
+	}
+	reader->insts_per_frame = get_le(&header[5], 4);
+
+	uint32_t capacity = 16;
+	reader->keys = calloc(capacity, sizeof *reader->keys);
+	if (!reader->keys) {
+		displog_reader_close(reader);
+		return NULL;
+	}
+	reader->keys[0].offset = HEADER_SIZE;
+	reader->key_count = 1;
+
+	uint64_t cycle = 0;
+	displog_tag_t tag;
+	uint64_t delta;
+	uint8_t payload[DISPLAY_H * 8];
+	while (read_record(reader->file, &tag, &delta, payload)) {
+		cycle += delta;
+		if (tag == DISPLOG_END)
+			break;
+		if (tag != DISPLOG_KEYFRAME)
+			continue;
+		if (reader->key_count == capacity) {
+			capacity *= 2;
+			displog_key_t *grown =
+					realloc(reader->keys, capacity * sizeof *reader->keys);
+			if (!grown) {
+				displog_reader_close(reader);
+				return NULL;
+			}
+			reader->keys = grown;
+		}
+		displog_key_t *key = &reader->keys[reader->key_count++];
+		key->cycle = cycle;
+		key->offset = ftell(reader->file);
+		for (uint32_t y = 0; y < DISPLAY_H; y++)
+			key->display[y] = get_le(&payload[y * 8], 8);
+	}
+	// A log cut short still replays up to its last record
+	reader->frames = cycle / reader->insts_per_frame;
+	return reader;
+}
+
+bool displog_read_frame(displog_reader_t *reader, uint64_t frame,
+												uint64_t display[32]) {
+	if (frame >= reader->frames)
+		return false;
+	const uint64_t limit = (frame + 1) * reader->insts_per_frame;
+
+	// Latest keyframe at or before the end of the frame
+	uint32_t lo = 0, hi = reader->key_count - 1;
+	while (lo < hi) {
+		const uint32_t mid = (lo + hi + 1) / 2;
+		if (reader->keys[mid].cycle <= limit)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	const displog_key_t *key = &reader->keys[lo];
+	memcpy(display, key->display, sizeof key->display);
+	if (fseek(reader->file, key->offset, SEEK_SET) != 0)
+		return false;
+
+	uint64_t cycle = key->cycle;
+	displog_tag_t tag;
+	uint64_t delta;
+	uint8_t payload[DISPLAY_H * 8];
+	while (read_record(reader->file, &tag, &delta, payload)) {
+		cycle += delta;
+		if (cycle >= limit || tag == DISPLOG_END)
+			break;
+		if (tag == DISPLOG_CLEAR)
+			memset(display, 0, DISPLAY_H * sizeof *display);
+		else if (tag == DISPLOG_DRAW)
+			replay_draw(display, payload);
+		else if (tag == DISPLOG_KEYFRAME)
+			for (uint32_t y = 0; y < DISPLAY_H; y++)
+				display[y] = get_le(&payload[y * 8], 8);
+	}
+	return true;
+}
+
+void displog_reader_close(displog_reader_t *reader) {
+	fclose(reader->file);
+	free(reader->keys);
+	free(reader);
+}
@@ -0,0 +1,70 @@
+#ifndef DISPLOG_H
+#define DISPLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+// Display command log: instead of frames, the operations that change the
+// display (00E0 and DXYN with its sprite bytes) are recorded, stamped with
+// the instruction they ran at. Any frame can be rebuilt by replaying them
+// from the nearest keyframe, a full copy of the display written every
+// keyframe_interval frames.
+//
+// File layout, little endian: "C8DL", version byte, insts_per_frame and
+// keyframe_interval as u32, then records. Each record is a tag byte and
+// the LEB128 instruction count since the previous record, followed by:
+//   DISPLOG_CLEAR    nothing
+//   DISPLOG_DRAW     VX, VY, N, then the N sprite bytes
+//   DISPLOG_KEYFRAME the 32 display rows as u64
+//   DISPLOG_END      nothing; the stamp is the end of the last frame
+#define DISPLOG_VERSION 1
+
+typedef enum {
+	DISPLOG_END,
+	DISPLOG_CLEAR,
+	DISPLOG_DRAW,
+	DISPLOG_KEYFRAME,
+} displog_tag_t;
+
+typedef struct {
+	FILE *file;
+	uint32_t insts_per_frame;
+	uint32_t keyframe_interval;
+	uint64_t frame;			 // Frames completed
+	uint64_t last_cycle; // Stamp of the previous record
+} displog_t;
+
+// Where replay can start from: the display as of `cycle`, and the file
+// offset of the record after it
+typedef struct {
+	uint64_t cycle;
+	long offset;
+	uint64_t display[32];
+} displog_key_t;
+
+typedef struct {
+	FILE *file;
+	uint32_t insts_per_frame;
+	uint64_t frames; // Frames recorded
+	displog_key_t *keys;
+	uint32_t key_count;
+} displog_reader_t;
+
+displog_t *displog_open(const char *path, uint32_t insts_per_frame,
+												uint32_t keyframe_interval);
+// Call before emulating each instruction; `inst` is its index in the frame.
+// Records the instruction if it is 00E0 or DXYN.
+void displog_instruction(displog_t *log, const chip8_t *chip8, uint32_t inst);
+void displog_end_frame(displog_t *log, const uint64_t display[32]);
+bool displog_close(displog_t *log);
+
+displog_reader_t *displog_reader_open(const char *path);
+// The display as it was at the end of `frame`, counting from 0
+bool displog_read_frame(displog_reader_t *reader, uint64_t frame,
+												uint64_t display[32]);
+void displog_reader_close(displog_reader_t *reader);
+
+#endif
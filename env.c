@@ -0,0 +1,299 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "env.h"
+
+// Pixel pairs to one pixel each, lit if either is, packed into the top
+// half of the row
+static uint64_t halve(uint64_t row) {
+	row = (row | row >> 1) & 0x5555555555555555;
+	row = (row | row >> 1) & 0x3333333333333333;
+	row = (row | row >> 2) & 0x0F0F0F0F0F0F0F0F;
+	row = (row | row >> 4) & 0x00FF00FF00FF00FF;
+	row = (row | row >> 8) & 0x0000FFFF0000FFFF;
+	row = (row | row >> 16) & 0x00000000FFFFFFFF;
+	return row << 32;
+}
+
+// One frame of the display into the observation format
+static void write_frame(const env_t *env, const uint64_t display[32],
+												uint8_t *out) {
+	if (env->config.obs == ENV_OBS_PACKED) {
+		memcpy(out, display, 32 * sizeof *display);
+		return;
+	}
+	const uint32_t d = env->config.downsample;
+	for (uint32_t y = 0; y < env->height; y++) {
+		uint64_t row = display[y * d];
+		for (uint32_t j = 1; j < d; j++)
+			row |= display[y * d + j];
+		for (uint32_t halved = 1; halved < d; halved <<= 1)
+			row = halve(row);
+		// Eight pixels at a time
+		for (uint32_t x = 0; x < env->width; x += 8)
+			memcpy(out + y * env->width + x, env->pixels[row >> (56 - x) & 0xFF], 8);
+	}
+}
+
+static void write_obs(const env_t *env, uint32_t i) {
+	const env_slot_t *slot = &env->slots[i];
+	const uint32_t stack = env->config.stack;
+	const size_t frame_size = env->obs_size / stack;
+	uint8_t *out = env->obs + i * env->obs_size;
+	for (uint32_t k = 0; k < stack; k++)
+		write_frame(env, env->history[i * stack + (slot->newest + 1 + k) % stack],
+								out + k * frame_size);
+}
+
+static void push_frame(env_t *env, uint32_t i, const chip8_t *chip8) {
+	env_slot_t *slot = &env->slots[i];
+	slot->newest = (slot->newest + 1) % env->config.stack;
+	memcpy(env->history[i * env->config.stack + slot->newest], chip8->display,
+				 sizeof chip8->display);
+}
+
+// The machine has just been spawned: every frame of the first observation
+// is its display, and delta() terms start from where it is
+static void start_episode(env_t *env, uint32_t i, const chip8_t *chip8) {
+	env_slot_t *slot = &env->slots[i];
+	slot->frames = 0;
+	watch_eval(&env->reward, chip8, slot->reward_prev);
+	watch_eval(&env->terminal, chip8, slot->terminal_prev);
+	for (uint32_t k = 0; k < env->config.stack; k++)
+		push_frame(env, i, chip8);
+}
+
+// On the worker that ran the environment's last frame of the step
+static void step_done(sched_task_t *task, void *arg) {
+	env_t *env = arg;
+	const uint32_t i = task - env->sched->tasks;
+	chip8_t *chip8 = task->chip8;
+	env_slot_t *slot = &env->slots[i];
+
+	slot->frames += env->config.frameskip;
+	push_frame(env, i, chip8);
+	env->rewards[i] = watch_eval(&env->reward, chip8, slot->reward_prev);
+	env_done_t done = ENV_RUNNING;
+	if (watch_eval(&env->terminal, chip8, slot->terminal_prev))
+		done = ENV_TERMINATED;
+	else if (env->config.max_frames && slot->frames >= env->config.max_frames)
+		done = ENV_TRUNCATED;
+	env->dones[i] = done;
+	if (done != ENV_RUNNING) {
+		// Copied pages go back to this worker's arena, and come from it again.
+		// The next episode's random numbers follow on from this one's.
+		arena_t *pages = chip8->page_arena;
+		boot_image_reset(&env->image, chip8, chip8->rng);
+		chip8->page_arena = pages;
+		start_episode(env, i, chip8);
+	}
+	write_obs(env, i);
+}
+
+static bool check_config(env_config_t *config) {
+	if (config->downsample == 0)
+		config->downsample = 1;
+	if (config->stack == 0)
+		config->stack = 1;
+	if (config->frameskip == 0)
+		config->frameskip = 1;
+	const uint32_t d = config->downsample;
+	if (config->obs == ENV_OBS_PACKED ? d != 1
+																		: d != 1 && d != 2 && d != 4 && d != 8) {
+		fprintf(stderr, "Downsampling is 1, 2, 4 or 8, and only for pixels\n");
+		return false;
+	}
+	if (config->stack > ENV_MAX_STACK) {
+		fprintf(stderr, "Frame stacks are at most %u frames\n", ENV_MAX_STACK);
+		return false;
+	}
+	return true;
+}
+
+env_t *env_create(const char *rom, uint32_t count, const config_t config,
+									const env_config_t env_config) {
+	if (count == 0)
+		return NULL;
+	env_t *env = calloc(1, sizeof *env);
+	if (!env)
+		return NULL;
+	env->config = env_config;
+	env->count = count;
+	env->seed = config.seed;
+	if (!check_config(&env->config) ||
+			!watch_compile(&env->reward, env->config.reward) ||
+			!watch_compile(&env->terminal, env->config.terminal) ||
+			!boot_image_load(&env->image, rom)) {
+		free(env);
+		return NULL;
+	}
+	env->width = 64 / env->config.downsample;
+	env->height = 32 / env->config.downsample;
+	env->obs_size = env->config.stack *
+									(env->config.obs == ENV_OBS_PACKED
+											 ? 32 * sizeof(uint64_t)
+											 : (size_t)env->width * env->height);
+	for (uint32_t byte = 0; byte < 256; byte++)
+		for (uint32_t x = 0; x < 8; x++)
+			env->pixels[byte][x] = (byte >> (7 - x)) & 1 ? 255 : 0;
+
+	env->jobs = config.jobs;
+	if (env->jobs == 0) {
+		const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		env->jobs = cores > 0 ? (uint32_t)cores : 1;
+	}
+	if (env->jobs > count)
+		env->jobs = count;
+	env->page_arenas = calloc(env->jobs, sizeof *env->page_arenas);
+	env->slots = calloc(count, sizeof *env->slots);
+	env->history = calloc((size_t)count * env->config.stack,
+												sizeof *env->history);
+	bool ok = env->page_arenas && env->slots && env->history &&
+						arena_init(&env->machine_arena, sizeof(chip8_t), config.hugepages);
+	for (uint32_t i = 0; ok && i < env->jobs; i++)
+		ok = arena_init(&env->page_arenas[i], RAM_PAGE_SIZE, config.hugepages);
+	if (ok)
+		env->machines = arena_alloc_run(&env->machine_arena, count);
+	if (env->machines)
+		for (uint32_t i = 0; i < count; i++)
+			boot_image_spawn(&env->image, &env->machines[i],
+											 chip8_seed(env->seed, i));
+	if (env->machines && config.memo_mb)
+		env->memo = memo_create((size_t)config.memo_mb << 20);
+	if (env->machines && (env->memo || !config.memo_mb))
+		env->sched = sched_create(env->machines, count, config, env->memo,
+															env->page_arenas, env->jobs, true);
+	if (!env->sched) {
+		env_destroy(env);
+		return NULL;
+	}
+	env->sched->on_idle = step_done;
+	env->sched->on_idle_arg = env;
+	return env;
+}
+
+void env_destroy(env_t *env) {
+	if (env->sched)
+		sched_destroy(env->sched);
+	if (env->memo)
+		memo_destroy(env->memo);
+	for (uint32_t i = 0; env->machines && i < env->count; i++)
+		release_chip8(&env->machines[i]);
+	arena_destroy(&env->machine_arena);
+	for (uint32_t i = 0; env->page_arenas && i < env->jobs; i++)
+		arena_destroy(&env->page_arenas[i]);
+	free(env->page_arenas);
+	free(env->slots);
+	free(env->history);
+	free(env);
+}
+
+void env_reset(env_t *env, uint8_t *obs) {
+	env->obs = obs;
+	for (uint32_t i = 0; i < env->count; i++) {
+		sched_task_t *task = &env->sched->tasks[i];
+		sched_spawn(env->sched, task, &env->image, chip8_seed(env->seed, i));
+		start_episode(env, i, task->chip8);
+		write_obs(env, i);
+	}
+}
+
+void env_step(env_t *env, const uint32_t *actions, uint8_t *obs,
+							float *rewards, uint8_t *dones) {
+	env->obs = obs;
+	env->rewards = rewards;
+	env->dones = dones;
+	for (uint32_t i = 0; i < env->count; i++) {
+		uint32_t mask = actions[i];
+		if (env->config.action_keys)
+			mask = mask < env->config.action_count ? env->config.action_keys[mask]
+																						 : 0;
+		bool keys[16];
+		for (int k = 0; k < 16; k++)
+			keys[k] = (mask >> k) & 1;
+		sched_task_t *task = &env->sched->tasks[i];
+		sched_set_keys(env->sched, task, keys);
+		sched_step(env->sched, task, env->config.frameskip);
+	}
+	while (sched_frame(env->sched) > 0)
+		;
+}
+
+bool env_bench(const config_t config) {
+	// No key or one key, as an agent would press
+	uint16_t action_keys[17] = {0};
+	for (int k = 0; k < 16; k++)
+		action_keys[k + 1] = 1 << k;
+	const env_config_t env_config = {
+			.obs = config.env_pixels ? ENV_OBS_PIXELS : ENV_OBS_PACKED,
+			.downsample = config.downsample,
+			.stack = config.frame_stack,
+			.frameskip = config.frameskip,
+			.max_frames = config.episode_frames,
+			.reward = config.reward,
+			.terminal = config.terminal,
+			.action_keys = action_keys,
+			.action_count = 17,
+	};
+	env_t *env = env_create(config.roms[0], config.envs, config, env_config);
+	if (!env)
+		return false;
+	uint8_t *obs = malloc(env->count * env->obs_size);
+	uint32_t *actions = malloc(env->count * sizeof *actions);
+	float *rewards = malloc(env->count * sizeof *rewards);
+	uint8_t *dones = malloc(env->count);
+	if (!obs || !actions || !rewards || !dones) {
+		free(obs);
+		free(actions);
+		free(rewards);
+		free(dones);
+		env_destroy(env);
+		return false;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	env_reset(env, obs);
+	uint64_t episodes = 0, random = config.seed_set ? config.seed | 1 : 1;
+	double reward = 0;
+	for (uint32_t step = 0; step < config.env_steps; step++) {
+		for (uint32_t i = 0; i < env->count; i++) {
+			random ^= random << 13; // xorshift64
+			random ^= random >> 7;
+			random ^= random << 17;
+			actions[i] = random % 17;
+		}
+		env_step(env, actions, obs, rewards, dones);
+		for (uint32_t i = 0; i < env->count; i++) {
+			reward += rewards[i];
+			episodes += dones[i] != ENV_RUNNING;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	const double s =
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	const double steps = (double)env->count * config.env_steps;
+	printf("%u environments x %u steps of %u frames in %.3f s: %.0f steps/s, "
+				 "%.0f frames/s, %zu observation bytes each; %" PRIu64
+				 " episodes ended, total reward %.0f\n",
+				 env->count, config.env_steps, env->config.frameskip, s, steps / s,
+				 steps * env->config.frameskip / s, env->obs_size, episodes, reward);
+	sched_report(env->sched);
+	if (env->memo)
+		memo_report(env->memo);
+	arena_report("machines", &env->machine_arena, 1);
+	arena_report("pages", env->page_arenas, env->jobs);
+
+	free(obs);
+	free(actions);
+	free(rewards);
+	free(dones);
+	env_destroy(env);
+	return true;
+}
@@ -0,0 +1,99 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "chip8.h"
+#include "memo.h"
+#include "scheduler.h"
+#include "watch.h"
+
+#define ENV_MAX_STACK 16 // Frames in one observation
+
+typedef enum {
+	ENV_OBS_PACKED, // 32 uint64_t rows per frame, bit 63 is x=0
+	ENV_OBS_PIXELS, // A byte per pixel, 0 or 255, row major
+} env_obs_t;
+
+// What env_step reports for each environment in `dones`
+typedef enum {
+	ENV_RUNNING = 0,
+	ENV_TERMINATED = 1, // The terminal expression held
+	ENV_TRUNCATED = 2,	// Ran max_frames
+} env_done_t;
+
+typedef struct {
+	env_obs_t obs;
+	uint32_t downsample;	// Pixels only: 1, 2, 4 or 8, lit if any pixel in
+												// the block is
+	uint32_t stack;				// Latest frames per observation, oldest first
+	uint32_t frameskip;		// Frames per step, with the action's keys held
+	uint32_t max_frames;	// Episode length, 0 for no limit
+	const char *reward;		// Watch expressions (see watch.h), per step
+	const char *terminal; // Ends the episode when not 0
+	// Key masks that actions index, or NULL to take actions as key masks
+	// (bit k = key k down)
+	const uint16_t *action_keys;
+	uint32_t action_count;
+} env_config_t;
+
+// Per environment state besides the machine
+typedef struct {
+	int32_t reward_prev[WATCH_MAX_DELTAS];
+	int32_t terminal_prev[WATCH_MAX_DELTAS];
+	uint32_t frames; // Into the episode
+	uint32_t newest; // History slot of the latest frame
+} env_slot_t;
+
+// Vectorised reinforcement learning environments: `count` copies of one
+// ROM, stepped together on the scheduler's workers. Each step holds every
+// environment's keys for frameskip frames, then its worker writes the
+// observation, reward and done flag straight into the caller's buffers
+// and respawns the machine from the boot image if the episode ended, so
+// the next observation is the new episode's first. Nothing is allocated
+// per step; ram pages machines copy come back to the arenas on respawn.
+typedef struct {
+	env_config_t config;
+	uint32_t count;
+	size_t obs_size;			 // Bytes per environment
+	uint32_t width, height; // Of a pixel observation
+	uint32_t seed;					// Environment i's machine gets chip8_seed(seed, i)
+
+	boot_image_t image;
+	arena_t machine_arena;
+	arena_t *page_arenas; // One per worker
+	uint32_t jobs;
+	chip8_t *machines;
+	memo_t *memo;
+	sched_t *sched;
+	watch_t reward, terminal;
+	uint8_t pixels[256][8]; // Pixel bytes of each display byte
+
+	env_slot_t *slots;
+	uint64_t (*history)[32]; // `stack` displays per environment, a ring
+	// Buffers of the step being run
+	uint8_t *obs;
+	float *rewards;
+	uint8_t *dones;
+} env_t;
+
+// `config` supplies the emulation settings: speed, seed, jobs, memo,
+// hugepages.
+// Reports what is wrong on stderr and returns NULL.
+env_t *env_create(const char *rom, uint32_t count, const config_t config,
+									const env_config_t env_config);
+void env_destroy(env_t *env);
+// Start every environment's episode afresh; `obs` takes count * obs_size
+// bytes
+void env_reset(env_t *env, uint8_t *obs);
+// Advance every environment by one step of actions[i]. `obs` as for
+// env_reset; `rewards` and `dones` take `count` entries.
+void env_step(env_t *env, const uint32_t *actions, uint8_t *obs,
+							float *rewards, uint8_t *dones);
+// Step random actions `steps` times and report the rate
+bool env_bench(const config_t config);
+
+#endif
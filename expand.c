@@ -0,0 +1,395 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "expand.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EXPAND_X86
+#endif
+
+#define DISPLAY_W 64
+
+typedef struct {
+	const char *name;
+	void (*line32)(uint64_t row, uint32_t fg, uint32_t bg, uint32_t scale,
+								 uint32_t *out);
+	void (*line8)(uint64_t row, uint8_t fg, uint8_t bg, uint32_t scale,
+								uint8_t *out);
+	void (*replicate32)(const uint32_t colors[DISPLAY_W], uint32_t scale,
+											uint32_t *out);
+	bool (*decay8)(uint8_t level[DISPLAY_W], uint64_t row, uint32_t keep);
+} kernel_t;
+
+static void line32_scalar(uint64_t row, uint32_t fg, uint32_t bg,
+													uint32_t scale, uint32_t *out) {
+	for (uint32_t x = 0; x < DISPLAY_W; x++) {
+		const uint32_t color = ((row >> (63 - x)) & 1) ? fg : bg;
+		for (uint32_t s = 0; s < scale; s++)
+			*out++ = color;
+	}
+}
+
+static void line8_scalar(uint64_t row, uint8_t fg, uint8_t bg, uint32_t scale,
+												 uint8_t *out) {
+	for (uint32_t x = 0; x < DISPLAY_W; x++) {
+		memset(out, ((row >> (63 - x)) & 1) ? fg : bg, scale);
+		out += scale;
+	}
+}
+
+static void replicate32_scalar(const uint32_t colors[DISPLAY_W],
+															 uint32_t scale, uint32_t *out) {
+	for (uint32_t x = 0; x < DISPLAY_W; x++)
+		for (uint32_t s = 0; s < scale; s++)
+			*out++ = colors[x];
+}
+
+// Fade a row of phosphor levels by keep/256 and relight its lit pixels.
+// Returns whether any level changed.
+static bool decay8_scalar(uint8_t level[DISPLAY_W], uint64_t row,
+													uint32_t keep) {
+	bool changed = false;
+	for (uint32_t x = 0; x < DISPLAY_W; x++) {
+		const uint8_t next =
+				((row >> (63 - x)) & 1) ? 255 : (level[x] * keep) >> 8;
+		changed |= next != level[x];
+		level[x] = next;
+	}
+	return changed;
+}
+
+#ifdef EXPAND_X86
+// The vector kernels look up all 64 colours first, then replicate each one
+// with unaligned stores of a whole vector. A store may run past its cell;
+// the next cell overwrites the excess, and stores that would run past the
+// end of the line are done a pixel at a time instead.
+
+__attribute__((target("sse2"))) static void
+replicate32_sse2(const uint32_t colors[DISPLAY_W], uint32_t scale,
+									uint32_t *out) {
+	uint32_t *const end = out + DISPLAY_W * scale;
+	for (uint32_t x = 0; x < DISPLAY_W; x++) {
+		const __m128i v = _mm_set1_epi32(colors[x]);
+		uint32_t *p = out + x * scale;
+		uint32_t *const cell_end = p + scale;
+		while (p < cell_end) {
+			if (end - p >= 4) {
+				_mm_storeu_si128((__m128i *)p, v);
+				p += 4;
+			} else {
+				*p++ = colors[x];
+			}
+		}
+	}
+}
+
+__attribute__((target("sse2"))) static void
+line32_sse2(uint64_t row, uint32_t fg, uint32_t bg, uint32_t scale,
+						uint32_t *out) {
+	uint32_t colors[DISPLAY_W];
+	const __m128i sel = _mm_set_epi32(1, 2, 4, 8); // Lane 0 is the nibble's msb
+	const __m128i fgv = _mm_set1_epi32(fg);
+	const __m128i bgv = _mm_set1_epi32(bg);
+	uint32_t *first = scale == 1 ? out : colors;
+	for (uint32_t x = 0; x < DISPLAY_W; x += 4) {
+		const __m128i bits = _mm_set1_epi32((row >> (60 - x)) & 0xF);
+		const __m128i on = _mm_cmpeq_epi32(_mm_and_si128(bits, sel), sel);
+		_mm_storeu_si128((__m128i *)&first[x],
+										 _mm_or_si128(_mm_and_si128(on, fgv),
+																	_mm_andnot_si128(on, bgv)));
+	}
+	if (scale == 1)
+		return;
+
+	replicate32_sse2(colors, scale, out);
+}
+
+__attribute__((target("sse2"))) static void
+line8_sse2(uint64_t row, uint8_t fg, uint8_t bg, uint32_t scale, uint8_t *out) {
+	uint8_t colors[DISPLAY_W];
+	const __m128i sel = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8,
+																	 16, 32, 64, -128);
+	const __m128i fgv = _mm_set1_epi8(fg);
+	const __m128i bgv = _mm_set1_epi8(bg);
+	uint8_t *first = scale == 1 ? out : colors;
+	for (uint32_t x = 0; x < DISPLAY_W; x += 16) {
+		// Each byte of the row spread over the 8 lanes of its pixels
+		const uint64_t hi = (row >> (56 - x)) & 0xFF;
+		const uint64_t lo = (row >> (48 - x)) & 0xFF;
+		const __m128i bits =
+				_mm_set_epi64x(lo * 0x0101010101010101ULL, hi * 0x0101010101010101ULL);
+		const __m128i on = _mm_cmpeq_epi8(_mm_and_si128(bits, sel), sel);
+		_mm_storeu_si128((__m128i *)&first[x],
+										 _mm_or_si128(_mm_and_si128(on, fgv),
+																	_mm_andnot_si128(on, bgv)));
+	}
+	if (scale == 1)
+		return;
+
+	uint8_t *const end = out + DISPLAY_W * scale;
+	for (uint32_t x = 0; x < DISPLAY_W; x++) {
+		const __m128i v = _mm_set1_epi8(colors[x]);
+		uint8_t *p = out + x * scale;
+		uint8_t *const cell_end = p + scale;
+		while (p < cell_end) {
+			if (end - p >= 16) {
+				_mm_storeu_si128((__m128i *)p, v);
+				p += 16;
+			} else {
+				*p++ = colors[x];
+			}
+		}
+	}
+}
+
+// Levels are widened to 16 bits for the multiply; 255 * 255 still fits
+__attribute__((target("sse2"))) static bool
+decay8_sse2(uint8_t level[DISPLAY_W], uint64_t row, uint32_t keep) {
+	uint8_t lit[DISPLAY_W];
+	line8_sse2(row, 0xFF, 0, 1, lit);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i factor = _mm_set1_epi16(keep);
+	__m128i diff = zero;
+	for (uint32_t x = 0; x < DISPLAY_W; x += 16) {
+		const __m128i old = _mm_loadu_si128((const __m128i *)&level[x]);
+		const __m128i lo = _mm_srli_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(old, zero), factor), 8);
+		const __m128i hi = _mm_srli_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(old, zero), factor), 8);
+		const __m128i next =
+				_mm_max_epu8(_mm_packus_epi16(lo, hi),
+										 _mm_loadu_si128((const __m128i *)&lit[x]));
+		diff = _mm_or_si128(diff, _mm_xor_si128(next, old));
+		_mm_storeu_si128((__m128i *)&level[x], next);
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xFFFF;
+}
+
+__attribute__((target("avx2"))) static void
+replicate32_avx2(const uint32_t colors[DISPLAY_W], uint32_t scale,
+									uint32_t *out) {
+	uint32_t *const end = out + DISPLAY_W * scale;
+	for (uint32_t x = 0; x < DISPLAY_W; x++) {
+		const __m256i v = _mm256_set1_epi32(colors[x]);
+		uint32_t *p = out + x * scale;
+		uint32_t *const cell_end = p + scale;
+		while (p < cell_end) {
+			if (end - p >= 8) {
+				_mm256_storeu_si256((__m256i *)p, v);
+				p += 8;
+			} else {
+				*p++ = colors[x];
+			}
+		}
+	}
+}
+
+__attribute__((target("avx2"))) static void
+line32_avx2(uint64_t row, uint32_t fg, uint32_t bg, uint32_t scale,
+						uint32_t *out) {
+	uint32_t colors[DISPLAY_W];
+	const __m256i sel = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	const __m256i fgv = _mm256_set1_epi32(fg);
+	const __m256i bgv = _mm256_set1_epi32(bg);
+	uint32_t *first = scale == 1 ? out : colors;
+	for (uint32_t x = 0; x < DISPLAY_W; x += 8) {
+		const __m256i bits = _mm256_set1_epi32((row >> (56 - x)) & 0xFF);
+		const __m256i on = _mm256_cmpeq_epi32(_mm256_and_si256(bits, sel), sel);
+		_mm256_storeu_si256((__m256i *)&first[x], _mm256_blendv_epi8(bgv, fgv, on));
+	}
+	if (scale == 1)
+		return;
+
+	replicate32_avx2(colors, scale, out);
+}
+
+__attribute__((target("avx2"))) static void
+line8_avx2(uint64_t row, uint8_t fg, uint8_t bg, uint32_t scale, uint8_t *out) {
+	uint8_t colors[DISPLAY_W];
+	const __m256i sel = _mm256_set_epi8(
+			1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8,
+			16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	const __m256i fgv = _mm256_set1_epi8(fg);
+	const __m256i bgv = _mm256_set1_epi8(bg);
+	uint8_t *first = scale == 1 ? out : colors;
+	for (uint32_t x = 0; x < DISPLAY_W; x += 32) {
+		const uint64_t k = 0x0101010101010101ULL;
+		const __m256i bits = _mm256_set_epi64x(
+				((row >> (32 - x)) & 0xFF) * k, ((row >> (40 - x)) & 0xFF) * k,
+				((row >> (48 - x)) & 0xFF) * k, ((row >> (56 - x)) & 0xFF) * k);
+		const __m256i on = _mm256_cmpeq_epi8(_mm256_and_si256(bits, sel), sel);
+		_mm256_storeu_si256((__m256i *)&first[x], _mm256_blendv_epi8(bgv, fgv, on));
+	}
+	if (scale == 1)
+		return;
+
+	uint8_t *const end = out + DISPLAY_W * scale;
+	for (uint32_t x = 0; x < DISPLAY_W; x++) {
+		const __m256i v = _mm256_set1_epi8(colors[x]);
+		uint8_t *p = out + x * scale;
+		uint8_t *const cell_end = p + scale;
+		while (p < cell_end) {
+			if (end - p >= 32) {
+				_mm256_storeu_si256((__m256i *)p, v);
+				p += 32;
+			} else {
+				*p++ = colors[x];
+			}
+		}
+	}
+}
+
+__attribute__((target("avx2"))) static bool
+decay8_avx2(uint8_t level[DISPLAY_W], uint64_t row, uint32_t keep) {
+	uint8_t lit[DISPLAY_W];
+	line8_avx2(row, 0xFF, 0, 1, lit);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i factor = _mm256_set1_epi16(keep);
+	__m256i diff = zero;
+	for (uint32_t x = 0; x < DISPLAY_W; x += 32) {
+		// Unpack and pack both work within 128 bit lanes, so order is kept
+		const __m256i old = _mm256_loadu_si256((const __m256i *)&level[x]);
+		const __m256i lo = _mm256_srli_epi16(
+				_mm256_mullo_epi16(_mm256_unpacklo_epi8(old, zero), factor), 8);
+		const __m256i hi = _mm256_srli_epi16(
+				_mm256_mullo_epi16(_mm256_unpackhi_epi8(old, zero), factor), 8);
+		const __m256i next =
+				_mm256_max_epu8(_mm256_packus_epi16(lo, hi),
+												_mm256_loadu_si256((const __m256i *)&lit[x]));
+		diff = _mm256_or_si256(diff, _mm256_xor_si256(next, old));
+		_mm256_storeu_si256((__m256i *)&level[x], next);
+	}
+	return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(diff, zero)) !=
+				 0xFFFFFFFF;
+}
+#endif
+
+static kernel_t kernel = {"scalar", line32_scalar, line8_scalar,
+												 replicate32_scalar, decay8_scalar};
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernel(void) {
+#ifdef EXPAND_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		kernel = (kernel_t){"avx2", line32_avx2, line8_avx2, replicate32_avx2,
+												decay8_avx2};
+	else if (__builtin_cpu_supports("sse2"))
+		kernel = (kernel_t){"sse2", line32_sse2, line8_sse2, replicate32_sse2,
+												decay8_sse2};
+#endif
+}
+
+// Half brightness RGBA8888, alpha kept
+static uint32_t dim_color(uint32_t color) {
+	return ((color >> 1) & 0x7F7F7F00) | (color & 0xFF);
+}
+
+void expand_init(expand_t *expand, uint32_t fg, uint32_t bg, uint32_t scale) {
+	pthread_once(&kernel_once, pick_kernel);
+	*expand = (expand_t){
+			.fg = fg,
+			.bg = bg,
+			.fg_dim = dim_color(fg),
+			.bg_dim = dim_color(bg),
+			.scale = scale,
+	};
+}
+
+const char *expand_isa(void) {
+	pthread_once(&kernel_once, pick_kernel);
+	return kernel.name;
+}
+
+// bg to fg blend at every brightness level, plus the scanline versions
+void phosphor_init(phosphor_t *phosphor, uint32_t fg, uint32_t bg,
+									 uint32_t keep) {
+	pthread_once(&kernel_once, pick_kernel);
+	memset(phosphor, 0, sizeof *phosphor);
+	phosphor->keep = keep > 255 ? 255 : keep;
+	for (uint32_t level = 0; level < 256; level++) {
+		uint32_t color = 0;
+		for (uint32_t shift = 0; shift < 32; shift += 8) {
+			const int32_t from = (bg >> shift) & 0xFF;
+			const int32_t to = (fg >> shift) & 0xFF;
+			color |= (uint32_t)(from + (to - from) * (int32_t)level / 255) << shift;
+		}
+		phosphor->palette[level] = color;
+		phosphor->palette_dim[level] = dim_color(color);
+	}
+}
+
+uint32_t phosphor_update(phosphor_t *phosphor, const uint64_t display[32]) {
+	uint32_t changed = 0;
+	for (uint32_t y = 0; y < 32; y++)
+		if (kernel.decay8(phosphor->level[y], display[y], phosphor->keep))
+			changed |= 1u << y;
+	return changed;
+}
+
+void expand_line32(const expand_t *expand, uint64_t row, uint32_t *out) {
+	kernel.line32(row, expand->fg, expand->bg, expand->scale, out);
+}
+
+void expand_line8(const expand_t *expand, uint64_t row, uint8_t *out) {
+	kernel.line8(row, expand->fg, expand->bg, expand->scale, out);
+}
+
+void expand_rows32(const expand_t *expand, const uint64_t display[32],
+									 const phosphor_t *phosphor, uint32_t top, uint32_t count,
+									 uint32_t *out, size_t pitch) {
+	const uint32_t scale = expand->scale;
+	const uint32_t width = DISPLAY_W * scale;
+
+	for (uint32_t y = top; y < top + count; y++) {
+		// Pixels that get an outline: lit ones, or still glowing ones
+		uint64_t lit = display[y];
+		if (phosphor) {
+			lit = 0;
+			for (uint32_t x = 0; x < DISPLAY_W; x++)
+				lit |= (uint64_t)(phosphor->level[y][x] != 0) << (63 - x);
+		}
+
+		// Each distinct line is expanded once, then copied down the cell
+		const uint32_t *normal = NULL, *dim = NULL;
+		for (uint32_t sy = 0; sy < scale; sy++) {
+			uint32_t *line = out + ((size_t)(y - top) * scale + sy) * pitch;
+			const bool is_dim = expand->scanlines && (sy & 1);
+			const uint32_t bg = is_dim ? expand->bg_dim : expand->bg;
+
+			// Top and bottom edges of every cell are all border
+			if (expand->outline && (sy == 0 || sy == scale - 1)) {
+				for (uint32_t x = 0; x < width; x++)
+					line[x] = bg;
+				continue;
+			}
+
+			const uint32_t **done = is_dim ? &dim : &normal;
+			if (*done) {
+				memcpy(line, *done, width * sizeof *line);
+				continue;
+			}
+			if (phosphor) {
+				const uint32_t *palette =
+						is_dim ? phosphor->palette_dim : phosphor->palette;
+				uint32_t colors[DISPLAY_W];
+				for (uint32_t x = 0; x < DISPLAY_W; x++)
+					colors[x] = palette[phosphor->level[y][x]];
+				kernel.replicate32(colors, scale, line);
+			} else {
+				kernel.line32(display[y], is_dim ? expand->fg_dim : expand->fg, bg,
+											scale, line);
+			}
+			if (expand->outline) {
+				// Left and right edges of each lit pixel
+				for (uint64_t bits = lit; bits; bits &= bits - 1) {
+					const uint32_t x = 63 - __builtin_ctzll(bits);
+					line[x * scale] = bg;
+					line[x * scale + scale - 1] = bg;
+				}
+			}
+			*done = line;
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Expansion of packed display rows (bit 63 is x=0) into scaled pixels. One
+// lit/unlit colour lookup per CHIP8 pixel, then each pixel is replicated
+// across the scale with vector stores; repeated lines are memcpy'd. SSE2 or
+// AVX2 is picked at runtime on x86, with a scalar fallback elsewhere.
+typedef struct {
+	uint32_t fg, bg;				 // Output values; only the low byte for 8 bit output
+	uint32_t fg_dim, bg_dim; // Colours on scanlines
+	uint32_t scale;
+	bool outline;		// Lit pixels get a border in bg, like the SDL window's
+	bool scanlines; // Every other output line is drawn at half brightness
+} expand_t;
+
+// Phosphor persistence: every CHIP8 pixel has a brightness that jumps to
+// full when lit and then fades by `keep`/256 per frame, so sprites that are
+// XORed off and on again every frame show steadily instead of flickering.
+typedef struct {
+	uint8_t level[32][64];		 // 255 while lit
+	uint32_t palette[256];		 // RGBA8888 per level, bg to fg
+	uint32_t palette_dim[256]; // Same on scanlines
+	uint32_t keep;						 // Brightness kept per frame, /256
+} phosphor_t;
+
+void expand_init(expand_t *expand, uint32_t fg, uint32_t bg, uint32_t scale);
+void phosphor_init(phosphor_t *phosphor, uint32_t fg, uint32_t bg,
+									 uint32_t keep);
+// Advance one emulated frame; returns the rows whose levels changed
+uint32_t phosphor_update(phosphor_t *phosphor, const uint64_t display[32]);
+
+// One output line (64 * scale pixels) of `row`, without outline or scanlines
+void expand_line32(const expand_t *expand, uint64_t row, uint32_t *out);
+void expand_line8(const expand_t *expand, uint64_t row, uint8_t *out);
+
+// Display rows top..top+count-1 into count * scale lines of RGBA8888 with
+// the outline and scanline masks applied, blended through `phosphor` if not
+// NULL. `pitch` is in pixels.
+void expand_rows32(const expand_t *expand, const uint64_t display[32],
+									 const phosphor_t *phosphor, uint32_t top, uint32_t count,
+									 uint32_t *out, size_t pitch);
+
+// Name of the kernel in use: "avx2", "sse2" or "scalar"
+const char *expand_isa(void);
+
+#endif
@@ -0,0 +1,253 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memo.h"
+
+#define DISPLAY_H 32
+
+static uint64_t mix_word(uint64_t hash, uint64_t word) {
+	hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+	return hash ^ (hash >> 32);
+}
+
+// Everything a frame's instructions read. Ram comes in through its running
+// hash, so this is about 40 words whatever is in memory.
+static uint64_t state_hash(const chip8_t *chip8) {
+	uint64_t hash = chip8->ram_hash;
+	for (uint32_t y = 0; y < DISPLAY_H; y++)
+		hash = mix_word(hash, chip8->display[y]);
+	uint64_t words[6];
+	memcpy(&words[0], chip8->regs.V, sizeof chip8->regs.V);
+	memcpy(&words[2], chip8->regs.stack, sizeof chip8->regs.stack);
+	for (uint32_t i = 0; i < 6; i++)
+		hash = mix_word(hash, words[i]);
+	return mix_word(hash, (uint64_t)chip8->regs.I | (uint64_t)chip8->regs.PC << 16 |
+														(uint64_t)chip8->regs.sp << 32 |
+														(uint64_t)chip8->regs.delay_timer << 40 |
+														(uint64_t)chip8->regs.sound_timer << 48);
+}
+
+static uint16_t keypad_bits(const chip8_t *chip8) {
+	uint16_t keys = 0;
+	for (uint32_t k = 0; k < 16; k++)
+		keys |= (uint16_t)chip8->keypad[k] << k;
+	return keys;
+}
+
+memo_t *memo_create(size_t max_bytes) {
+	memo_t *memo = calloc(1, sizeof *memo);
+	if (!memo)
+		return NULL;
+	memo->max_shard_bytes = max_bytes / MEMO_SHARDS;
+	for (uint32_t i = 0; i < MEMO_SHARDS; i++)
+		pthread_mutex_init(&memo->shards[i].lock, NULL);
+	return memo;
+}
+
+void memo_destroy(memo_t *memo) {
+	for (uint32_t i = 0; i < MEMO_SHARDS; i++) {
+		memo_shard_t *shard = &memo->shards[i];
+		for (memo_entry_t *entry = shard->newest, *older; entry; entry = older) {
+			older = entry->older;
+			free(entry);
+		}
+		pthread_mutex_destroy(&shard->lock);
+	}
+	free(memo);
+}
+
+static memo_entry_t **bucket_of(memo_shard_t *shard, uint64_t hash) {
+	return &shard->buckets[(hash / MEMO_SHARDS) & (MEMO_BUCKETS - 1)];
+}
+
+static void lru_unlink(memo_shard_t *shard, memo_entry_t *entry) {
+	if (entry->newer)
+		entry->newer->older = entry->older;
+	else
+		shard->newest = entry->older;
+	if (entry->older)
+		entry->older->newer = entry->newer;
+	else
+		shard->oldest = entry->newer;
+}
+
+static void lru_push(memo_shard_t *shard, memo_entry_t *entry) {
+	entry->newer = NULL;
+	entry->older = shard->newest;
+	if (shard->newest)
+		shard->newest->newer = entry;
+	else
+		shard->oldest = entry;
+	shard->newest = entry;
+}
+
+static void evict_oldest(memo_shard_t *shard) {
+	memo_entry_t *entry = shard->oldest;
+	memo_entry_t **link = bucket_of(shard, entry->hash);
+	while (*link != entry)
+		link = &(*link)->chain;
+	*link = entry->chain;
+	lru_unlink(shard, entry);
+	shard->bytes -= entry->size;
+	free(entry);
+}
+
+// Put the machine into the state the entry recorded
+static void apply(const memo_entry_t *entry, chip8_t *chip8) {
+	chip8->regs = entry->regs;
+	chip8->dirty_rows |= entry->drawn;
+
+	const uint8_t *data = entry->data;
+	for (uint32_t rows = entry->changed; rows; rows &= rows - 1) {
+		memcpy(&chip8->display[__builtin_ctz(rows)], data, sizeof(uint64_t));
+		data += sizeof(uint64_t);
+	}
+	for (uint32_t run = 0; run < entry->ram_runs; run++) {
+		uint16_t addr, len;
+		memcpy(&addr, data, 2);
+		memcpy(&len, data + 2, 2);
+		for (uint16_t i = 0; i < len; i++)
+			store_ram(chip8, addr + i, data[4 + i]); // Copies shared pages
+		data += 4 + len;
+	}
+}
+
+// Record what the frame from `before` did to `after`. Ram that was
+// already the machine's own is written in place, so the ram from before
+// comes separately.
+static memo_entry_t *make_entry(const chip8_t *before,
+																const uint8_t before_ram[RAM_SIZE],
+																const chip8_t *after, uint32_t drawn) {
+	uint32_t changed = 0;
+	for (uint32_t y = 0; y < DISPLAY_H; y++)
+		changed |= (uint32_t)(before->display[y] != after->display[y]) << y;
+
+	// Ram changed only if its hash did; then find the changed spans
+	uint16_t runs = 0, ram_bytes = 0;
+	const bool ram_changed = before->ram_hash != after->ram_hash;
+	uint8_t after_ram[RAM_SIZE];
+	if (ram_changed)
+		copy_ram(after, after_ram);
+	for (uint32_t addr = 0; ram_changed && addr < RAM_SIZE;) {
+		if (before_ram[addr] == after_ram[addr]) {
+			addr++;
+			continue;
+		}
+		runs++;
+		while (addr < RAM_SIZE && before_ram[addr] != after_ram[addr]) {
+			ram_bytes++;
+			addr++;
+		}
+	}
+
+	const size_t data_size = __builtin_popcount(changed) * sizeof(uint64_t) +
+													 runs * 4u + ram_bytes;
+	memo_entry_t *entry = malloc(sizeof *entry + data_size);
+	if (!entry)
+		return NULL;
+	entry->size = sizeof *entry + data_size;
+	entry->regs = after->regs;
+	entry->drawn = drawn;
+	entry->changed = changed;
+	entry->ram_runs = runs;
+	entry->ram_bytes = ram_bytes;
+
+	uint8_t *data = entry->data;
+	for (uint32_t rows = changed; rows; rows &= rows - 1) {
+		memcpy(data, &after->display[__builtin_ctz(rows)], sizeof(uint64_t));
+		data += sizeof(uint64_t);
+	}
+	for (uint16_t addr = 0; ram_changed && addr < RAM_SIZE;) {
+		if (before_ram[addr] == after_ram[addr]) {
+			addr++;
+			continue;
+		}
+		uint16_t len = 0;
+		while (addr + len < RAM_SIZE &&
+					 before_ram[addr + len] != after_ram[addr + len])
+			len++;
+		memcpy(data, &addr, 2);
+		memcpy(data + 2, &len, 2);
+		memcpy(data + 4, &after_ram[addr], len);
+		data += 4 + len;
+		addr += len;
+	}
+	return entry;
+}
+
+void memo_frame(memo_t *memo, chip8_t *chip8, const config_t config) {
+	const uint64_t hash = state_hash(chip8);
+	const uint16_t keys = keypad_bits(chip8);
+	memo_shard_t *shard = &memo->shards[hash & (MEMO_SHARDS - 1)];
+
+	pthread_mutex_lock(&shard->lock);
+	for (memo_entry_t *entry = *bucket_of(shard, hash); entry;
+			 entry = entry->chain) {
+		if (entry->hash != hash || entry->keys != keys)
+			continue;
+		lru_unlink(shard, entry);
+		lru_push(shard, entry);
+		apply(entry, chip8);
+		pthread_mutex_unlock(&shard->lock);
+		atomic_fetch_add_explicit(&memo->hits, 1, memory_order_relaxed);
+		return;
+	}
+	pthread_mutex_unlock(&shard->lock);
+
+	// Miss: run the frame for real, watching for CXNN
+	const chip8_t before = *chip8;
+	uint8_t before_ram[RAM_SIZE];
+	copy_ram(chip8, before_ram);
+	chip8->dirty_rows = 0;
+	bool cacheable = true;
+	const uint32_t insts_per_frame = config.insts_per_second / 60;
+	for (uint32_t i = 0; i < insts_per_frame; i++) {
+		if ((read_ram(chip8, chip8->regs.PC) >> 4) == 0xC)
+			cacheable = false;
+		emulate_instruction(chip8, config);
+	}
+	const uint32_t drawn = chip8->dirty_rows;
+	chip8->dirty_rows |= before.dirty_rows;
+	if (!cacheable) {
+		atomic_fetch_add_explicit(&memo->uncacheable, 1, memory_order_relaxed);
+		return;
+	}
+	atomic_fetch_add_explicit(&memo->misses, 1, memory_order_relaxed);
+
+	memo_entry_t *entry = make_entry(&before, before_ram, chip8, drawn);
+	if (!entry || entry->size > memo->max_shard_bytes) {
+		free(entry);
+		return;
+	}
+	entry->hash = hash;
+	entry->keys = keys;
+
+	pthread_mutex_lock(&shard->lock);
+	memo_entry_t **bucket = bucket_of(shard, hash);
+	for (memo_entry_t *other = *bucket; other; other = other->chain)
+		if (other->hash == hash && other->keys == keys) {
+			// Another thread got there first
+			pthread_mutex_unlock(&shard->lock);
+			free(entry);
+			return;
+		}
+	while (shard->bytes + entry->size > memo->max_shard_bytes)
+		evict_oldest(shard);
+	entry->chain = *bucket;
+	*bucket = entry;
+	lru_push(shard, entry);
+	shard->bytes += entry->size;
+	pthread_mutex_unlock(&shard->lock);
+}
+
+void memo_report(memo_t *memo) {
+	size_t bytes = 0;
+	for (uint32_t i = 0; i < MEMO_SHARDS; i++)
+		bytes += memo->shards[i].bytes;
+	printf("memo: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+				 " uncacheable frames, %zu KiB cached\n",
+				 atomic_load(&memo->hits), atomic_load(&memo->misses),
+				 atomic_load(&memo->uncacheable), bytes / 1024);
+}
@@ -0,0 +1,59 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define MEMO_SHARDS 16				// Independently locked parts, must be a power of 2
+#define MEMO_BUCKETS 4096			// Hash chains per shard, must be a power of 2
+
+// What one frame of instructions did to a machine, replayed on a hit
+typedef struct memo_entry {
+	uint64_t hash; // Machine state before the frame
+	uint16_t keys; // Keypad during the frame, bit k = key k
+	struct memo_entry *chain;						 // Next in the bucket
+	struct memo_entry *newer, *older;		 // LRU list
+	size_t size;												 // Bytes charged to the shard
+
+	chip8_regs_t regs; // Registers after the frame, stored whole
+
+	uint32_t drawn;				// Rows drawn to, for dirty_rows
+	uint32_t changed;			// Rows whose value changed
+	uint16_t ram_runs;		// Changed spans of ram
+	uint16_t ram_bytes;
+	uint8_t data[];				// Changed rows as u64, then per run u16 addr, u16
+												// length and the bytes
+} memo_entry_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	memo_entry_t *buckets[MEMO_BUCKETS];
+	memo_entry_t *newest, *oldest;
+	size_t bytes;
+} memo_shard_t;
+
+// Frame memoisation cache. Attract modes and title screens run the same
+// frame from the same state over and over; with the keypad part of the key
+// such a frame is replayed from its stored effect instead of re-executed.
+// Frames that run CXNN depend on the machine's random state and are never
+// stored. Memory is bounded; each shard evicts its least recently used
+// entries.
+typedef struct {
+	memo_shard_t shards[MEMO_SHARDS];
+	size_t max_shard_bytes;
+	_Atomic uint64_t hits, misses, uncacheable;
+} memo_t;
+
+memo_t *memo_create(size_t max_bytes);
+void memo_destroy(memo_t *memo);
+// Emulate one 60hz frame worth of instructions, from the cache if it can.
+// Machines that are heard go through emulate_frame instead, since their
+// tone edges are stamped per instruction.
+void memo_frame(memo_t *memo, chip8_t *chip8, const config_t config);
+void memo_report(memo_t *memo);
+
+#endif
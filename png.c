@@ -0,0 +1,206 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "png.h"
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void make_crc_table(void) {
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+	for (size_t i = 0; i < len; i++)
+		crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+static void put_be32(uint8_t *out, uint32_t value) {
+	out[0] = value >> 24;
+	out[1] = value >> 16;
+	out[2] = value >> 8;
+	out[3] = value;
+}
+
+// Length, type, data and CRC of one chunk
+static bool write_chunk(FILE *file, const char type[4], const uint8_t *data,
+												uint32_t len) {
+	uint8_t head[8];
+	put_be32(&head[0], len);
+	memcpy(&head[4], type, 4);
+	uint8_t tail[4];
+	const uint32_t crc = crc32_update(0xFFFFFFFF, &head[4], 4);
+	put_be32(tail, ~crc32_update(crc, data, len));
+	return fwrite(head, 8, 1, file) == 1 &&
+				 (len == 0 || fwrite(data, len, 1, file) == 1) &&
+				 fwrite(tail, 4, 1, file) == 1;
+}
+
+// Deflate output, bits packed LSB first
+typedef struct {
+	uint8_t *out;
+	size_t len;
+	uint32_t bits;
+	uint32_t bit_count;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, uint32_t value, uint32_t count) {
+	w->bits |= value << w->bit_count;
+	w->bit_count += count;
+	while (w->bit_count >= 8) {
+		w->out[w->len++] = w->bits & 0xFF;
+		w->bits >>= 8;
+		w->bit_count -= 8;
+	}
+}
+
+// Huffman codes go out MSB first
+static void put_code(bit_writer_t *w, uint32_t code, uint32_t count) {
+	uint32_t reversed = 0;
+	for (uint32_t i = 0; i < count; i++)
+		reversed |= ((code >> i) & 1) << (count - 1 - i);
+	put_bits(w, reversed, count);
+}
+
+// Fixed literal/length code for symbol 0-287
+static void put_symbol(bit_writer_t *w, uint32_t sym) {
+	if (sym < 144)
+		put_code(w, 0x30 + sym, 8);
+	else if (sym < 256)
+		put_code(w, 0x190 + sym - 144, 9);
+	else if (sym < 280)
+		put_code(w, sym - 256, 7);
+	else
+		put_code(w, 0xC0 + sym - 280, 8);
+}
+
+static const uint16_t length_base[29] = {
+		3,	4,	5,	6,	7,	8,	9,	10, 11,	 13,	15,	 17,	19,	 23, 27,
+		31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+																				 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+																				 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+		1,		2,		3,		4,		5,		 7,			9,		 13,		17,		25,
+		33,		49,		65,		97,		129,	 193,		257,	 385,		513,	769,
+		1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2,	2,	3,	3,
+																			 4, 4, 5, 5, 6, 6, 7,	7,	8,	8,
+																			 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static void put_match(bit_writer_t *w, uint32_t len, uint32_t dist) {
+	uint32_t i = 28;
+	while (length_base[i] > len)
+		i--;
+	put_symbol(w, 257 + i);
+	put_bits(w, len - length_base[i], length_extra[i]);
+	uint32_t d = 29;
+	while (dist_base[d] > dist)
+		d--;
+	put_code(w, d, 5);
+	put_bits(w, dist - dist_base[d], dist_extra[d]);
+}
+
+static uint32_t match_length(const uint8_t *raw, size_t pos, size_t len,
+														 size_t dist) {
+	if (dist > pos || dist > 32768)
+		return 0;
+	uint32_t n = 0;
+	while (n < 258 && pos + n < len && raw[pos + n] == raw[pos + n - dist])
+		n++;
+	return n;
+}
+
+// One fixed Huffman block. Greedy: take the longer of a run of the
+// previous byte or a copy of the line above, else a literal.
+static void deflate_fixed(bit_writer_t *w, const uint8_t *raw, size_t len,
+													size_t line) {
+	put_bits(w, 1, 1); // Final block
+	put_bits(w, 1, 2); // Fixed Huffman codes
+	for (size_t pos = 0; pos < len;) {
+		const uint32_t run = match_length(raw, pos, len, 1);
+		const uint32_t up = match_length(raw, pos, len, line);
+		const uint32_t best = up >= run ? up : run;
+		if (best >= 3) {
+			put_match(w, best, up >= run ? line : 1);
+			pos += best;
+		} else {
+			put_symbol(w, raw[pos++]);
+		}
+	}
+	put_symbol(w, 256); // End of block
+	if (w->bit_count > 0)
+		put_bits(w, 0, 8 - w->bit_count);
+}
+
+static uint32_t adler32(const uint8_t *data, size_t len) {
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < len; i++) {
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return b << 16 | a;
+}
+
+bool png_write(const char *path, const uint8_t *bits, uint32_t width,
+							 uint32_t height, size_t stride, uint32_t fg_color,
+							 uint32_t bg_color) {
+	pthread_once(&crc_once, make_crc_table);
+
+	// Every line is preceded by filter type 0 (none)
+	const size_t line = (width + 7) / 8 + 1;
+	const size_t raw_len = line * height;
+	uint8_t *raw = malloc(raw_len);
+	// Worst case is 9 bits per byte, plus the zlib header and checksum
+	bit_writer_t w = {.out = malloc(raw_len + raw_len / 8 + 16)};
+	if (!raw || !w.out) {
+		free(raw);
+		free(w.out);
+		return false;
+	}
+	for (uint32_t y = 0; y < height; y++) {
+		raw[y * line] = 0;
+		memcpy(&raw[y * line + 1], &bits[y * stride], line - 1);
+	}
+
+	w.out[w.len++] = 0x78; // Deflate, 32K window
+	w.out[w.len++] = 0x01; // No dictionary, fastest
+	deflate_fixed(&w, raw, raw_len, line);
+	put_be32(&w.out[w.len], adler32(raw, raw_len));
+	w.len += 4;
+	free(raw);
+
+	uint8_t ihdr[13];
+	put_be32(&ihdr[0], width);
+	put_be32(&ihdr[4], height);
+	ihdr[8] = 1;	// Bit depth
+	ihdr[9] = 3;	// Palette colour
+	ihdr[10] = 0; // Deflate
+	ihdr[11] = 0; // Adaptive filtering
+	ihdr[12] = 0; // Not interlaced
+	const uint8_t plte[6] = {bg_color >> 24, bg_color >> 16, bg_color >> 8,
+													 fg_color >> 24, fg_color >> 16, fg_color >> 8};
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		free(w.out);
+		return false;
+	}
+	bool ok = fwrite("\x89PNG\r\n\x1A\n", 8, 1, file) == 1 &&
+						write_chunk(file, "IHDR", ihdr, sizeof ihdr) &&
+						write_chunk(file, "PLTE", plte, sizeof plte) &&
+						write_chunk(file, "IDAT", w.out, (uint32_t)w.len) &&
+						write_chunk(file, "IEND", NULL, 0);
+	free(w.out);
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
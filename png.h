@@ -0,0 +1,20 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal PNG writer for 2 colour images. Pixels stay packed 1 bit per
+// pixel, MSB first like the CHIP8 display rows, and are written as a
+// 1 bit palette image. The zlib stream uses fixed Huffman codes with
+// matches against the previous byte (runs) and the line above only, which
+// is most of what a CHIP8 screen compresses to and costs no tables.
+//
+// `bits` holds `height` lines of `stride` bytes, each at least
+// (width + 7) / 8 bytes long. Colours are RGBA8888.
+bool png_write(const char *path, const uint8_t *bits, uint32_t width,
+							 uint32_t height, size_t stride, uint32_t fg_color,
+							 uint32_t bg_color);
+
+#endif
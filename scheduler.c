@@ -0,0 +1,452 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+static uint16_t opcode_at(const chip8_t *chip8, uint16_t addr) {
+	return read_ram(chip8, addr) << 8 | read_ram(chip8, addr + 1);
+}
+
+static bool any_key(const chip8_t *chip8) {
+	for (uint8_t i = 0; i < sizeof chip8->keypad; i++)
+		if (chip8->keypad[i])
+			return true;
+	return false;
+}
+
+// What the machine waits for if the instruction at PC leaves it exactly as
+// it is, so every frame from here on would too: FX0A with no key down, or
+// a jump to itself
+static task_wait_t fixed_point(const chip8_t *chip8) {
+	const uint16_t pc = chip8->regs.PC;
+	const uint16_t opcode = opcode_at(chip8, pc);
+	switch (opcode >> 12) {
+	case 0x1:
+		return (opcode & 0x0FFF) == pc ? TASK_HALTED : TASK_RUNNABLE;
+	case 0xB:
+		return (opcode & 0x0FFF) + chip8->regs.V[0] == pc ? TASK_HALTED
+																											 : TASK_RUNNABLE;
+	case 0xF:
+		return (opcode & 0xFF) == 0x0A && !any_key(chip8) ? TASK_KEY_WAIT
+																											 : TASK_RUNNABLE;
+	}
+	return TASK_RUNNABLE;
+}
+
+// Start of the `FX07; 3X00; 1NNN` loop (read the delay timer until it is 0)
+// PC is in and still going round, or -1
+static int delay_loop(const chip8_t *chip8, uint8_t *x) {
+	for (uint16_t back = 0; back <= 4; back += 2) {
+		const uint16_t start = chip8->regs.PC - back;
+		const uint16_t load = opcode_at(chip8, start);
+		if (start > 0x0FFF || (load & 0xF0FF) != 0xF007 ||
+				opcode_at(chip8, start + 2) != (0x3000 | (load & 0x0F00)) ||
+				opcode_at(chip8, start + 4) != (0x1000 | start))
+			continue;
+		*x = (load >> 8) & 0x0F;
+		// About to test a register that already read 0 and leave
+		if (back == 2 && chip8->regs.V[*x] == 0)
+			return -1;
+		return start;
+	}
+	return -1;
+}
+
+static void push_list(sched_task_t **list, sched_task_t *task) {
+	task->next = *list;
+	if (*list)
+		(*list)->pprev = &task->next;
+	*list = task;
+	task->pprev = list;
+}
+
+static void unlink_task(sched_task_t *task) {
+	if (!task->pprev)
+		return; // Halted tasks are on no list
+	*task->pprev = task->next;
+	if (task->next)
+		task->next->pprev = task->pprev;
+	task->next = NULL;
+	task->pprev = NULL;
+}
+
+// Advance a machine blocked on `wait` by `frames` frames without running
+// them. Only the timers run; a delay loop also goes round once per
+// instruction, last reading the timer as it was at the start of the last
+// frame.
+static void skip_frames(const sched_t *sched, chip8_t *chip8, task_wait_t wait,
+												uint64_t frames) {
+	if (frames == 0)
+		return;
+	if (wait == TASK_TIMER_WAIT) {
+		uint8_t x;
+		const int start = delay_loop(chip8, &x);
+		const uint64_t insts = frames * (sched->config.insts_per_second / 60);
+		chip8->regs.PC = start + 2 * (((chip8->regs.PC - start) / 2 + insts) % 3);
+		chip8->regs.V[x] = chip8->regs.delay_timer - frames + 1;
+	}
+	chip8->regs.delay_timer -= frames < chip8->regs.delay_timer
+																 ? frames
+																 : chip8->regs.delay_timer;
+	chip8->regs.sound_timer -= frames < chip8->regs.sound_timer
+																 ? frames
+																 : chip8->regs.sound_timer;
+}
+
+// Bring a parked machine to where the frames it skipped since it was last
+// brought up to date would have left it
+static void catch_up(sched_t *sched, sched_task_t *task) {
+	const uint64_t skipped = sched->frame - 1 - task->parked_frame;
+	skip_frames(sched, task->chip8, task->wait, skipped);
+	task->parked_frame += skipped;
+	sched->workers[task->worker].skipped += skipped;
+}
+
+// Onto the run queue of the worker it last ran on, for the next frame
+static void requeue(sched_t *sched, sched_task_t *task) {
+	sched_worker_t *worker = &sched->workers[task->worker];
+	unlink_task(task);
+	task->wait = TASK_RUNNABLE;
+	worker->next[worker->next_count++] = task;
+}
+
+// Off the run queue for the next frame, where runnable tasks wait between
+// frames
+static void dequeue(sched_t *sched, sched_task_t *task) {
+	sched_worker_t *worker = &sched->workers[task->worker];
+	for (uint32_t i = 0; i < worker->next_count; i++) {
+		if (worker->next[i] == task) {
+			worker->next[i] = worker->next[--worker->next_count];
+			return;
+		}
+	}
+}
+
+// One frame of the task, then either back on the queue for the next or
+// parked on what it blocks on
+static void run_task(sched_t *sched, sched_worker_t *worker,
+										 sched_task_t *task) {
+	chip8_t *chip8 = task->chip8;
+	const uint32_t index = worker - sched->workers;
+	if (task->worker != index) {
+		task->worker = index;
+		chip8->page_arena = worker->pages; // Arenas are per thread
+	}
+	const uint32_t insts_per_frame = sched->config.insts_per_second / 60;
+	if (sched->memo) {
+		memo_frame(sched->memo, chip8, sched->config);
+	} else {
+		for (uint32_t i = 0; i < insts_per_frame; i++) {
+			const uint16_t pc = chip8->regs.PC;
+			emulate_instruction(chip8, sched->config);
+			// Blocked for the rest of the frame, so yield now
+			if (chip8->regs.PC == pc && fixed_point(chip8) != TASK_RUNNABLE)
+				break;
+		}
+	}
+	if (chip8->regs.delay_timer > 0)
+		chip8->regs.delay_timer--;
+	if (chip8->regs.sound_timer > 0)
+		chip8->regs.sound_timer--;
+	worker->ran++;
+
+	task->parked_frame = sched->frame;
+	task_wait_t wait = fixed_point(chip8);
+	uint8_t x;
+	if (wait == TASK_RUNNABLE && chip8->regs.delay_timer > 0 &&
+			insts_per_frame >= 3 && delay_loop(chip8, &x) >= 0)
+		wait = TASK_TIMER_WAIT; // Goes round for delay_timer more frames
+
+	if (task->budget != SCHED_FOREVER) {
+		// Stepped: nothing can change while the frames are run, so the
+		// blocked ones are skipped right away
+		uint32_t frames = --task->budget;
+		if (wait == TASK_TIMER_WAIT && chip8->regs.delay_timer < frames)
+			frames = chip8->regs.delay_timer;
+		if (wait != TASK_RUNNABLE) {
+			skip_frames(sched, chip8, wait, frames);
+			task->budget -= frames;
+			worker->skipped += frames;
+		}
+		if (task->budget) {
+			task->wait = TASK_RUNNABLE;
+			worker->next[worker->next_count++] = task;
+		} else {
+			task->wait = TASK_IDLE;
+			if (sched->on_idle)
+				sched->on_idle(task, sched->on_idle_arg);
+		}
+		return;
+	}
+
+	task->wait = wait;
+	if (wait == TASK_TIMER_WAIT) {
+		// Wakes to read 0
+		const uint64_t wake = sched->frame + chip8->regs.delay_timer + 1;
+		push_list(&worker->wheel[wake % SCHED_WHEEL], task);
+	} else if (wait == TASK_KEY_WAIT) {
+		push_list(&worker->key_waits, task);
+	} else if (task->wait == TASK_RUNNABLE) {
+		worker->next[worker->next_count++] = task;
+		return;
+	}
+	worker->parked++;
+}
+
+// Move half of another worker's remaining tasks onto the thief's empty
+// queue. Only one queue is locked at a time; while the thief's is empty
+// nobody else reads the slots being filled.
+static bool steal(sched_t *sched, sched_worker_t *thief) {
+	const uint32_t index = thief - sched->workers;
+	for (uint32_t i = 1; i < sched->worker_count; i++) {
+		sched_worker_t *victim = &sched->workers[(index + i) % sched->worker_count];
+		pthread_mutex_lock(&victim->lock);
+		const uint32_t count = (victim->tail - victim->head + 1) / 2;
+		victim->tail -= count;
+		memcpy(thief->queue, &victim->queue[victim->tail],
+					 count * sizeof *thief->queue);
+		pthread_mutex_unlock(&victim->lock);
+		if (count == 0)
+			continue;
+		pthread_mutex_lock(&thief->lock);
+		thief->head = 0;
+		thief->tail = count;
+		pthread_mutex_unlock(&thief->lock);
+		thief->stolen += count;
+		return true;
+	}
+	return false;
+}
+
+// Run tasks off the worker's own queue a batch at a time, then off the
+// others', until there are none left this frame
+static void work(sched_t *sched, sched_worker_t *worker) {
+	for (;;) {
+		pthread_mutex_lock(&worker->lock);
+		const uint32_t start = worker->head;
+		uint32_t count = worker->tail - start;
+		if (count > SCHED_BATCH)
+			count = SCHED_BATCH;
+		worker->head += count;
+		pthread_mutex_unlock(&worker->lock);
+		if (count == 0) {
+			if (!steal(sched, worker))
+				return;
+			continue;
+		}
+		for (uint32_t i = 0; i < count; i++)
+			run_task(sched, worker, worker->queue[start + i]);
+	}
+}
+
+static void *worker_main(void *arg) {
+	sched_worker_t *worker = arg;
+	sched_t *sched = worker->sched;
+	uint64_t seen = 0;
+	for (;;) {
+		pthread_mutex_lock(&sched->lock);
+		while (sched->generation == seen && !sched->quit)
+			pthread_cond_wait(&sched->start, &sched->lock);
+		if (sched->quit) {
+			pthread_mutex_unlock(&sched->lock);
+			return NULL;
+		}
+		seen = sched->generation;
+		pthread_mutex_unlock(&sched->lock);
+
+		work(sched, worker);
+
+		pthread_mutex_lock(&sched->lock);
+		if (--sched->busy == 0)
+			pthread_cond_signal(&sched->done);
+		pthread_mutex_unlock(&sched->lock);
+	}
+}
+
+sched_t *sched_create(chip8_t *machines, uint32_t count, const config_t config,
+											memo_t *memo, arena_t *pages, uint32_t workers,
+											bool stepped) {
+	if (workers == 0)
+		return NULL;
+	sched_t *sched = calloc(1, sizeof *sched);
+	if (!sched)
+		return NULL;
+	sched->config = config;
+	sched->memo = memo;
+	sched->task_count = count;
+	sched->tasks = calloc(count, sizeof *sched->tasks);
+	sched->workers = calloc(workers, sizeof *sched->workers);
+	pthread_mutex_init(&sched->lock, NULL);
+	pthread_cond_init(&sched->start, NULL);
+	pthread_cond_init(&sched->done, NULL);
+	if (!sched->tasks || !sched->workers) {
+		sched_destroy(sched);
+		return NULL;
+	}
+	// Fewer threads than asked for just means fewer workers
+	for (uint32_t w = 0; w < workers; w++) {
+		sched_worker_t *worker = &sched->workers[w];
+		worker->sched = sched;
+		worker->pages = &pages[w];
+		worker->queue = calloc(count ? count : 1, sizeof *worker->queue);
+		worker->next = calloc(count ? count : 1, sizeof *worker->next);
+		pthread_mutex_init(&worker->lock, NULL);
+		if (!worker->queue || !worker->next ||
+				(w > 0 &&
+				 pthread_create(&worker->thread, NULL, worker_main, worker) != 0)) {
+			pthread_mutex_destroy(&worker->lock);
+			free(worker->queue);
+			free(worker->next);
+			break;
+		}
+		sched->worker_count++;
+	}
+	if (sched->worker_count == 0) {
+		sched_destroy(sched);
+		return NULL;
+	}
+
+	// Neighbouring machines start on the same worker
+	for (uint32_t i = 0; i < count; i++) {
+		sched_task_t *task = &sched->tasks[i];
+		task->chip8 = &machines[i];
+		task->worker = (uint64_t)i * sched->worker_count / count;
+		task->chip8->page_arena = sched->workers[task->worker].pages;
+		if (stepped) {
+			task->wait = TASK_IDLE;
+			continue;
+		}
+		task->budget = SCHED_FOREVER;
+		sched_worker_t *worker = &sched->workers[task->worker];
+		worker->next[worker->next_count++] = task;
+	}
+	return sched;
+}
+
+void sched_destroy(sched_t *sched) {
+	pthread_mutex_lock(&sched->lock);
+	sched->quit = true;
+	pthread_cond_broadcast(&sched->start);
+	pthread_mutex_unlock(&sched->lock);
+	for (uint32_t w = 0; w < sched->worker_count; w++) {
+		sched_worker_t *worker = &sched->workers[w];
+		if (w > 0)
+			pthread_join(worker->thread, NULL);
+		pthread_mutex_destroy(&worker->lock);
+		free(worker->queue);
+		free(worker->next);
+	}
+	pthread_mutex_destroy(&sched->lock);
+	pthread_cond_destroy(&sched->start);
+	pthread_cond_destroy(&sched->done);
+	free(sched->workers);
+	free(sched->tasks);
+	free(sched);
+}
+
+uint32_t sched_frame(sched_t *sched) {
+	for (uint32_t w = 0; w < sched->worker_count; w++) {
+		sched_worker_t *worker = &sched->workers[w];
+		sched_task_t **slot = &worker->wheel[sched->frame % SCHED_WHEEL];
+		while (*slot) {
+			catch_up(sched, *slot);
+			requeue(sched, *slot);
+		}
+		// Last frame's yields are this frame's queue
+		sched_task_t **queue = worker->queue;
+		worker->queue = worker->next;
+		worker->next = queue;
+		worker->head = 0;
+		worker->tail = worker->next_count;
+		worker->next_count = 0;
+	}
+
+	pthread_mutex_lock(&sched->lock);
+	sched->busy = sched->worker_count - 1;
+	sched->generation++;
+	pthread_cond_broadcast(&sched->start);
+	pthread_mutex_unlock(&sched->lock);
+
+	work(sched, &sched->workers[0]);
+
+	pthread_mutex_lock(&sched->lock);
+	while (sched->busy > 0)
+		pthread_cond_wait(&sched->done, &sched->lock);
+	pthread_mutex_unlock(&sched->lock);
+	sched->frame++;
+
+	uint32_t queued = 0;
+	for (uint32_t w = 0; w < sched->worker_count; w++)
+		queued += sched->workers[w].next_count;
+	return queued;
+}
+
+void sched_set_keys(sched_t *sched, sched_task_t *task, const bool keys[16]) {
+	memcpy(task->chip8->keypad, keys, sizeof task->chip8->keypad);
+	if (task->wait == TASK_KEY_WAIT && any_key(task->chip8)) {
+		catch_up(sched, task);
+		requeue(sched, task);
+	}
+}
+
+void sched_sync(sched_t *sched, sched_task_t *task) {
+	// Idle tasks skip their blocked frames as they run them, so are already
+	// where they stopped
+	if (task->wait != TASK_RUNNABLE && task->wait != TASK_IDLE)
+		catch_up(sched, task);
+}
+
+void sched_wake(sched_t *sched, sched_task_t *task) {
+	if (task->wait != TASK_RUNNABLE && task->wait != TASK_IDLE)
+		requeue(sched, task);
+}
+
+uint32_t sched_step(sched_t *sched, sched_task_t *task, uint32_t frames) {
+	if (task->budget == SCHED_FOREVER)
+		return 0;
+	if (frames > SCHED_FOREVER - 1 - task->budget)
+		frames = SCHED_FOREVER - 1 - task->budget;
+	if (frames == 0)
+		return 0;
+	task->budget += frames;
+	if (task->wait == TASK_IDLE)
+		requeue(sched, task);
+	return frames;
+}
+
+void sched_spawn(sched_t *sched, sched_task_t *task, const boot_image_t *image,
+								 uint64_t seed) {
+	boot_image_reset(image, task->chip8, seed);
+	task->chip8->page_arena = sched->workers[task->worker].pages;
+	if (task->budget != SCHED_FOREVER) {
+		// Still queued with frames left: they are dropped
+		if (task->wait == TASK_RUNNABLE)
+			dequeue(sched, task);
+		task->budget = 0;
+		unlink_task(task);
+		task->wait = TASK_IDLE;
+	} else {
+		sched_wake(sched, task);
+	}
+}
+
+void sched_report(sched_t *sched) {
+	uint64_t ran = 0, skipped = 0, stolen = 0, parked = 0;
+	for (uint32_t w = 0; w < sched->worker_count; w++) {
+		ran += sched->workers[w].ran;
+		skipped += sched->workers[w].skipped;
+		stolen += sched->workers[w].stolen;
+		parked += sched->workers[w].parked;
+	}
+	uint32_t waiting[TASK_IDLE + 1] = {0};
+	for (uint32_t i = 0; i < sched->task_count; i++)
+		waiting[sched->tasks[i].wait]++;
+	printf("sched: %u workers ran %" PRIu64 " task frames and skipped %" PRIu64
+				 ", %" PRIu64 " stolen, %" PRIu64 " parks; now %u waiting on keys, %u "
+				 "on timers, %u halted\n",
+				 sched->worker_count, ran, skipped, stolen, parked,
+				 waiting[TASK_KEY_WAIT], waiting[TASK_TIMER_WAIT],
+				 waiting[TASK_HALTED]);
+}
@@ -0,0 +1,114 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "chip8.h"
+#include "memo.h"
+
+#define SCHED_WHEEL 256 // Timer wheel slots; a delay timer runs out within 255
+#define SCHED_BATCH 16	// Tasks a worker takes off its own queue at once
+#define SCHED_FOREVER UINT32_MAX // Budget of tasks that run every frame
+
+// Why a task is off the run queues
+typedef enum {
+	TASK_RUNNABLE,
+	TASK_KEY_WAIT,	 // FX0A with no key down, until the keypad changes
+	TASK_TIMER_WAIT, // Spinning on the delay timer, until it runs out
+	TASK_HALTED,		 // Jumped to itself, until woken
+	TASK_IDLE,			 // Stepped and out of frames, until stepped again
+} task_wait_t;
+
+// A machine as a resumable task. Everything it needs to carry on is in the
+// machine itself, so it yields at every frame boundary, and at a blocking
+// point parks until whatever it waits for happens, at no cost per frame.
+// Stepped tasks only run the frames they are given and skip blocked ones
+// on the spot instead.
+typedef struct sched_task {
+	chip8_t *chip8;
+	uint32_t budget; // Frames left to run, SCHED_FOREVER when not stepped
+	struct sched_task *next, **pprev; // Wait list, while parked
+	uint64_t parked_frame;						// Last frame run before parking
+	task_wait_t wait;
+	uint32_t worker; // Last ran on, whose queue it goes back to
+} sched_task_t;
+
+typedef struct sched sched_t;
+
+typedef struct {
+	sched_t *sched;
+	pthread_mutex_t lock; // Guards head and tail against thieves
+	sched_task_t **queue; // This frame's tasks, taken from the head and
+	uint32_t head, tail;	// stolen from the tail
+	sched_task_t **next;	// Tasks to run next frame
+	uint32_t next_count;
+	sched_task_t *key_waits;					 // Parked until the keypad changes
+	sched_task_t *wheel[SCHED_WHEEL]; // Parked until the frame of their slot
+	arena_t *pages;										 // Ram pages copied by tasks run here
+	uint64_t ran, skipped, stolen, parked;
+	pthread_t thread;
+} sched_worker_t;
+
+// Runs machines a frame at a time on a pool of workers, each with its own
+// run queue; a worker that runs out steals half of another's. Machines
+// blocked on FX0A, spinning on the delay timer or halted are parked on the
+// worker's key list or timer wheel and skipped until woken, their timers
+// caught up on waking. Tasks park and wake only between frames or on the
+// worker running them, so the wait lists need no locks.
+struct sched {
+	config_t config;
+	memo_t *memo; // Frame cache shared by the workers, or NULL
+	sched_task_t *tasks;
+	uint32_t task_count;
+	sched_worker_t *workers;
+	uint32_t worker_count;
+	uint64_t frame; // Frames run so far
+	// Called on the worker when a stepped task runs out of frames, eg. to
+	// read its machine while still in that worker's cache. It may respawn
+	// the machine but not touch the scheduler.
+	void (*on_idle)(sched_task_t *task, void *arg);
+	void *on_idle_arg;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	uint64_t generation; // Bumped to start a frame on the other workers
+	uint32_t busy;			 // Workers still in this frame
+	bool quit;
+};
+
+// One worker per page arena; the first is the calling thread. Copied ram
+// pages come from the arena of the worker that copies them, so the arenas
+// must outlive the machines. Tasks run every frame from the start, or
+// with `stepped` wait idle for sched_step.
+sched_t *sched_create(chip8_t *machines, uint32_t count, const config_t config,
+											memo_t *memo, arena_t *pages, uint32_t workers,
+											bool stepped);
+void sched_destroy(sched_t *sched);
+// Run one 60hz frame of every task that is not parked, and wake those
+// whose timer runs out, then return once all are done. Returns how many
+// tasks are queued for the next frame.
+uint32_t sched_frame(sched_t *sched);
+// Between frames only: press and release keys, waking the task if it waits
+// for them
+void sched_set_keys(sched_t *sched, sched_task_t *task, const bool keys[16]);
+// Between frames only: bring a parked task's machine to where the frames
+// it skipped would have left it, eg. before reading its timers or
+// snapshotting it. Its display and ram are always up to date. Stepped
+// tasks are always up to date between frames.
+void sched_sync(sched_t *sched, sched_task_t *task);
+// Between frames only: put a parked task back on the run queues as it is,
+// without catching up, eg. after its machine has been reset
+void sched_wake(sched_t *sched, sched_task_t *task);
+// Between frames only: give a stepped task `frames` more frames to run.
+// Returns how many it got, fewer if its budget would reach SCHED_FOREVER.
+uint32_t sched_step(sched_t *sched, sched_task_t *task, uint32_t frames);
+// Between frames only: release the task's machine and start it afresh
+// from `image` and `seed`, dropping whatever it waited for and any frames
+// left
+void sched_spawn(sched_t *sched, sched_task_t *task, const boot_image_t *image,
+								 uint64_t seed);
+void sched_report(sched_t *sched);
+
+#endif
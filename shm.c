@@ -0,0 +1,90 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+bool shm_export_open(shm_export_t *export, const char *name) {
+	return shm_export_open_slots(export, name, 1);
+}
+
+// Create (or replace) the shared memory object `name`, or "/chip8-<pid>" when
+// name is NULL so several instances can run side by side
+bool shm_export_open_slots(shm_export_t *export, const char *name,
+													 uint32_t slots) {
+	if (slots == 0)
+		return false;
+	if (name)
+		snprintf(export->name, sizeof export->name, "%s", name);
+	else
+		snprintf(export->name, sizeof export->name, "/chip8-%ld", (long)getpid());
+	export->frame = 0;
+	export->slots = slots;
+
+	const size_t size = slots * sizeof(chip8_shm_t);
+	const int fd = shm_open(export->name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		shm_unlink(export->name);
+		return false;
+	}
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd); // The mapping keeps the object alive
+	if (map == MAP_FAILED) {
+		shm_unlink(export->name);
+		return false;
+	}
+
+	export->shm = map;
+	memset(export->shm, 0, size);
+	for (uint32_t i = 0; i < slots; i++) {
+		export->shm[i].magic = CHIP8_SHM_MAGIC;
+		export->shm[i].version = CHIP8_SHM_VERSION;
+	}
+	return true;
+}
+
+void shm_export_publish(shm_export_t *export, const chip8_t *chip8) {
+	shm_publish(export->shm, chip8, export->frame++, true);
+}
+
+// Writer half of a seqlock: readers see an odd sequence number while the
+// copy is in progress and retry. Never blocks.
+void shm_publish(chip8_shm_t *shm, const chip8_t *chip8, uint64_t frame,
+								 bool full) {
+	const uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+	atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	shm->frame = frame;
+	memcpy(shm->display, chip8->display, sizeof shm->display);
+	if (!full) {
+		atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+		return;
+	}
+	shm->I = chip8->regs.I;
+	shm->PC = chip8->regs.PC;
+	memcpy(shm->stack, chip8->regs.stack, sizeof shm->stack);
+	shm->stack_index = chip8->regs.sp;
+	shm->delay_timer = chip8->regs.delay_timer;
+	shm->sound_timer = chip8->regs.sound_timer;
+	shm->state = chip8->state;
+	memcpy(shm->V, chip8->regs.V, sizeof shm->V);
+	for (int i = 0; i < 16; i++)
+		shm->keypad[i] = chip8->keypad[i];
+	copy_ram(chip8, shm->ram);
+
+	atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+}
+
+void shm_export_close(shm_export_t *export) {
+	munmap(export->shm, export->slots * sizeof *export->shm);
+	shm_unlink(export->name);
+	export->shm = NULL;
+}
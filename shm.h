@@ -0,0 +1,30 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_shm.h"
+
+// Emulator side of the shared memory export: one chip8_shm_t, or an array
+// of them with one slot per machine
+typedef struct {
+	chip8_shm_t *shm;
+	uint32_t slots;
+	char name[64];
+	uint64_t frame;
+} shm_export_t;
+
+bool shm_export_open(shm_export_t *export, const char *name);
+bool shm_export_open_slots(shm_export_t *export, const char *name,
+													 uint32_t slots);
+// Publish the first slot, counting frames
+void shm_export_publish(shm_export_t *export, const chip8_t *chip8);
+// Publish one slot: the frame number and display, and with `full` the
+// registers, keypad and ram too
+void shm_publish(chip8_shm_t *slot, const chip8_t *chip8, uint64_t frame,
+								 bool full);
+void shm_export_close(shm_export_t *export);
+
+#endif
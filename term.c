@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "term.h"
+
+static void out_str(term_t *term, const char *str) {
+	const size_t len = strlen(str);
+	memcpy(&term->out[term->out_len], str, len);
+	term->out_len += len;
+}
+
+static void flush_out(term_t *term) {
+	const char *data = term->out;
+	uint32_t len = term->out_len;
+	while (len > 0) {
+		const ssize_t n = write(STDOUT_FILENO, data, len);
+		if (n <= 0)
+			break;
+		data += n;
+		len -= n;
+	}
+	term->out_len = 0;
+}
+
+// UTF-8 encode a BMP code point
+static void out_glyph(term_t *term, uint32_t code_point) {
+	char *out = &term->out[term->out_len];
+	out[0] = 0xE0 | (code_point >> 12);
+	out[1] = 0x80 | ((code_point >> 6) & 0x3F);
+	out[2] = 0x80 | (code_point & 0x3F);
+	term->out_len += 3;
+}
+
+// Switch to the alternate screen in raw mode and paint in fg/bg colours
+bool term_init(term_t *term, term_mode_t mode, const config_t config) {
+	memset(term, 0, sizeof *term);
+	term->mode = mode;
+	term->cols = mode == TERM_HALF ? 64 : 32;
+	term->rows = mode == TERM_HALF ? 16 : 8;
+	memset(term->cells, 0xFF, sizeof term->cells);
+
+	if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &term->saved) != 0)
+		return false;
+	struct termios raw = term->saved;
+	raw.c_iflag &= ~(ICRNL | IXON | ISTRIP);
+	raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+	raw.c_cc[VMIN] = 0; // Reads return immediately
+	raw.c_cc[VTIME] = 0;
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0)
+		return false;
+
+	char colors[64];
+	snprintf(colors, sizeof colors, "\x1b[38;2;%u;%u;%um\x1b[48;2;%u;%u;%um",
+					 (config.fg_color >> 24) & 0xFF, (config.fg_color >> 16) & 0xFF,
+					 (config.fg_color >> 8) & 0xFF, (config.bg_color >> 24) & 0xFF,
+					 (config.bg_color >> 16) & 0xFF, (config.bg_color >> 8) & 0xFF);
+	out_str(term, "\x1b[?1049h\x1b[?25l"); // Alternate screen, hide cursor
+	out_str(term, colors);
+	out_str(term, "\x1b[2J");
+	flush_out(term);
+	return true;
+}
+
+// Glyph for the cell at (col, row): bit pattern of the pixels it covers
+static uint16_t cell_bits(const term_t *term, const uint64_t display[32],
+													uint32_t col, uint32_t row) {
+	if (term->mode == TERM_HALF) {
+		const uint32_t top = (display[row * 2] >> (63 - col)) & 1;
+		const uint32_t bottom = (display[row * 2 + 1] >> (63 - col)) & 1;
+		return top | bottom << 1;
+	}
+
+	// Braille dot numbering: 1 2 3 7 down the left, 4 5 6 8 down the right
+	static const uint8_t dots[4][2] = {
+			{0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}};
+	uint16_t bits = 0;
+	for (uint32_t y = 0; y < 4; y++) {
+		const uint64_t line = display[row * 4 + y];
+		for (uint32_t x = 0; x < 2; x++)
+			if ((line >> (63 - (col * 2 + x))) & 1)
+				bits |= dots[y][x];
+	}
+	return bits;
+}
+
+// Redraw only the cells that differ from what's on screen. The cursor is
+// only repositioned when the next changed cell isn't the one right after
+// the last cell written on the same row; past the last column it stays on
+// that row.
+void term_present(term_t *term, const chip8_t *chip8) {
+	static const uint16_t half_blocks[4] = {' ', 0x2580, 0x2584, 0x2588};
+	uint32_t cursor = UINT32_MAX; // Cell index the cursor is at
+
+	for (uint32_t row = 0; row < term->rows; row++) {
+		for (uint32_t col = 0; col < term->cols; col++) {
+			const uint32_t index = row * term->cols + col;
+			const uint16_t bits = cell_bits(term, chip8->display, col, row);
+			if (bits == term->cells[index])
+				continue;
+			term->cells[index] = bits;
+
+			if (cursor != index) {
+				char move[32];
+				snprintf(move, sizeof move, "\x1b[%u;%uH", row + 1, col + 1);
+				out_str(term, move);
+			}
+			if (term->mode == TERM_HALF) {
+				if (bits == 0)
+					out_str(term, " ");
+				else
+					out_glyph(term, half_blocks[bits]);
+			} else {
+				out_glyph(term, 0x2800 + bits);
+			}
+			cursor = col + 1 < term->cols ? index + 1 : UINT32_MAX;
+		}
+	}
+
+	// Ring the terminal bell when the sound timer starts
+	const bool tone = chip8->regs.sound_timer > 0;
+	if (tone && !term->tone)
+		out_str(term, "\a");
+	term->tone = tone;
+
+	if (term->out_len > 0)
+		flush_out(term);
+}
+
+// Read pending keystrokes. Terminals don't report key releases, so a key
+// stays down for TERM_KEY_HOLD frames after its last keystroke; holding a
+// key keeps it down through auto repeat.
+void term_poll(term_t *term, chip8_t *chip8) {
+	static const char layout[] = "x123qweasdzc4rfv"; // Index is CHIP8 key
+	for (int i = 0; i < 16; i++) {
+		if (term->key_hold[i] > 0 && --term->key_hold[i] == 0)
+			chip8->keypad[i] = false;
+	}
+
+	char input[64];
+	const ssize_t n = read(STDIN_FILENO, input, sizeof input);
+	for (ssize_t i = 0; i < n; i++) {
+		char c = input[i];
+		if (c == 0x03 || (c == 0x1B && n == 1)) {
+			// Ctrl-C or a lone escape (not the start of a sequence)
+			chip8->state = QUIT;
+			return;
+		}
+		if (c == ' ') {
+			chip8->state = chip8->state == RUNNING ? PAUSED : RUNNING;
+			continue;
+		}
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		const char *key = strchr(layout, c);
+		if (key && c) {
+			chip8->keypad[key - layout] = true;
+			term->key_hold[key - layout] = TERM_KEY_HOLD;
+		}
+	}
+}
+
+void term_cleanup(term_t *term) {
+	out_str(term, "\x1b[0m\x1b[?25h\x1b[?1049l"); // Reset colours, show cursor
+	flush_out(term);
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &term->saved);
+}
+
+// Backend wrapper: the terminal bell stands in for the tone, so the audio
+// ring is just drained on the emulated clock
+typedef struct {
+	term_t term;
+	audio_sink_t sink;
+} term_state_t;
+
+static void *term_backend_init(const config_t config, audio_t *audio) {
+	term_state_t *state = malloc(sizeof *state);
+	if (!state)
+		return NULL;
+	if (!term_init(&state->term, config.term_braille ? TERM_BRAILLE : TERM_HALF,
+								 config)) {
+		fprintf(stderr, "Could not put the terminal in raw mode\n");
+		free(state);
+		return NULL;
+	}
+	audio_init(audio, config.audio_sample_rate, config.square_wave_freq,
+						 config.volume, 0);
+	audio_sink_init(&state->sink, NULL);
+	return state;
+}
+
+static void term_backend_poll(void *state, chip8_t *chip8) {
+	term_poll(&((term_state_t *)state)->term, chip8);
+}
+
+// Cells are diffed against the screen, so dirty rows aren't needed
+static void term_backend_present(void *state, const chip8_t *chip8,
+																 uint32_t dirty_rows) {
+	(void)dirty_rows;
+	term_present(&((term_state_t *)state)->term, chip8);
+}
+
+static void term_backend_end_frame(void *state, audio_t *audio) {
+	audio_sink_frame(audio, &((term_state_t *)state)->sink);
+}
+
+static bool term_backend_cleanup(void *state) {
+	term_cleanup(&((term_state_t *)state)->term);
+	free(state);
+	return true;
+}
+
+const backend_t backend_term = {
+		.name = "term",
+		.realtime = true,
+		.init = term_backend_init,
+		.poll = term_backend_poll,
+		.present = term_backend_present,
+		.end_frame = term_backend_end_frame,
+		.now_ns = backend_now_ns,
+		.sleep_until = backend_sleep_until,
+		.cleanup = term_backend_cleanup,
+};
@@ -0,0 +1,36 @@
+#ifndef TERM_H
+#define TERM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <termios.h>
+
+#include "chip8.h"
+
+typedef enum {
+	TERM_HALF,		// Unicode half blocks, 64x16 cells
+	TERM_BRAILLE, // Braille patterns, 32x8 cells
+} term_mode_t;
+
+#define TERM_MAX_CELLS (64 * 16)
+#define TERM_KEY_HOLD 6 // Frames a key stays down after its last keystroke
+
+// Terminal display backend. Cells are diffed against what is already on
+// screen so only changed cells are redrawn.
+typedef struct {
+	term_mode_t mode;
+	uint32_t cols, rows;
+	uint16_t cells[TERM_MAX_CELLS]; // Glyph index on screen, 0xFFFF unknown
+	struct termios saved;						// Settings restored on exit
+	char out[32768];								// Escape sequences for one frame
+	uint32_t out_len;
+	uint8_t key_hold[16]; // Frames left before a key is released
+	bool tone;						// Sound timer was running last frame
+} term_t;
+
+bool term_init(term_t *term, term_mode_t mode, const config_t config);
+void term_present(term_t *term, const chip8_t *chip8);
+void term_poll(term_t *term, chip8_t *chip8);
+void term_cleanup(term_t *term);
+
+#endif
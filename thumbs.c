@@ -0,0 +1,400 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memo.h"
+#include "png.h"
+#include "thumbs.h"
+
+#define DISPLAY_W 64 // CHIP8 display size
+#define DISPLAY_H 32
+
+typedef struct {
+	const config_t *config;
+	char **roms; // Paths, sorted by name
+	uint32_t rom_count;
+	const thumb_input_t *input;
+	uint32_t input_count;
+	memo_t *memo; // Shared by all workers, NULL without --memo
+	uint64_t (*cells)[DISPLAY_H]; // Atlas only: rom * frames + frame
+	bool *loaded;									// Atlas only: ROM ran and was captured
+	_Atomic uint32_t next;				// Next ROM a worker picks up
+	_Atomic uint32_t written;
+	_Atomic bool error;
+} thumbs_t;
+
+static bool is_rom(const char *name) {
+	const char *ext = strrchr(name, '.');
+	return ext && (strcmp(ext, ".ch8") == 0 || strcmp(ext, ".c8") == 0 ||
+								 strcmp(ext, ".CH8") == 0);
+}
+
+static int compare_paths(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void free_roms(char **roms, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++)
+		free(roms[i]);
+	free(roms);
+}
+
+// Paths of the ROM files in `dir`, sorted so the atlas layout is stable
+static char **list_roms(const char *dir, uint32_t *count) {
+	DIR *d = opendir(dir);
+	if (!d)
+		return NULL;
+	char **roms = NULL;
+	uint32_t capacity = 0;
+	*count = 0;
+	bool ok = true;
+	for (struct dirent *entry; ok && (entry = readdir(d));) {
+		if (!is_rom(entry->d_name))
+			continue;
+		char path[4096];
+		snprintf(path, sizeof path, "%s/%s", dir, entry->d_name);
+		struct stat st;
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		if (*count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			char **grown = realloc(roms, capacity * sizeof *roms);
+			if (!grown) {
+				ok = false;
+				break;
+			}
+			roms = grown;
+		}
+		roms[*count] = strdup(path);
+		ok = roms[*count] != NULL;
+		*count += ok;
+	}
+	closedir(d);
+	if (!ok) {
+		fprintf(stderr, "Out of memory listing %s\n", dir);
+		free_roms(roms, *count);
+		*count = 0;
+		return NULL;
+	}
+	if (roms)
+		qsort(roms, *count, sizeof *roms, compare_paths);
+	return roms;
+}
+
+// "<frame> <keys>" per line, keys as hex digits held down or "-" for none.
+// Blank lines and lines starting with # are skipped. Reports what is wrong
+// on stderr and returns NULL.
+static thumb_input_t *load_input(const char *path, uint32_t *count) {
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return NULL;
+	thumb_input_t *input = NULL;
+	uint32_t capacity = 0, line_number = 0;
+	*count = 0;
+	bool ok = true;
+	char line[256];
+	while (ok && fgets(line, sizeof line, file)) {
+		line_number++;
+		uint32_t frame;
+		char keys[64];
+		if (line[0] == '#' || sscanf(line, "%u %63s", &frame, keys) != 2)
+			continue;
+		if (*count == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			thumb_input_t *grown = realloc(input, capacity * sizeof *input);
+			if (!grown) {
+				fprintf(stderr, "Out of memory reading %s\n", path);
+				ok = false;
+				break;
+			}
+			input = grown;
+		}
+		thumb_input_t *entry = &input[(*count)++];
+		entry->frame = frame;
+		entry->keys = 0;
+		for (const char *k = keys; *k && *k != '-'; k++) {
+			if (!isxdigit((unsigned char)*k)) {
+				fprintf(stderr, "%s line %u: key %c is not a hex digit\n", path,
+								line_number, *k);
+				ok = false;
+				break;
+			}
+			char digit[2] = {*k, 0};
+			entry->keys |= 1u << strtoul(digit, NULL, 16);
+		}
+	}
+	fclose(file);
+	if (!ok) {
+		free(input);
+		*count = 0;
+		return NULL;
+	}
+	if (!input)
+		input = calloc(1, sizeof *input); // Empty script, still not an error
+	return input;
+}
+
+// Scale packed display rows into 1 bit per pixel PNG lines
+static void scale_bits(const uint64_t rows[DISPLAY_H], uint32_t scale,
+											 uint8_t *out, size_t stride) {
+	for (uint32_t y = 0; y < DISPLAY_H * scale; y++) {
+		uint8_t *line = &out[y * stride];
+		memset(line, 0, DISPLAY_W * scale / 8);
+		const uint64_t row = rows[y / scale];
+		for (uint32_t x = 0; x < DISPLAY_W * scale; x++)
+			if ((row >> (63 - x / scale)) & 1)
+				line[x / 8] |= 0x80 >> (x % 8);
+	}
+}
+
+// Run one ROM for the last capture frame, copying the display at each
+static bool run_rom(thumbs_t *thumbs, const char *path,
+										uint64_t (*captures)[DISPLAY_H]) {
+	const config_t *config = thumbs->config;
+	boot_image_t image;
+	if (!boot_image_load(&image, path))
+		return false;
+	chip8_t chip8;
+	boot_image_spawn(&image, &chip8, chip8_seed(config->seed, 0));
+
+	const uint32_t insts_per_frame = config->insts_per_second / 60;
+	const uint32_t last = config->thumb_frames[config->thumb_frame_count - 1];
+	uint32_t input = 0, capture = 0;
+	for (uint32_t frame = 0; frame < last; frame++) {
+		while (input < thumbs->input_count &&
+					 thumbs->input[input].frame <= frame) {
+			for (uint32_t k = 0; k < 16; k++)
+				chip8.keypad[k] = (thumbs->input[input].keys >> k) & 1;
+			input++;
+		}
+		if (thumbs->memo)
+			memo_frame(thumbs->memo, &chip8, *config);
+		else
+			for (uint32_t i = 0; i < insts_per_frame; i++)
+				emulate_instruction(&chip8, *config);
+		if (chip8.regs.delay_timer > 0)
+			chip8.regs.delay_timer--;
+		if (chip8.regs.sound_timer > 0)
+			chip8.regs.sound_timer--;
+		while (capture < config->thumb_frame_count &&
+					 config->thumb_frames[capture] == frame + 1)
+			memcpy(captures[capture++], chip8.display, sizeof chip8.display);
+	}
+	release_chip8(&chip8);
+	return true;
+}
+
+// Path of one thumbnail: <out>/<rom name>.png, with -<frame> before the
+// extension when several frames are captured
+static void thumb_path(const config_t *config, const char *rom, uint32_t frame,
+											 char *out, size_t size) {
+	const char *name = strrchr(rom, '/');
+	name = name ? name + 1 : rom;
+	const int base = (int)(strrchr(name, '.') - name);
+	if (config->thumb_frame_count > 1)
+		snprintf(out, size, "%s/%.*s-%u.png", config->thumbs_out, base, name,
+						 frame);
+	else
+		snprintf(out, size, "%s/%.*s.png", config->thumbs_out, base, name);
+}
+
+static void *worker(void *arg) {
+	thumbs_t *thumbs = arg;
+	const config_t *config = thumbs->config;
+	const uint32_t scale = config->capture_scale;
+	const size_t stride = DISPLAY_W * scale / 8;
+	uint8_t *bits = malloc(stride * DISPLAY_H * scale);
+	uint64_t(*captures)[DISPLAY_H] =
+			malloc(config->thumb_frame_count * sizeof *captures);
+	if (!bits || !captures) {
+		atomic_store(&thumbs->error, true);
+		free(bits);
+		free(captures);
+		return NULL;
+	}
+
+	for (;;) {
+		const uint32_t rom = atomic_fetch_add(&thumbs->next, 1);
+		if (rom >= thumbs->rom_count)
+			break;
+		uint64_t(*out)[DISPLAY_H] =
+				thumbs->cells ? &thumbs->cells[rom * config->thumb_frame_count]
+											: captures;
+		if (!run_rom(thumbs, thumbs->roms[rom], out)) {
+			fprintf(stderr, "Skipped %s\n", thumbs->roms[rom]);
+			atomic_store(&thumbs->error, true);
+			continue;
+		}
+		if (thumbs->cells) {
+			thumbs->loaded[rom] = true;
+			continue;
+		}
+
+		for (uint32_t f = 0; f < config->thumb_frame_count; f++) {
+			char path[4096];
+			thumb_path(config, thumbs->roms[rom], config->thumb_frames[f], path,
+								 sizeof path);
+			scale_bits(captures[f], scale, bits, stride);
+			if (!png_write(path, bits, DISPLAY_W * scale, DISPLAY_H * scale, stride,
+										 config->fg_color, config->bg_color)) {
+				fprintf(stderr, "Could not write %s\n", path);
+				atomic_store(&thumbs->error, true);
+				continue;
+			}
+			atomic_fetch_add(&thumbs->written, 1);
+		}
+	}
+	free(bits);
+	free(captures);
+	return NULL;
+}
+
+// Pack every captured cell into one sheet, left to right then top to
+// bottom, with a tab separated line per cell in the index
+static bool write_atlas(thumbs_t *thumbs) {
+	const config_t *config = thumbs->config;
+	const uint32_t scale = config->capture_scale;
+	uint32_t cells = 0;
+	for (uint32_t rom = 0; rom < thumbs->rom_count; rom++)
+		cells += thumbs->loaded[rom] ? config->thumb_frame_count : 0;
+	if (cells == 0)
+		return true;
+
+	// About square: each cell is twice as wide as it is tall
+	uint32_t columns = 1;
+	while (columns * columns * 2 < cells)
+		columns++;
+	const uint32_t rows = (cells + columns - 1) / columns;
+	const uint32_t cell_w = DISPLAY_W * scale, cell_h = DISPLAY_H * scale;
+	const size_t cell_stride = cell_w / 8;
+	const size_t stride = cell_stride * columns;
+	uint8_t *sheet = calloc(stride, (size_t)cell_h * rows);
+	uint8_t *cell = malloc(cell_stride * cell_h);
+
+	char path[4096];
+	snprintf(path, sizeof path, "%s/atlas.txt", config->thumbs_out);
+	FILE *index = fopen(path, "w");
+	if (!sheet || !cell || !index) {
+		if (index)
+			fclose(index);
+		free(sheet);
+		free(cell);
+		return false;
+	}
+	fprintf(index, "# x\ty\twidth\theight\tframe\trom\n");
+
+	uint32_t n = 0;
+	for (uint32_t rom = 0; rom < thumbs->rom_count; rom++) {
+		if (!thumbs->loaded[rom])
+			continue;
+		for (uint32_t f = 0; f < config->thumb_frame_count; f++, n++) {
+			const uint32_t x = n % columns * cell_w, y = n / columns * cell_h;
+			scale_bits(thumbs->cells[rom * config->thumb_frame_count + f], scale,
+								 cell, cell_stride);
+			for (uint32_t line = 0; line < cell_h; line++)
+				memcpy(&sheet[(y + line) * stride + x / 8],
+							 &cell[line * cell_stride], cell_stride);
+			const char *name = strrchr(thumbs->roms[rom], '/');
+			fprintf(index, "%u\t%u\t%u\t%u\t%u\t%s\n", x, y, cell_w, cell_h,
+							config->thumb_frames[f], name ? name + 1 : thumbs->roms[rom]);
+		}
+	}
+
+	bool ok = fclose(index) == 0;
+	snprintf(path, sizeof path, "%s/atlas.png", config->thumbs_out);
+	if (!png_write(path, sheet, cell_w * columns, cell_h * rows, stride,
+								 config->fg_color, config->bg_color)) {
+		fprintf(stderr, "Could not write %s\n", path);
+		ok = false;
+	}
+	atomic_store(&thumbs->written, cells);
+	free(sheet);
+	free(cell);
+	return ok;
+}
+
+bool thumbs_run(const config_t config) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	thumbs_t thumbs = {.config = &config};
+	thumbs.roms = list_roms(config.roms[0], &thumbs.rom_count);
+	if (!thumbs.roms) {
+		fprintf(stderr, "No ROMs found in %s\n", config.roms[0]);
+		return false;
+	}
+	if (config.thumb_input) {
+		thumb_input_t *input = load_input(config.thumb_input, &thumbs.input_count);
+		if (!input) {
+			fprintf(stderr, "Could not read input script %s\n", config.thumb_input);
+			return false;
+		}
+		thumbs.input = input;
+	}
+	if (mkdir(config.thumbs_out, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create %s\n", config.thumbs_out);
+		return false;
+	}
+	if (config.memo_mb) {
+		thumbs.memo = memo_create((size_t)config.memo_mb << 20);
+		if (!thumbs.memo)
+			return false;
+	}
+	if (config.thumb_atlas) {
+		thumbs.cells = calloc((size_t)thumbs.rom_count * config.thumb_frame_count,
+													sizeof *thumbs.cells);
+		thumbs.loaded = calloc(thumbs.rom_count, sizeof *thumbs.loaded);
+		if (!thumbs.cells || !thumbs.loaded)
+			return false;
+	}
+
+	uint32_t jobs = config.jobs;
+	if (jobs == 0) {
+		const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cores > 0 ? (uint32_t)cores : 1;
+	}
+	if (jobs > thumbs.rom_count)
+		jobs = thumbs.rom_count ? thumbs.rom_count : 1;
+	pthread_t *threads = calloc(jobs, sizeof *threads);
+	uint32_t started = 0;
+	if (threads)
+		while (started < jobs &&
+					 pthread_create(&threads[started], NULL, worker, &thumbs) == 0)
+			started++;
+	if (started == 0)
+		worker(&thumbs); // No threads to be had, do it all here
+	for (uint32_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	bool ok = !atomic_load(&thumbs.error);
+	if (config.thumb_atlas && !write_atlas(&thumbs))
+		ok = false;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	const double ms = (end.tv_sec - start.tv_sec) * 1e3 +
+										(end.tv_nsec - start.tv_nsec) / 1e6;
+	printf("%u thumbnails of %u ROMs in %.1f ms on %u threads\n",
+				 atomic_load(&thumbs.written), thumbs.rom_count, ms,
+				 started ? started : 1);
+	if (thumbs.memo) {
+		memo_report(thumbs.memo);
+		memo_destroy(thumbs.memo);
+	}
+
+	free_roms(thumbs.roms, thumbs.rom_count);
+	free((void *)thumbs.input);
+	free(thumbs.cells);
+	free(thumbs.loaded);
+	return ok;
+}
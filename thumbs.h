@@ -0,0 +1,21 @@
+#ifndef THUMBS_H
+#define THUMBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Keys held from a frame of scripted input on, until the next entry
+typedef struct {
+	uint32_t frame;
+	uint16_t keys; // Bit k = key k down
+} thumb_input_t;
+
+// Batch thumbnails: every ROM in the directory config.roms[0] is run
+// headless, one machine per worker thread, and its display is captured at
+// each of config.thumb_frames. Captures are written to config.thumbs_out
+// as a PNG each, or packed into atlas.png with an atlas.txt index.
+bool thumbs_run(const config_t config);
+
+#endif
@@ -0,0 +1,749 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "vnc.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: SO_NOSIGPIPE is set per socket instead
+#endif
+
+#define DISPLAY_W 64 // CHIP8 display size
+#define DISPLAY_H 32
+
+enum {
+	ENCODING_RAW = 0,
+	ENCODING_RRE = 2,
+	ENCODING_HEXTILE = 5,
+};
+
+// Hextile tile subencoding flags
+enum {
+	HEXTILE_RAW = 1,
+	HEXTILE_BG = 2,
+	HEXTILE_FG = 4,
+	HEXTILE_SUBRECTS = 8,
+};
+
+// Growable output buffer for encoded messages
+typedef struct {
+	uint8_t *data;
+	size_t len, cap;
+} vnc_buf_t;
+
+static void buf_reserve(vnc_buf_t *buf, size_t extra) {
+	if (buf->len + extra <= buf->cap)
+		return;
+	size_t cap = buf->cap ? buf->cap : 4096;
+	while (cap < buf->len + extra)
+		cap *= 2;
+	uint8_t *data = realloc(buf->data, cap);
+	if (!data)
+		abort();
+	buf->data = data;
+	buf->cap = cap;
+}
+
+static void put_u8(vnc_buf_t *buf, uint8_t value) {
+	buf_reserve(buf, 1);
+	buf->data[buf->len++] = value;
+}
+
+static void put_u16(vnc_buf_t *buf, uint16_t value) {
+	put_u8(buf, value >> 8);
+	put_u8(buf, value & 0xFF);
+}
+
+static void put_u32(vnc_buf_t *buf, uint32_t value) {
+	put_u16(buf, value >> 16);
+	put_u16(buf, value & 0xFFFF);
+}
+
+static void put_bytes(vnc_buf_t *buf, const void *data, size_t len) {
+	buf_reserve(buf, len);
+	memcpy(&buf->data[buf->len], data, len);
+	buf->len += len;
+}
+
+static void put_pixel(vnc_buf_t *buf, const vnc_format_t *format, bool on) {
+	put_bytes(buf, on ? format->fg : format->bg, format->bpp / 8);
+}
+
+static bool send_all(int fd, const void *data, size_t len) {
+	const uint8_t *bytes = data;
+	while (len > 0) {
+		const ssize_t n = send(fd, bytes, len, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		bytes += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool recv_all(int fd, void *data, size_t len) {
+	uint8_t *bytes = data;
+	while (len > 0) {
+		const ssize_t n = recv(fd, bytes, len, 0);
+		if (n <= 0)
+			return false;
+		bytes += n;
+		len -= n;
+	}
+	return true;
+}
+
+static uint16_t get_u16(const uint8_t *p) { return p[0] << 8 | p[1]; }
+
+static uint32_t get_u32(const uint8_t *p) {
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Convert an RGBA8888 colour into the client's pixel format bytes
+static void encode_color(vnc_format_t *format, uint32_t rgba, uint8_t *out) {
+	const uint32_t r = (rgba >> 24) & 0xFF;
+	const uint32_t g = (rgba >> 16) & 0xFF;
+	const uint32_t b = (rgba >> 8) & 0xFF;
+	const uint32_t pixel = (r * format->red_max / 255) << format->red_shift |
+												 (g * format->green_max / 255) << format->green_shift |
+												 (b * format->blue_max / 255) << format->blue_shift;
+	const int bytes = format->bpp / 8;
+	for (int i = 0; i < bytes; i++) {
+		const int shift = format->big_endian ? 8 * (bytes - 1 - i) : 8 * i;
+		out[i] = (pixel >> shift) & 0xFF;
+	}
+}
+
+// Colours for the expansion kernels: the encoded bytes as they should land
+// in memory, 4 of them at 32bpp and 1 at 8bpp
+static void format_expand(vnc_t *vnc, vnc_format_t *format) {
+	uint32_t fg = format->fg[0], bg = format->bg[0];
+	if (format->bpp == 32) {
+		memcpy(&fg, format->fg, sizeof fg);
+		memcpy(&bg, format->bg, sizeof bg);
+	}
+	expand_init(&format->expand, fg, bg, vnc->scale);
+}
+
+// Server's native format: 32bpp little endian xRGB, depth 24
+static void default_format(vnc_t *vnc, vnc_format_t *format) {
+	*format = (vnc_format_t){
+			.bpp = 32,
+			.red_max = 255,
+			.green_max = 255,
+			.blue_max = 255,
+			.red_shift = 16,
+			.green_shift = 8,
+			.blue_shift = 0,
+	};
+	encode_color(format, vnc->fg_color, format->fg);
+	encode_color(format, vnc->bg_color, format->bg);
+	format_expand(vnc, format);
+}
+
+static void put_format(vnc_buf_t *buf, const vnc_format_t *format) {
+	put_u8(buf, format->bpp);
+	put_u8(buf, format->bpp == 8 ? 8 : 24); // Depth
+	put_u8(buf, format->big_endian);
+	put_u8(buf, 1); // True colour
+	put_u16(buf, format->red_max);
+	put_u16(buf, format->green_max);
+	put_u16(buf, format->blue_max);
+	put_u8(buf, format->red_shift);
+	put_u8(buf, format->green_shift);
+	put_u8(buf, format->blue_shift);
+	put_u8(buf, 0); // Padding
+	put_u8(buf, 0);
+	put_u8(buf, 0);
+}
+
+// Output pixel (x, y) of the scaled display
+static inline bool pixel_at(const vnc_t *vnc, const uint64_t rows[32],
+														uint32_t x, uint32_t y) {
+	return (rows[y / vnc->scale] >> (63 - x / vnc->scale)) & 1;
+}
+
+// Rectangle in output pixels
+typedef struct {
+	uint16_t x, y, w, h;
+} vnc_rect_t;
+
+static void encode_raw(const vnc_t *vnc, const vnc_format_t *format,
+											 const uint64_t rows[32], vnc_rect_t r, vnc_buf_t *buf) {
+	// Narrow rectangles (hextile tiles) and 16bpp go a pixel at a time
+	const uint32_t bytes = format->bpp / 8;
+	if (bytes == 2 || r.w < DISPLAY_W) {
+		for (uint32_t y = r.y; y < r.y + r.h; y++)
+			for (uint32_t x = r.x; x < r.x + r.w; x++)
+				put_pixel(buf, format, pixel_at(vnc, rows, x, y));
+		return;
+	}
+
+	// Expand each display row once and copy out the rectangle's span
+	uint32_t expanded = UINT32_MAX;
+	for (uint32_t y = r.y; y < r.y + r.h; y++) {
+		if (y / vnc->scale != expanded) {
+			expanded = y / vnc->scale;
+			if (bytes == 4)
+				expand_line32(&format->expand, rows[expanded], (uint32_t *)vnc->line);
+			else
+				expand_line8(&format->expand, rows[expanded], vnc->line);
+		}
+		put_bytes(buf, vnc->line + r.x * bytes, r.w * bytes);
+	}
+}
+
+// Collect runs of foreground pixels in a rectangle as subrectangles,
+// merging a run into the one directly above when it has the same extent.
+// Coordinates are relative to the rectangle. Returns the subrect count, or
+// max + 1 if there are more than max.
+static uint32_t find_subrects(const vnc_t *vnc, const uint64_t rows[32],
+															vnc_rect_t r, vnc_rect_t *subrects,
+															uint32_t max) {
+	uint32_t count = 0;
+	uint32_t row_start = 0; // First subrect that may still grow downwards
+	for (uint32_t y = 0; y < r.h; y++) {
+		const uint32_t row_end = count;
+		for (uint32_t x = 0; x < r.w;) {
+			if (!pixel_at(vnc, rows, r.x + x, r.y + y)) {
+				x++;
+				continue;
+			}
+			uint32_t end = x;
+			while (end < r.w && pixel_at(vnc, rows, r.x + end, r.y + y))
+				end++;
+
+			bool merged = false;
+			for (uint32_t i = row_start; i < row_end; i++) {
+				vnc_rect_t *above = &subrects[i];
+				if (above->x == x && above->w == end - x &&
+						above->y + above->h == y) {
+					above->h++;
+					merged = true;
+					break;
+				}
+			}
+			if (!merged) {
+				if (count == max)
+					return max + 1;
+				subrects[count++] = (vnc_rect_t){x, y, end - x, 1};
+			}
+			x = end;
+		}
+		// Subrects that didn't grow this row are closed for good
+		while (row_start < count &&
+					 subrects[row_start].y + subrects[row_start].h <= y)
+			row_start++;
+	}
+	return count;
+}
+
+// RRE: background colour plus a list of solid foreground subrectangles
+static bool encode_rre(const vnc_t *vnc, const vnc_format_t *format,
+											 const uint64_t rows[32], vnc_rect_t r, vnc_buf_t *buf,
+											 size_t limit) {
+	const uint32_t max = limit / (format->bpp / 8 + 8);
+	vnc_rect_t *subrects = malloc((max + 1) * sizeof *subrects);
+	if (!subrects)
+		return false;
+	const uint32_t count = find_subrects(vnc, rows, r, subrects, max);
+	if (count > max) {
+		free(subrects); // Would be bigger than the alternative
+		return false;
+	}
+
+	put_u32(buf, count);
+	put_pixel(buf, format, false);
+	for (uint32_t i = 0; i < count; i++) {
+		put_pixel(buf, format, true);
+		put_u16(buf, subrects[i].x);
+		put_u16(buf, subrects[i].y);
+		put_u16(buf, subrects[i].w);
+		put_u16(buf, subrects[i].h);
+	}
+	free(subrects);
+	return true;
+}
+
+// Hextile: 16x16 tiles, each either a solid colour (often omitted entirely
+// when it repeats the previous tile's background) or bg + fg subrects
+static void encode_hextile(const vnc_t *vnc, const vnc_format_t *format,
+													 const uint64_t rows[32], vnc_rect_t r,
+													 vnc_buf_t *buf) {
+	int last_bg = -1, last_fg = -1; // Colours carried between tiles, -1 unset
+	vnc_rect_t subrects[256];
+	const uint32_t bytes = format->bpp / 8;
+
+	for (uint32_t ty = r.y; ty < r.y + r.h; ty += 16) {
+		for (uint32_t tx = r.x; tx < r.x + r.w; tx += 16) {
+			const vnc_rect_t tile = {
+					tx, ty, r.x + r.w - tx < 16 ? r.x + r.w - tx : 16,
+					r.y + r.h - ty < 16 ? r.y + r.h - ty : 16};
+
+			uint32_t on = 0;
+			for (uint32_t y = tile.y; y < tile.y + tile.h; y++)
+				for (uint32_t x = tile.x; x < tile.x + tile.w; x++)
+					on += pixel_at(vnc, rows, x, y);
+
+			if (on == 0 || on == (uint32_t)tile.w * tile.h) {
+				// Solid tile, just a background colour
+				const int color = on != 0;
+				if (color == last_bg) {
+					put_u8(buf, 0);
+				} else {
+					put_u8(buf, HEXTILE_BG);
+					put_pixel(buf, format, color);
+					last_bg = color;
+				}
+				continue;
+			}
+
+			const uint32_t count = find_subrects(vnc, rows, tile, subrects, 255);
+			const uint32_t raw_size = tile.w * tile.h * bytes;
+			if (count > 255 || 2 * bytes + 1 + 2 * count >= raw_size) {
+				put_u8(buf, HEXTILE_RAW);
+				encode_raw(vnc, format, rows, tile, buf);
+				last_bg = last_fg = -1; // Raw tiles reset the carried colours
+				continue;
+			}
+
+			uint8_t flags = HEXTILE_SUBRECTS;
+			if (last_bg != 0)
+				flags |= HEXTILE_BG;
+			if (last_fg != 1)
+				flags |= HEXTILE_FG;
+			put_u8(buf, flags);
+			if (flags & HEXTILE_BG)
+				put_pixel(buf, format, false);
+			if (flags & HEXTILE_FG)
+				put_pixel(buf, format, true);
+			last_bg = 0;
+			last_fg = 1;
+
+			put_u8(buf, count);
+			for (uint32_t i = 0; i < count; i++) {
+				put_u8(buf, subrects[i].x << 4 | subrects[i].y);
+				put_u8(buf, (subrects[i].w - 1) << 4 | (subrects[i].h - 1));
+			}
+		}
+	}
+}
+
+// Append one rectangle, picking whichever encoding the client supports that
+// comes out smallest
+static void encode_rect(vnc_t *vnc, vnc_client_t *client,
+												const uint64_t rows[32], vnc_rect_t r,
+												vnc_buf_t *buf) {
+	static vnc_buf_t scratch;
+	const vnc_format_t *format = &client->format;
+	const size_t raw_size = (size_t)r.w * r.h * (format->bpp / 8);
+
+	put_u16(buf, r.x);
+	put_u16(buf, r.y);
+	put_u16(buf, r.w);
+	put_u16(buf, r.h);
+
+	size_t best = raw_size;
+	int32_t encoding = ENCODING_RAW;
+	scratch.len = 0;
+	if (client->hextile) {
+		encode_hextile(vnc, format, rows, r, &scratch);
+		if (scratch.len < best) {
+			best = scratch.len;
+			encoding = ENCODING_HEXTILE;
+		}
+	}
+	if (client->rre) {
+		const size_t mark = scratch.len;
+		if (encode_rre(vnc, format, rows, r, &scratch, best) &&
+				scratch.len - mark < best) {
+			// RRE won; keep only its bytes
+			memmove(scratch.data, &scratch.data[mark], scratch.len - mark);
+			scratch.len -= mark;
+			best = scratch.len;
+			encoding = ENCODING_RRE;
+		}
+	}
+
+	put_u32(buf, (uint32_t)encoding);
+	if (encoding == ENCODING_RAW)
+		encode_raw(vnc, format, rows, r, buf);
+	else
+		put_bytes(buf, scratch.data, best);
+}
+
+// Send every changed band of rows as a rectangle trimmed to the columns that
+// actually differ from what this client last saw
+static bool send_update(vnc_t *vnc, vnc_client_t *client,
+												const uint64_t rows[32]) {
+	static vnc_buf_t buf;
+	vnc_rect_t rects[DISPLAY_H];
+	uint32_t count = 0;
+
+	if (client->full) {
+		rects[count++] = (vnc_rect_t){0, 0, DISPLAY_W * vnc->scale,
+																	DISPLAY_H * vnc->scale};
+		client->dirty = 0;
+	}
+	for (uint32_t y = 0; y < DISPLAY_H;) {
+		if (!((client->dirty >> y) & 1)) {
+			y++;
+			continue;
+		}
+		uint32_t end = y;
+		uint64_t columns = 0;
+		uint32_t top = DISPLAY_H, bottom = 0;
+		while (end < DISPLAY_H && ((client->dirty >> end) & 1)) {
+			const uint64_t diff = rows[end] ^ client->sent[end];
+			if (diff) {
+				columns |= diff;
+				if (end < top)
+					top = end;
+				bottom = end;
+			}
+			end++;
+		}
+		if (columns) {
+			const uint32_t left = __builtin_clzll(columns);
+			const uint32_t width = 64 - __builtin_ctzll(columns) - left;
+			rects[count++] = (vnc_rect_t){
+					left * vnc->scale, top * vnc->scale, width * vnc->scale,
+					(bottom - top + 1) * vnc->scale};
+		}
+		y = end;
+	}
+	client->dirty = 0;
+	if (count == 0)
+		return true; // Nothing changed; leave the request outstanding
+
+	buf.len = 0;
+	put_u8(&buf, 0); // FramebufferUpdate
+	put_u8(&buf, 0);
+	put_u16(&buf, count);
+	for (uint32_t i = 0; i < count; i++)
+		encode_rect(vnc, client, rows, rects[i], &buf);
+
+	memcpy(client->sent, rows, sizeof client->sent);
+	client->update_requested = false;
+	client->full = false;
+	return send_all(client->fd, buf.data, buf.len);
+}
+
+// CHIP8 keypad position of an X11 keysym, same layout as the SDL window:
+// 1234/qwer/asdf/zxcv
+static int keysym_to_key(uint32_t keysym) {
+	static const char layout[] = "x123qweasdzc4rfv"; // Index is CHIP8 key
+	if (keysym >= 'A' && keysym <= 'Z')
+		keysym += 'a' - 'A';
+	for (int i = 0; i < 16; i++)
+		if ((uint32_t)layout[i] == keysym)
+			return i;
+	return -1;
+}
+
+// RFB 3.3, 3.7 and 3.8 handshake with no authentication, then ServerInit
+static bool handshake(vnc_t *vnc, vnc_client_t *client) {
+	uint8_t version[12];
+	if (!send_all(client->fd, "RFB 003.008\n", 12) ||
+			!recv_all(client->fd, version, sizeof version))
+		return false;
+	const int minor = (version[8] - '0') * 100 + (version[9] - '0') * 10 +
+										(version[10] - '0');
+
+	if (minor < 7) {
+		// 3.3: the server decides, security type is a u32
+		const uint8_t none[4] = {0, 0, 0, 1};
+		if (!send_all(client->fd, none, sizeof none))
+			return false;
+	} else {
+		const uint8_t types[2] = {1, 1}; // One type offered: None
+		uint8_t chosen;
+		if (!send_all(client->fd, types, sizeof types) ||
+				!recv_all(client->fd, &chosen, 1) || chosen != 1)
+			return false;
+		if (minor >= 8) {
+			const uint8_t ok[4] = {0};
+			if (!send_all(client->fd, ok, sizeof ok))
+				return false;
+		}
+	}
+
+	uint8_t shared;
+	if (!recv_all(client->fd, &shared, 1))
+		return false;
+
+	static const char name[] = "CHIP8 Emulator";
+	vnc_buf_t buf = {0};
+	put_u16(&buf, DISPLAY_W * vnc->scale);
+	put_u16(&buf, DISPLAY_H * vnc->scale);
+	default_format(vnc, &client->format);
+	put_format(&buf, &client->format);
+	put_u32(&buf, sizeof name - 1);
+	put_bytes(&buf, name, sizeof name - 1);
+	const bool ok = send_all(client->fd, buf.data, buf.len);
+	free(buf.data);
+	return ok;
+}
+
+// Read and act on one client message
+static bool handle_message(vnc_t *vnc, vnc_client_t *client) {
+	uint8_t type;
+	uint8_t msg[20];
+	if (!recv_all(client->fd, &type, 1))
+		return false;
+
+	switch (type) {
+	case 0: { // SetPixelFormat
+		if (!recv_all(client->fd, msg, 19))
+			return false;
+		const uint8_t *pf = &msg[3];
+		if (pf[0] != 8 && pf[0] != 16 && pf[0] != 32)
+			return false;
+		if (!pf[3])
+			return false; // Colour map formats are not supported
+		vnc_format_t *format = &client->format;
+		*format = (vnc_format_t){
+				.bpp = pf[0],
+				.big_endian = pf[2],
+				.red_max = get_u16(&pf[4]),
+				.green_max = get_u16(&pf[6]),
+				.blue_max = get_u16(&pf[8]),
+				.red_shift = pf[10],
+				.green_shift = pf[11],
+				.blue_shift = pf[12],
+		};
+		encode_color(format, vnc->fg_color, format->fg);
+		encode_color(format, vnc->bg_color, format->bg);
+		format_expand(vnc, format);
+		client->full = true; // Everything has to be resent in the new format
+		return true;
+	}
+	case 2: { // SetEncodings
+		if (!recv_all(client->fd, msg, 3))
+			return false;
+		const uint16_t count = get_u16(&msg[1]);
+		client->rre = client->hextile = false;
+		for (uint16_t i = 0; i < count; i++) {
+			if (!recv_all(client->fd, msg, 4))
+				return false;
+			const int32_t encoding = (int32_t)get_u32(msg);
+			if (encoding == ENCODING_RRE)
+				client->rre = true;
+			else if (encoding == ENCODING_HEXTILE)
+				client->hextile = true;
+		}
+		return true;
+	}
+	case 3: // FramebufferUpdateRequest
+		if (!recv_all(client->fd, msg, 9))
+			return false;
+		client->update_requested = true;
+		if (!msg[0])
+			client->full = true; // Not incremental: the client wants everything
+		return true;
+	case 4: { // KeyEvent
+		if (!recv_all(client->fd, msg, 7))
+			return false;
+		const int key = keysym_to_key(get_u32(&msg[3]));
+		if (key >= 0) {
+			if (msg[0])
+				atomic_fetch_or(&vnc->keys_down, 1u << key);
+			else
+				atomic_fetch_and(&vnc->keys_down, ~(1u << key));
+			atomic_fetch_or(&vnc->keys_changed, 1u << key);
+		}
+		return true;
+	}
+	case 5: // PointerEvent, ignored
+		return recv_all(client->fd, msg, 5);
+	case 6: { // ClientCutText, skipped
+		if (!recv_all(client->fd, msg, 7))
+			return false;
+		uint32_t len = get_u32(&msg[3]);
+		while (len > 0) {
+			const uint32_t n = len < sizeof msg ? len : sizeof msg;
+			if (!recv_all(client->fd, msg, n))
+				return false;
+			len -= n;
+		}
+		return true;
+	}
+	default:
+		return false; // Unknown message; we can't know its length
+	}
+}
+
+static void drop_client(vnc_client_t *client) {
+	close(client->fd);
+	client->fd = -1;
+}
+
+static void accept_client(vnc_t *vnc) {
+	const int fd = accept(vnc->listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	vnc_client_t *client = NULL;
+	for (int i = 0; i < VNC_MAX_CLIENTS; i++)
+		if (vnc->clients[i].fd < 0)
+			client = &vnc->clients[i];
+	if (!client) {
+		close(fd);
+		return;
+	}
+
+	// A stalled client can only hold up the server thread this long
+	const struct timeval timeout = {.tv_sec = 2};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+	const int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+
+	*client = (vnc_client_t){.fd = fd, .full = true};
+	if (!handshake(vnc, client))
+		drop_client(client);
+}
+
+static void *vnc_thread(void *arg) {
+	vnc_t *vnc = arg;
+	uint64_t frame[32];
+
+	while (!atomic_load(&vnc->done)) {
+		struct pollfd fds[VNC_MAX_CLIENTS + 1];
+		vnc_client_t *owners[VNC_MAX_CLIENTS + 1];
+		nfds_t nfds = 0;
+		fds[nfds] = (struct pollfd){.fd = vnc->listen_fd, .events = POLLIN};
+		owners[nfds++] = NULL;
+		for (int i = 0; i < VNC_MAX_CLIENTS; i++) {
+			if (vnc->clients[i].fd < 0)
+				continue;
+			fds[nfds] = (struct pollfd){.fd = vnc->clients[i].fd, .events = POLLIN};
+			owners[nfds++] = &vnc->clients[i];
+		}
+
+		// Wake at least every few ms to pick up new frames
+		if (poll(fds, nfds, 5) > 0) {
+			for (nfds_t i = 0; i < nfds; i++) {
+				if (!fds[i].revents)
+					continue;
+				if (!owners[i])
+					accept_client(vnc);
+				else if (!handle_message(vnc, owners[i]))
+					drop_client(owners[i]);
+			}
+		}
+
+		pthread_mutex_lock(&vnc->lock);
+		memcpy(frame, vnc->frame, sizeof frame);
+		const uint32_t dirty = vnc->frame_dirty;
+		vnc->frame_dirty = 0;
+		pthread_mutex_unlock(&vnc->lock);
+
+		for (int i = 0; i < VNC_MAX_CLIENTS; i++) {
+			vnc_client_t *client = &vnc->clients[i];
+			if (client->fd < 0)
+				continue;
+			client->dirty |= dirty;
+			if (client->update_requested && (client->dirty || client->full) &&
+					!send_update(vnc, client, frame))
+				drop_client(client);
+		}
+	}
+
+	for (int i = 0; i < VNC_MAX_CLIENTS; i++)
+		if (vnc->clients[i].fd >= 0)
+			drop_client(&vnc->clients[i]);
+	return NULL;
+}
+
+// Listen on bind_addr:port (IPv4) and start the server thread. There is no
+// authentication, so bind to loopback unless the network is trusted.
+vnc_t *vnc_open(const char *bind_addr, uint16_t port, uint32_t scale,
+								uint32_t fg_color, uint32_t bg_color) {
+	struct sockaddr_in addr = {
+			.sin_family = AF_INET,
+			.sin_port = htons(port),
+	};
+	if (scale == 0 || DISPLAY_W * scale > 0xFFFF ||
+			inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1)
+		return NULL;
+
+	vnc_t *vnc = calloc(1, sizeof *vnc);
+	if (!vnc)
+		return NULL;
+	vnc->scale = scale;
+	vnc->line = malloc(DISPLAY_W * scale * sizeof(uint32_t));
+	if (!vnc->line) {
+		free(vnc);
+		return NULL;
+	}
+	vnc->fg_color = fg_color;
+	vnc->bg_color = bg_color;
+	for (int i = 0; i < VNC_MAX_CLIENTS; i++)
+		vnc->clients[i].fd = -1;
+
+	vnc->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	const int one = 1;
+	if (vnc->listen_fd < 0 ||
+			setsockopt(vnc->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+								 sizeof one) != 0 ||
+			bind(vnc->listen_fd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+			listen(vnc->listen_fd, VNC_MAX_CLIENTS) != 0) {
+		if (vnc->listen_fd >= 0)
+			close(vnc->listen_fd);
+		free(vnc->line);
+		free(vnc);
+		return NULL;
+	}
+
+	pthread_mutex_init(&vnc->lock, NULL);
+	if (pthread_create(&vnc->thread, NULL, vnc_thread, vnc) != 0) {
+		close(vnc->listen_fd);
+		pthread_mutex_destroy(&vnc->lock);
+		free(vnc->line);
+		free(vnc);
+		return NULL;
+	}
+	return vnc;
+}
+
+// Hand over a completed frame. Only copies 256 bytes under the lock.
+void vnc_publish(vnc_t *vnc, const uint64_t display[32], uint32_t dirty_rows) {
+	if (!dirty_rows)
+		return;
+	pthread_mutex_lock(&vnc->lock);
+	memcpy(vnc->frame, display, sizeof vnc->frame);
+	vnc->frame_dirty |= dirty_rows;
+	pthread_mutex_unlock(&vnc->lock);
+}
+
+// Apply key presses and releases received from VNC clients since last call
+void vnc_apply_keys(vnc_t *vnc, bool keypad[16]) {
+	const uint32_t changed = atomic_exchange(&vnc->keys_changed, 0);
+	if (!changed)
+		return;
+	const uint32_t down = atomic_load(&vnc->keys_down);
+	for (int i = 0; i < 16; i++)
+		if ((changed >> i) & 1)
+			keypad[i] = (down >> i) & 1;
+}
+
+void vnc_close(vnc_t *vnc) {
+	atomic_store(&vnc->done, true);
+	pthread_join(vnc->thread, NULL);
+	close(vnc->listen_fd);
+	pthread_mutex_destroy(&vnc->lock);
+	free(vnc->line);
+	free(vnc);
+}
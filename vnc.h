@@ -0,0 +1,64 @@
+#ifndef VNC_H
+#define VNC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "expand.h"
+
+#define VNC_MAX_CLIENTS 4
+
+// Client's requested pixel format, plus the fg/bg colours already converted
+// to it
+typedef struct {
+	uint8_t bpp; // 8, 16 or 32
+	bool big_endian;
+	uint16_t red_max, green_max, blue_max;
+	uint8_t red_shift, green_shift, blue_shift;
+	uint8_t fg[4], bg[4]; // Encoded pixel bytes
+	expand_t expand;			// fg/bg for the expansion kernels, 8 and 32 bpp
+} vnc_format_t;
+
+typedef struct {
+	int fd; // -1 when the slot is free
+	vnc_format_t format;
+	bool rre, hextile;				 // Encodings the client accepts besides raw
+	bool update_requested;		 // A FramebufferUpdateRequest is outstanding
+	bool full;								 // Next update must cover the whole screen
+	uint32_t dirty;						 // Rows that may differ from `sent`
+	uint64_t sent[32];				 // Display as last sent to this client
+} vnc_client_t;
+
+// Minimal RFB (VNC) server. The emulation thread only hands over the packed
+// display and its dirty rows under a briefly held lock; the server thread
+// does all networking and encoding. Key events are mapped onto the CHIP8
+// keypad with the same layout as the SDL window.
+typedef struct {
+	int listen_fd;
+	uint32_t scale;
+	uint8_t *line; // One expanded output row, server thread only
+	uint32_t fg_color, bg_color; // RGBA8888
+	vnc_client_t clients[VNC_MAX_CLIENTS];
+
+	pthread_t thread;
+	_Atomic bool done;
+
+	// Frame handoff from the emulation thread
+	pthread_mutex_t lock;
+	uint64_t frame[32];
+	uint32_t frame_dirty; // Rows drawn since the server last took the frame
+
+	// Keypad state from VNC key events, bit n = CHIP8 key n
+	_Atomic uint32_t keys_down;
+	_Atomic uint32_t keys_changed;
+} vnc_t;
+
+vnc_t *vnc_open(const char *bind_addr, uint16_t port, uint32_t scale,
+								uint32_t fg_color, uint32_t bg_color);
+void vnc_publish(vnc_t *vnc, const uint64_t display[32], uint32_t dirty_rows);
+void vnc_apply_keys(vnc_t *vnc, bool keypad[16]);
+void vnc_close(vnc_t *vnc);
+
+#endif
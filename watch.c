@@ -0,0 +1,335 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "watch.h"
+
+typedef enum {
+	OP_CONST,
+	OP_V,
+	OP_I,
+	OP_PC,
+	OP_DT,
+	OP_ST,
+	OP_RAM,
+	OP_DELTA,
+	OP_NEG,
+	OP_NOT,
+	// Binary
+	OP_MUL,
+	OP_ADD,
+	OP_SUB,
+	OP_LT,
+	OP_LE,
+	OP_GT,
+	OP_GE,
+	OP_EQ,
+	OP_NE,
+	OP_AND,
+	OP_XOR,
+	OP_OR,
+	OP_LAND,
+	OP_LOR,
+} watch_opcode_t;
+
+// Higher levels bind tighter. Two character operators come before their
+// one character prefixes so the longest match wins.
+static const struct {
+	const char *token;
+	watch_opcode_t op;
+	uint32_t level;
+} binary_ops[] = {
+		{"||", OP_LOR, 0},
+		{"&&", OP_LAND, 1},
+		{"<=", OP_LE, 6},
+		{">=", OP_GE, 6},
+		{"==", OP_EQ, 5},
+		{"!=", OP_NE, 5},
+		{"|", OP_OR, 2},
+		{"^", OP_XOR, 3},
+		{"&", OP_AND, 4},
+		{"<", OP_LT, 6},
+		{">", OP_GT, 6},
+		{"+", OP_ADD, 7},
+		{"-", OP_SUB, 7},
+		{"*", OP_MUL, 8},
+};
+#define LEVELS 9
+
+typedef struct {
+	watch_t *watch;
+	const char *expr;
+	const char *at;
+	uint32_t depth; // Of parse_unary calls, each nesting ( [ - or !
+	bool ok;
+} parser_t;
+
+static void fail(parser_t *parser, const char *what) {
+	if (parser->ok)
+		fprintf(stderr, "Watch expression \"%s\": %s at offset %d\n",
+						parser->expr, what, (int)(parser->at - parser->expr));
+	parser->ok = false;
+}
+
+static void emit(parser_t *parser, watch_opcode_t op, int32_t arg) {
+	watch_t *watch = parser->watch;
+	if (watch->count == WATCH_MAX_OPS) {
+		fail(parser, "too long");
+		return;
+	}
+	watch->ops[watch->count].op = op;
+	watch->ops[watch->count].arg = arg;
+	watch->count++;
+}
+
+static void skip_space(parser_t *parser) {
+	while (isspace((unsigned char)*parser->at))
+		parser->at++;
+}
+
+static bool accept(parser_t *parser, const char *token) {
+	skip_space(parser);
+	const size_t len = strlen(token);
+	if (strncmp(parser->at, token, len) != 0)
+		return false;
+	parser->at += len;
+	return true;
+}
+
+static void expect(parser_t *parser, const char *token) {
+	if (!accept(parser, token))
+		fail(parser, token[0] == ')' ? "expected )" : "expected ]");
+}
+
+// Name of letters and digits at the cursor, or 0 for none
+static size_t name_length(const parser_t *parser) {
+	size_t len = 0;
+	while (isalnum((unsigned char)parser->at[len]) || parser->at[len] == '_')
+		len++;
+	return len;
+}
+
+static bool is_name(const parser_t *parser, size_t len, const char *name) {
+	return len == strlen(name) && strncasecmp(parser->at, name, len) == 0;
+}
+
+static void parse_binary(parser_t *parser, uint32_t level);
+static void parse_unary(parser_t *parser);
+
+static void parse_term(parser_t *parser) {
+	skip_space(parser);
+	if (accept(parser, "-")) {
+		parse_unary(parser);
+		emit(parser, OP_NEG, 0);
+		return;
+	}
+	if (accept(parser, "!")) {
+		parse_unary(parser);
+		emit(parser, OP_NOT, 0);
+		return;
+	}
+	if (accept(parser, "(")) {
+		parse_binary(parser, 0);
+		expect(parser, ")");
+		return;
+	}
+	if (isdigit((unsigned char)*parser->at)) {
+		char *end;
+		const long value = strtol(parser->at, &end, 0);
+		parser->at = end;
+		emit(parser, OP_CONST, (int32_t)value);
+		return;
+	}
+
+	const size_t len = name_length(parser);
+	static const struct {
+		const char *name;
+		watch_opcode_t op;
+	} registers[] = {
+			{"I", OP_I}, {"PC", OP_PC}, {"DT", OP_DT}, {"ST", OP_ST}};
+	for (size_t i = 0; i < sizeof registers / sizeof *registers; i++) {
+		if (is_name(parser, len, registers[i].name)) {
+			parser->at += len;
+			emit(parser, registers[i].op, 0);
+			return;
+		}
+	}
+	if (len == 2 && toupper((unsigned char)parser->at[0]) == 'V' &&
+			isxdigit((unsigned char)parser->at[1])) {
+		const char digit[2] = {parser->at[1], '\0'};
+		parser->at += len;
+		emit(parser, OP_V, strtol(digit, NULL, 16));
+		return;
+	}
+	if (is_name(parser, len, "ram")) {
+		parser->at += len;
+		if (!accept(parser, "[")) {
+			fail(parser, "expected [");
+			return;
+		}
+		parse_binary(parser, 0);
+		expect(parser, "]");
+		emit(parser, OP_RAM, 0);
+		return;
+	}
+	if (is_name(parser, len, "delta")) {
+		parser->at += len;
+		if (!accept(parser, "(")) {
+			fail(parser, "expected (");
+			return;
+		}
+		parse_binary(parser, 0);
+		expect(parser, ")");
+		if (parser->watch->deltas == WATCH_MAX_DELTAS)
+			fail(parser, "too many delta()");
+		emit(parser, OP_DELTA, parser->watch->deltas++);
+		return;
+	}
+	fail(parser, "expected a number, register, ram[] or delta()");
+}
+
+// A term, nested no deeper than an expression that fits in WATCH_MAX_OPS
+// could be, so the recursion is bounded whatever the input
+static void parse_unary(parser_t *parser) {
+	if (parser->depth == WATCH_MAX_OPS) {
+		fail(parser, "nested too deeply");
+		return;
+	}
+	parser->depth++;
+	parse_term(parser);
+	parser->depth--;
+}
+
+// Operands joined by operators of `level` or tighter
+static void parse_binary(parser_t *parser, uint32_t level) {
+	if (level == LEVELS) {
+		parse_unary(parser);
+		return;
+	}
+	parse_binary(parser, level + 1);
+	while (parser->ok) {
+		skip_space(parser);
+		size_t i = 0;
+		while (i < sizeof binary_ops / sizeof *binary_ops &&
+					 strncmp(parser->at, binary_ops[i].token,
+									 strlen(binary_ops[i].token)) != 0)
+			i++;
+		if (i == sizeof binary_ops / sizeof *binary_ops ||
+				binary_ops[i].level != level)
+			return;
+		parser->at += strlen(binary_ops[i].token);
+		parse_binary(parser, level + 1);
+		emit(parser, binary_ops[i].op, 0);
+	}
+}
+
+bool watch_compile(watch_t *watch, const char *expr) {
+	*watch = (watch_t){0};
+	if (!expr || !*expr) {
+		watch->ops[0].op = OP_CONST;
+		watch->count = 1;
+		return true;
+	}
+	parser_t parser = {.watch = watch, .expr = expr, .at = expr, .ok = true};
+	parse_binary(&parser, 0);
+	skip_space(&parser);
+	if (parser.ok && *parser.at)
+		fail(&parser, "unexpected character");
+	return parser.ok;
+}
+
+int32_t watch_eval(const watch_t *watch, const chip8_t *chip8,
+									 int32_t prev[WATCH_MAX_DELTAS]) {
+	int32_t stack[WATCH_MAX_OPS];
+	uint32_t sp = 0;
+	for (uint32_t i = 0; i < watch->count; i++) {
+		const int32_t arg = watch->ops[i].arg;
+		// Wrapping arithmetic, as the operands are unsigned underneath
+		const uint32_t b = sp > 0 ? (uint32_t)stack[sp - 1] : 0;
+		const uint32_t a = sp > 1 ? (uint32_t)stack[sp - 2] : 0;
+		int32_t value;
+		switch ((watch_opcode_t)watch->ops[i].op) {
+		case OP_CONST:
+			stack[sp++] = arg;
+			continue;
+		case OP_V:
+			stack[sp++] = chip8->regs.V[arg];
+			continue;
+		case OP_I:
+			stack[sp++] = chip8->regs.I;
+			continue;
+		case OP_PC:
+			stack[sp++] = chip8->regs.PC;
+			continue;
+		case OP_DT:
+			stack[sp++] = chip8->regs.delay_timer;
+			continue;
+		case OP_ST:
+			stack[sp++] = chip8->regs.sound_timer;
+			continue;
+		case OP_RAM:
+			stack[sp - 1] = read_ram(chip8, b & (RAM_SIZE - 1));
+			continue;
+		case OP_DELTA:
+			stack[sp - 1] = (int32_t)(b - (uint32_t)prev[arg]);
+			prev[arg] = (int32_t)b;
+			continue;
+		case OP_NEG:
+			stack[sp - 1] = (int32_t)(0 - b);
+			continue;
+		case OP_NOT:
+			stack[sp - 1] = b == 0;
+			continue;
+		case OP_MUL:
+			value = (int32_t)(a * b);
+			break;
+		case OP_ADD:
+			value = (int32_t)(a + b);
+			break;
+		case OP_SUB:
+			value = (int32_t)(a - b);
+			break;
+		case OP_LT:
+			value = (int32_t)a < (int32_t)b;
+			break;
+		case OP_LE:
+			value = (int32_t)a <= (int32_t)b;
+			break;
+		case OP_GT:
+			value = (int32_t)a > (int32_t)b;
+			break;
+		case OP_GE:
+			value = (int32_t)a >= (int32_t)b;
+			break;
+		case OP_EQ:
+			value = a == b;
+			break;
+		case OP_NE:
+			value = a != b;
+			break;
+		case OP_AND:
+			value = (int32_t)(a & b);
+			break;
+		case OP_XOR:
+			value = (int32_t)(a ^ b);
+			break;
+		case OP_OR:
+			value = (int32_t)(a | b);
+			break;
+		case OP_LAND:
+			value = a && b;
+			break;
+		case OP_LOR:
+			value = a || b;
+			break;
+		default:
+			value = 0;
+		}
+		stack[--sp - 1] = value;
+	}
+	return sp ? stack[sp - 1] : 0;
+}
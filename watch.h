@@ -0,0 +1,37 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define WATCH_MAX_OPS 64
+#define WATCH_MAX_DELTAS 8 // delta() terms in one expression
+
+// RAM watch expression, compiled to a little stack program so evaluating
+// it allocates nothing. C syntax and precedence over 32 bit integers:
+//
+//   operands  123, 0x1F, V0..VF, I, PC, DT, ST, ram[expr], (expr)
+//   delta(e)  e minus its value at the previous evaluation
+//   unary     - !
+//   binary    * + - < <= > >= == != & ^ | && ||
+//
+// eg. a score kept as BCD digits: delta(ram[0x2F0]*100 + ram[0x2F1]*10 +
+// ram[0x2F2]). && and || evaluate both sides, so every delta() keeps up.
+typedef struct {
+	struct {
+		uint8_t op;
+		int32_t arg;
+	} ops[WATCH_MAX_OPS];
+	uint32_t count;
+	uint32_t deltas;
+} watch_t;
+
+// NULL or empty is the constant 0. Reports what is wrong on stderr.
+bool watch_compile(watch_t *watch, const char *expr);
+// `prev` holds each delta() term's last value and is updated
+int32_t watch_eval(const watch_t *watch, const chip8_t *chip8,
+									 int32_t prev[WATCH_MAX_DELTAS]);
+
+#endif
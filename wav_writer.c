@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "wav_writer.h"
+
+// Store a little endian value regardless of host byte order
+static void put_le(uint8_t *out, uint32_t value, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+// 44 byte canonical RIFF/WAVE header for mono 16 bit PCM
+static void write_wav_header(wav_writer_t *writer) {
+	const uint32_t data_size = (uint32_t)(writer->samples * sizeof(int16_t));
+	uint8_t header[44];
+	memcpy(&header[0], "RIFF", 4);
+	put_le(&header[4], 36 + data_size, 4);
+	memcpy(&header[8], "WAVEfmt ", 8);
+	put_le(&header[16], 16, 4);												// fmt chunk size
+	put_le(&header[20], 1, 2);												// PCM
+	put_le(&header[22], 1, 2);												// Mono
+	put_le(&header[24], writer->sample_rate, 4);			// Sample rate
+	put_le(&header[28], writer->sample_rate * 2, 4); // Byte rate
+	put_le(&header[32], 2, 2);												// Block align
+	put_le(&header[34], 16, 2);												// Bits per sample
+	memcpy(&header[36], "data", 4);
+	put_le(&header[40], data_size, 4);
+	fwrite(header, sizeof header, 1, writer->file);
+}
+
+// Writer thread: drain full chunks to the file until closed
+static void *writer_thread(void *arg) {
+	wav_writer_t *writer = arg;
+	uint8_t bytes[WAV_CHUNK_SAMPLES * sizeof(int16_t)];
+
+	pthread_mutex_lock(&writer->lock);
+	for (;;) {
+		while (writer->tail == writer->head && !writer->done)
+			pthread_cond_wait(&writer->cond, &writer->lock);
+		if (writer->tail == writer->head)
+			break; // done and drained
+
+		const uint32_t slot = writer->tail & (WAV_CHUNKS - 1);
+		const uint32_t len = writer->lens[slot];
+		pthread_mutex_unlock(&writer->lock);
+
+		// Samples are always stored little endian on disk
+		for (uint32_t i = 0; i < len; i++)
+			put_le(&bytes[i * 2], (uint16_t)writer->chunks[slot][i], 2);
+		if (fwrite(bytes, 2, len, writer->file) != len)
+			writer->error = true;
+
+		pthread_mutex_lock(&writer->lock);
+		writer->tail++;
+		pthread_cond_broadcast(&writer->cond);
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return NULL;
+}
+
+// Open `path` for streaming; a .wav extension selects a RIFF header,
+// anything else is written as headerless little endian PCM
+wav_writer_t *wav_writer_open(const char *path, uint32_t sample_rate) {
+	wav_writer_t *writer = calloc(1, sizeof *writer);
+	if (!writer)
+		return NULL;
+
+	writer->file = fopen(path, "wb");
+	if (!writer->file) {
+		free(writer);
+		return NULL;
+	}
+	const char *ext = strrchr(path, '.');
+	writer->wav = ext && strcmp(ext, ".wav") == 0;
+	writer->sample_rate = sample_rate;
+	if (writer->wav)
+		write_wav_header(writer); // Placeholder sizes, patched on close
+
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0) {
+		fclose(writer->file);
+		free(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+// Hand the current chunk to the writer thread, waiting only if every
+// chunk is still queued
+static void submit_chunk(wav_writer_t *writer) {
+	pthread_mutex_lock(&writer->lock);
+	writer->lens[writer->head & (WAV_CHUNKS - 1)] = writer->fill;
+	writer->head++;
+	pthread_cond_broadcast(&writer->cond);
+	while (writer->head - writer->tail == WAV_CHUNKS)
+		pthread_cond_wait(&writer->cond, &writer->lock);
+	pthread_mutex_unlock(&writer->lock);
+	writer->fill = 0;
+}
+
+void wav_writer_write(wav_writer_t *writer, const int16_t *samples,
+											uint32_t count) {
+	while (count > 0) {
+		int16_t *chunk = writer->chunks[writer->head & (WAV_CHUNKS - 1)];
+		uint32_t n = WAV_CHUNK_SAMPLES - writer->fill;
+		if (n > count)
+			n = count;
+		memcpy(&chunk[writer->fill], samples, n * sizeof *samples);
+		writer->fill += n;
+		writer->samples += n;
+		samples += n;
+		count -= n;
+		if (writer->fill == WAV_CHUNK_SAMPLES)
+			submit_chunk(writer);
+	}
+}
+
+// Flush, stop the writer thread, fix up the header and free the writer
+bool wav_writer_close(wav_writer_t *writer) {
+	if (writer->fill > 0)
+		submit_chunk(writer);
+
+	pthread_mutex_lock(&writer->lock);
+	writer->done = true;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+
+	if (writer->wav) {
+		rewind(writer->file);
+		write_wav_header(writer);
+	}
+	bool ok = !writer->error && fclose(writer->file) == 0;
+
+	pthread_mutex_destroy(&writer->lock);
+	pthread_cond_destroy(&writer->cond);
+	free(writer);
+	return ok;
+}
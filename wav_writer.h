@@ -0,0 +1,39 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define WAV_CHUNK_SAMPLES 16384 // Samples per buffer handed to the writer thread
+#define WAV_CHUNKS 8						// Buffers in flight, must be a power of 2
+
+// Streams mono 16 bit PCM to a .wav (or headerless raw) file. The emulation
+// thread fills a chunk and hands it over; a background thread does the
+// file I/O so a slow disk never stalls emulation for more than a handoff.
+typedef struct {
+	FILE *file;
+	bool wav; // Write a RIFF header, patched with the final size on close
+	uint32_t sample_rate;
+	uint64_t samples; // Total samples written
+
+	int16_t chunks[WAV_CHUNKS][WAV_CHUNK_SAMPLES];
+	uint32_t lens[WAV_CHUNKS];
+	uint32_t head; // Next chunk the emulation thread fills
+	uint32_t tail; // Next chunk the writer thread drains
+	uint32_t fill; // Samples already in chunks[head]
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool done;
+	bool error;
+} wav_writer_t;
+
+wav_writer_t *wav_writer_open(const char *path, uint32_t sample_rate);
+void wav_writer_write(wav_writer_t *writer, const int16_t *samples,
+											uint32_t count);
+bool wav_writer_close(wav_writer_t *writer);
+
+#endif